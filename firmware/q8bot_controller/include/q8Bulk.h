@@ -0,0 +1,271 @@
+/*
+  q8Bulk.h - Chunked, acknowledged bulk transfer over ESP-NOW, used for the
+  recorded data dump (special command 3). Shared by the robot (sender) and the
+  controller (receiver) firmware. Keep both copies of this file identical.
+
+  The sender keeps one chunk in flight and sends the next one from the ESP-NOW
+  send callback. The last chunk of each pass asks for an ack, which carries a
+  bitmap of the chunks still missing. Those are sent again until none are left.
+*/
+#ifndef q8Bulk_h
+#define q8Bulk_h
+
+#include <Arduino.h>
+#include "q8Protocol.h"
+
+const uint8_t BULK_CHUNK_DATA = 240;
+const uint32_t BULK_MAX_BYTES = 16384;
+const uint16_t BULK_MAX_CHUNKS = (BULK_MAX_BYTES + BULK_CHUNK_DATA - 1) / BULK_CHUNK_DATA;
+const uint8_t BULK_BITMAP_LEN = (BULK_MAX_CHUNKS + 7) / 8;
+const uint32_t BULK_ACK_TIMEOUT_MS = 100;   // Poll again if no ack by then
+const uint8_t BULK_MAX_POLLS = 10;          // Give up after this many unanswered polls
+
+enum BulkFlag : uint8_t{
+  BULK_FLAG_POLL = 1 << 0,  // Last chunk of a pass, receiver answers with an ack
+};
+
+struct BulkChunk{
+  uint8_t msgType = BULK_DATA;
+  uint8_t transfer = 0;     // Changes with every transfer
+  uint8_t flags = 0;
+  uint16_t index = 0;
+  uint32_t totalLen = 0;    // Bytes in the whole transfer
+  uint8_t data[BULK_CHUNK_DATA];
+} __attribute__((packed));
+const uint8_t BULK_HEADER_LEN = offsetof(BulkChunk, data);
+static_assert(sizeof(BulkChunk) <= 250, "bulk chunk exceeds ESP-NOW payload");
+
+struct BulkAck{
+  uint8_t msgType = BULK_ACK;
+  uint8_t transfer = 0;
+  uint16_t missing = 0;                    // Chunks still missing, 0 = complete
+  uint8_t bitmap[BULK_BITMAP_LEN] = {0};   // Bit i set if chunk i is missing
+} __attribute__((packed));
+
+inline uint16_t q8BulkChunks(uint32_t len){
+  return (len + BULK_CHUNK_DATA - 1) / BULK_CHUNK_DATA;
+}
+
+class q8BulkSender
+{
+  public:
+    enum State : uint8_t{ IDLE, SENDING, WAIT_ACK, DONE, FAILED };
+
+    // data must stay valid until the transfer is DONE or FAILED
+    bool start(const uint8_t* data, uint32_t len, uint32_t nowMs){
+      if (len == 0 || len > BULK_MAX_BYTES || active()) return false;
+      _data = data;
+      _len = len;
+      _chunks = q8BulkChunks(len);
+      // Start time as id, so a rebooted robot does not repeat the last one
+      uint8_t id = static_cast<uint8_t>(nowMs);
+      _transfer = (id == _transfer) ? id + 1 : id;
+      memset(_pending, 0, sizeof(_pending));
+      for (uint16_t i = 0; i < _chunks; i++) _pending[i / 8] |= 1 << (i % 8);
+      _inFlight = -1;
+      _polls = 0;
+      _frames = 0;
+      _startMs = nowMs;
+      _state = SENDING;
+      return true;
+    }
+
+    // Next frame to send. False while a frame is in flight or an ack is due.
+    bool next(uint32_t nowMs, BulkChunk& out, size_t& len){
+      if (_inFlight >= 0) return false;
+      uint16_t index;
+      if (_state == SENDING){
+        if (!_firstPending(index)){
+          _state = WAIT_ACK;
+          _waitMs = nowMs;
+          return false;
+        }
+      } else if (_state == WAIT_ACK && nowMs - _waitMs >= BULK_ACK_TIMEOUT_MS){
+        if (++_polls > BULK_MAX_POLLS){
+          _state = FAILED;
+          _endMs = nowMs;
+          return false;
+        }
+        index = _lastIndex;   // Ack lost, poll again with the last chunk
+      } else {
+        return false;
+      }
+
+      _pending[index / 8] &= ~(1 << (index % 8));
+      uint16_t unused;
+      out.msgType = BULK_DATA;
+      out.transfer = _transfer;
+      out.flags = _firstPending(unused) ? 0 : BULK_FLAG_POLL;
+      out.index = index;
+      out.totalLen = _len;
+      uint32_t offset = static_cast<uint32_t>(index) * BULK_CHUNK_DATA;
+      size_t n = _len - offset < BULK_CHUNK_DATA ? _len - offset : BULK_CHUNK_DATA;
+      memcpy(out.data, _data + offset, n);
+      len = BULK_HEADER_LEN + n;
+
+      _inFlight = index;
+      _inFlightPoll = out.flags & BULK_FLAG_POLL;
+      _lastIndex = index;
+      _frames++;
+      return true;
+    }
+
+    // Send callback of the frame returned by next(). A failed send is queued
+    // again right away instead of waiting for the ack.
+    void sent(bool ok, uint32_t nowMs){
+      if (_inFlight < 0) return;
+      if (!ok){
+        _pending[_inFlight / 8] |= 1 << (_inFlight % 8);
+        if (_state == WAIT_ACK) _state = SENDING;
+      } else if (_inFlightPoll){
+        _state = WAIT_ACK;
+        _waitMs = nowMs;
+      }
+      _inFlight = -1;
+    }
+
+    void onAck(const BulkAck& ack, uint32_t nowMs){
+      if (ack.transfer != _transfer || !active()) return;
+      if (ack.missing == 0){
+        _state = DONE;
+        _endMs = nowMs;
+        return;
+      }
+      bool any = false;
+      for (uint16_t i = 0; i < _chunks; i++){
+        if (ack.bitmap[i / 8] & (1 << (i % 8))){
+          _pending[i / 8] |= 1 << (i % 8);
+          any = true;
+        }
+      }
+      if (any){
+        _polls = 0;
+        _state = SENDING;
+      }
+    }
+
+    // Back to IDLE after the caller has seen DONE or FAILED
+    void reset(){ if (!active()) _state = IDLE; }
+
+    State state() const { return _state; }
+    bool active() const { return _state == SENDING || _state == WAIT_ACK; }
+    uint32_t length() const { return _len; }
+    uint16_t chunks() const { return _chunks; }
+    uint16_t retransmits() const { return _frames - _chunks; }
+    uint32_t elapsedMs() const { return _endMs - _startMs; }
+
+  private:
+    const uint8_t* _data = nullptr;
+    uint32_t _len = 0;
+    uint16_t _chunks = 0;
+    uint8_t _transfer = 0;
+    uint8_t _pending[BULK_BITMAP_LEN];
+    int32_t _inFlight = -1;
+    bool _inFlightPoll = false;
+    uint16_t _lastIndex = 0;
+    uint8_t _polls = 0;
+    uint16_t _frames = 0;
+    uint32_t _startMs = 0;
+    uint32_t _endMs = 0;
+    uint32_t _waitMs = 0;
+    State _state = IDLE;
+
+    bool _firstPending(uint16_t& index) const {
+      for (uint16_t i = 0; i < _chunks; i++){
+        if (_pending[i / 8] & (1 << (i % 8))){
+          index = i;
+          return true;
+        }
+      }
+      return false;
+    }
+};
+
+class q8BulkReceiver
+{
+  public:
+    // Handles one BULK_DATA frame. Returns true if ack must be sent back.
+    bool onChunk(const uint8_t* frame, size_t len, uint32_t nowMs, BulkAck& ack){
+      _completedNow = false;
+      if (len < BULK_HEADER_LEN) return false;
+      BulkChunk chunk;
+      memcpy(&chunk, frame, len < sizeof(chunk) ? len : sizeof(chunk));
+      if (chunk.totalLen == 0 || chunk.totalLen > BULK_MAX_BYTES) return false;
+      if (chunk.index >= q8BulkChunks(chunk.totalLen)) return false;
+
+      // A new transfer id or length starts over
+      if (!_started || chunk.transfer != _transfer || chunk.totalLen != _len){
+        _started = true;
+        _transfer = chunk.transfer;
+        _len = chunk.totalLen;
+        _chunks = q8BulkChunks(_len);
+        memset(_have, 0, sizeof(_have));
+        _received = 0;
+        _duplicates = 0;
+        _firstPassLost = -1;
+        _startMs = nowMs;
+      }
+
+      uint32_t offset = static_cast<uint32_t>(chunk.index) * BULK_CHUNK_DATA;
+      size_t n = _len - offset < BULK_CHUNK_DATA ? _len - offset : BULK_CHUNK_DATA;
+      if (len < BULK_HEADER_LEN + n) return false;
+
+      bool completed = false;
+      if (_have[chunk.index / 8] & (1 << (chunk.index % 8))){
+        _duplicates++;
+      } else {
+        memcpy(_buf + offset, chunk.data, n);
+        _have[chunk.index / 8] |= 1 << (chunk.index % 8);
+        _received++;
+        if (_received == _chunks){
+          completed = true;
+          _completedNow = true;
+          _endMs = nowMs;
+        }
+      }
+      if (!(chunk.flags & BULK_FLAG_POLL) && !completed) return false;
+
+      ack.msgType = BULK_ACK;
+      ack.transfer = _transfer;
+      ack.missing = _chunks - _received;
+      memset(ack.bitmap, 0, sizeof(ack.bitmap));
+      for (uint16_t i = 0; i < _chunks; i++){
+        if (!(_have[i / 8] & (1 << (i % 8)))) ack.bitmap[i / 8] |= 1 << (i % 8);
+      }
+      if (_firstPassLost < 0) _firstPassLost = ack.missing;
+      return true;
+    }
+
+    // True if frame is part of the current transfer, so onChunk() leaves data() as it is
+    bool sameTransfer(const uint8_t* frame, size_t len) const {
+      if (!_started || len < BULK_HEADER_LEN) return false;
+      uint32_t totalLen;
+      memcpy(&totalLen, frame + offsetof(BulkChunk, totalLen), sizeof(totalLen));
+      return frame[offsetof(BulkChunk, transfer)] == _transfer && totalLen == _len;
+    }
+
+    bool complete() const { return _started && _received == _chunks; }
+    bool completedNow() const { return _completedNow; }   // Last onChunk() finished the transfer
+    const uint8_t* data() const { return _buf; }
+    uint32_t length() const { return _len; }
+    uint16_t chunks() const { return _chunks; }
+    uint16_t duplicates() const { return _duplicates; }
+    uint16_t firstPassLost() const { return _firstPassLost < 0 ? 0 : _firstPassLost; }
+    uint32_t elapsedMs() const { return _endMs - _startMs; }
+
+  private:
+    uint8_t _buf[BULK_MAX_BYTES];
+    uint8_t _have[BULK_BITMAP_LEN];
+    bool _started = false;
+    uint8_t _transfer = 0;
+    uint32_t _len = 0;
+    uint16_t _chunks = 0;
+    uint16_t _received = 0;
+    uint16_t _duplicates = 0;
+    int32_t _firstPassLost = -1;
+    bool _completedNow = false;
+    uint32_t _startMs = 0;
+    uint32_t _endMs = 0;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*
+  q8Config.h - Settings kept in NVS across power cycles: the paired peer, its
+  channel, and the servo gains and default move duration. Shared by the robot
+  and controller firmware. Keep both copies of this file identical.
+
+  The namespace stays open and every setting lives in one versioned record
+  cached in RAM. Setters only change the cache; commit(), called from a low
+  priority task, writes the record once it has been unchanged for a while
+  and differs from flash. Unpairing and pairing the same peer again before
+  then costs no flash write at all.
+*/
+#ifndef q8Config_h
+#define q8Config_h
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <mutex>
+
+const uint8_t CONFIG_VERSION = 1;
+const uint8_t CONFIG_JOINTS = 8;
+const uint32_t CONFIG_COMMIT_DELAY_MS = 2000;   // Quiet time before a write
+
+enum ConfigFlags : uint8_t{
+  CONFIG_HAS_PEER = 1 << 0,
+};
+
+struct q8ConfigRecord{
+  uint8_t version = CONFIG_VERSION;
+  uint8_t flags = 0;
+  uint8_t peerMac[6] = {0};
+  uint8_t channel = 1;                    // Wi-Fi channel of the pair
+  uint8_t reserved = 0;
+  uint16_t gain[CONFIG_JOINTS] = {400, 400, 400, 400, 400, 400, 400, 400};  // Position P gain
+  uint16_t profile = 1000;                // Default move duration, ms
+} __attribute__((packed));
+
+struct q8ConfigStats{
+  uint32_t writes;        // Records written to flash
+  uint32_t skipped;       // Commits with nothing new for flash
+};
+
+class q8Config
+{
+  public:
+    // Open the namespace and load the record. Defaults when there is none or
+    // it is of another version; the MAC of the old per-key storage is taken over.
+    bool begin(const char* name = "q8bot");
+
+    bool loadPeerMAC(uint8_t* mac);
+    void savePeerMAC(const uint8_t* mac, uint8_t channel);
+    void clearPeerMAC();
+    uint8_t channel();
+
+    void getGain(uint16_t gain[CONFIG_JOINTS]);
+    void setGain(const uint16_t gain[CONFIG_JOINTS]);
+    uint16_t profile();
+    void setProfile(uint16_t profile);
+
+    // Low priority task. Writes the record if it changed and has been quiet
+    // for CONFIG_COMMIT_DELAY_MS, or at once with force. True if written.
+    bool commit(uint32_t now, bool force = false);
+    bool pending();
+
+    const q8ConfigStats& stats() const { return _stats; }
+
+  private:
+    Preferences _prefs;
+    std::mutex _lock;             // RX task sets, the commit task reads
+    q8ConfigRecord _ram;
+    q8ConfigRecord _flash;        // What NVS holds
+    bool _changed = false;
+    uint32_t _changedAt = 0;
+    bool _legacyKey = false;      // Old "peerMAC" key still to be removed
+    q8ConfigStats _stats = {};
+
+    void _touch();
+};
+
+#endif
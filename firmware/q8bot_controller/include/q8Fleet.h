@@ -0,0 +1,162 @@
+/*
+  q8Fleet.h - The robots one controller drives. A robot keeps the slot it
+  paired into, and the slot number is its ID towards the PC (FleetHeader).
+  Pairing, heartbeats and link statistics are kept per robot.
+
+  Slots are taken by the ESP-NOW RX task and dropped by whichever task
+  unpairs; the others only read them. Timestamps are millis().
+*/
+#ifndef q8Fleet_h
+#define q8Fleet_h
+
+#include <Arduino.h>
+#include <atomic>
+#include "q8Protocol.h"
+#include "q8Link.h"
+
+const uint8_t FLEET_MAX = 8;                        // One bit each in FleetHeader::robots
+
+const unsigned long HEARTBEAT_INTERVAL = 2000;      // Send every 2s
+const unsigned long HEARTBEAT_RETRY_INTERVAL = 250; // While the last echo is missing
+const unsigned long HEARTBEAT_TIMEOUT = 5000;       // Unpair after 5s no response
+
+struct q8Robot{
+  uint8_t mac[6] = {0};
+  bool used = false;                      // Slot belongs to mac
+  volatile bool paired = false;
+  volatile unsigned long lastHeartbeatReceived = 0;
+  volatile unsigned long lastDataReceived = 0;    // Robot traffic other than echoes
+  volatile unsigned long lastCommandSent = 0;     // Our traffic that keeps the robot alive
+  uint16_t commandSeq = 0;                // sendCommand(): last command to this robot
+  std::atomic<uint16_t> heartbeatSeq{0};
+  volatile uint32_t heartbeatRttUs = 0;   // Latest echo, goes out with the next heartbeat
+  volatile uint16_t heartbeatEchoSeq = 0;
+  uint16_t lastSeq = 0;                   // heartbeatTask: our last heartbeat, 0 = none waiting
+  uint32_t heartbeatsSent = 0;
+  uint32_t heartbeatsSkipped = 0;         // Robot traffic proved the link instead
+  q8LinkStats linkStats;                  // Heartbeat echoes, espnowRxTask only
+};
+
+enum FleetBeat : uint8_t{
+  BEAT_IDLE,        // Robot not paired
+  BEAT_SKIP,        // Commands and data flow both ways, no heartbeat needed
+  BEAT_SEND,        // Send a heartbeat now
+};
+
+class q8Fleet
+{
+  public:
+    // Pairs with up to size robots, at most FLEET_MAX
+    explicit q8Fleet(uint8_t size) : _size(size < FLEET_MAX ? size : FLEET_MAX) {}
+
+    uint8_t size() const { return _size; }
+    q8Robot& operator[](uint8_t id){ return _robots[id]; }
+    const q8Robot& operator[](uint8_t id) const { return _robots[id]; }
+
+    // Slot of a paired or lost robot, -1 for a stranger
+    int8_t find(const uint8_t* mac) const {
+      for (uint8_t i = 0; i < _size; i++){
+        if (_robots[i].used && memcmp(_robots[i].mac, mac, 6) == 0) return i;
+      }
+      return -1;
+    }
+
+    // Slot for a robot that answered pairing: its own, a free one, or that of
+    // a lost robot it replaces. -1 while every slot has a paired robot.
+    int8_t slotFor(const uint8_t* mac) const {
+      int8_t id = find(mac);
+      if (id >= 0) return id;
+      for (uint8_t i = 0; i < _size; i++){
+        if (!_robots[i].used) return i;
+      }
+      for (uint8_t i = 0; i < _size; i++){
+        if (!_robots[i].paired) return i;
+      }
+      return -1;
+    }
+
+    // RX task, slot from slotFor(). A new robot in the slot starts its
+    // heartbeats, command seq and statistics over.
+    void pair(uint8_t id, const uint8_t* mac, unsigned long now){
+      q8Robot& r = _robots[id];
+      if (!r.used || memcmp(r.mac, mac, 6) != 0){
+        memcpy(r.mac, mac, 6);
+        r.heartbeatSeq = 0;
+        r.commandSeq = 0;
+        r.heartbeatRttUs = 0;
+        r.heartbeatEchoSeq = 0;
+        r.lastSeq = 0;
+        r.heartbeatsSent = 0;
+        r.heartbeatsSkipped = 0;
+        r.linkStats.reset();
+      }
+      r.used = true;
+      r.lastHeartbeatReceived = now;
+      r.paired = true;
+    }
+
+    // Lost robot, keeps its slot until another robot needs it
+    void unpair(uint8_t id){ _robots[id].paired = false; }
+
+    // Every robot dropped, e.g. forced pairing
+    void forget(){
+      for (uint8_t i = 0; i < _size; i++){
+        _robots[i].paired = false;
+        _robots[i].used = false;
+      }
+    }
+
+    uint8_t pairedMask() const {
+      uint8_t mask = 0;
+      for (uint8_t i = 0; i < _size; i++){
+        if (_robots[i].paired) mask |= 1 << i;
+      }
+      return mask;
+    }
+
+    uint8_t pairedCount() const {
+      uint8_t n = 0;
+      for (uint8_t i = 0; i < _size; i++) n += _robots[i].paired;
+      return n;
+    }
+
+    // No more robots to pair, the broadcast can stop
+    bool full() const { return pairedCount() == _size; }
+
+    // heartbeatTask, for each robot. wait is when to look at it again; the
+    // caller sends on BEAT_SEND and keeps the seq in lastSeq.
+    FleetBeat beat(uint8_t id, unsigned long now, unsigned long& wait){
+      q8Robot& r = _robots[id];
+      wait = HEARTBEAT_INTERVAL;
+      if (!r.paired) return BEAT_IDLE;
+      if (now - r.lastDataReceived < HEARTBEAT_INTERVAL && now - r.lastCommandSent < HEARTBEAT_INTERVAL){
+        r.heartbeatsSkipped++;
+        r.lastSeq = 0;
+        return BEAT_SKIP;
+      }
+      // Previous echo missing: check again sooner, the link may be going
+      if (r.lastSeq != 0 && r.heartbeatEchoSeq != r.lastSeq) wait = HEARTBEAT_RETRY_INTERVAL;
+      return BEAT_SEND;
+    }
+
+    bool timedOut(uint8_t id, unsigned long now) const {
+      // Signed, the RX task may have stamped a later time than now
+      return _robots[id].paired && (long)(now - _robots[id].lastHeartbeatReceived) > (long)HEARTBEAT_TIMEOUT;
+    }
+
+  private:
+    q8Robot _robots[FLEET_MAX];
+    uint8_t _size;
+};
+
+// A robot's packet behind its FleetHeader, as the payload of a serial frame
+// to the PC. out needs len + sizeof(FleetHeader) bytes. Returns the length.
+inline uint8_t q8FleetWrap(uint8_t* out, uint8_t robot, const uint8_t* data, uint8_t len){
+  FleetHeader h;
+  h.robots = 1 << robot;
+  memcpy(out, &h, sizeof(h));
+  memcpy(out + sizeof(h), data, len);
+  return len + sizeof(h);
+}
+
+#endif
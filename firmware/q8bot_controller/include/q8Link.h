@@ -0,0 +1,145 @@
+/*
+  q8Link.h - Fast resume of the ESP-NOW link to a saved peer. After a reset or
+  a lost link, a board that knows its peer probes it directly, quickly at
+  first and then backing off, instead of waiting for the 2 s pairing
+  broadcast. Shared by the robot and controller firmware. Keep both copies of
+  this file identical.
+
+  One task polls the schedule and sends the probes; the RX task stops it as
+  soon as anything arrives from the peer.
+
+  q8LinkStats keeps heartbeat statistics. It is owned by the RX task on each
+  board.
+*/
+#ifndef q8Link_h
+#define q8Link_h
+
+#include <Arduino.h>
+#include <algorithm>
+#include <atomic>
+
+// Wait after each probe. The first goes out at once, the schedule ends
+// LINK_PROBE_MS[LINK_PROBES - 1] after the last one.
+const uint16_t LINK_PROBE_MS[] = {10, 20, 50, 100, 200, 500, 1000};
+const uint8_t LINK_PROBES = sizeof(LINK_PROBE_MS) / sizeof(LINK_PROBE_MS[0]);
+
+enum LinkProbeStep : uint8_t{
+  PROBE_IDLE,       // Nothing to send yet, or not probing
+  PROBE_SEND,       // Send a probe now
+  PROBE_EXPIRED,    // No answer to any probe, fall back to the broadcast
+};
+
+class q8LinkProbe
+{
+  public:
+    // Prober side. Restarts the schedule, the first probe is due at once.
+    void start(uint32_t now){
+      _startMs = now;
+      _next = now;
+      _sent = 0;
+      _active.store(true, std::memory_order_release);
+    }
+
+    // Any task, once the peer has been heard from. True if a probe was running.
+    bool stop(){ return _active.exchange(false, std::memory_order_acq_rel); }
+    bool active() const { return _active.load(std::memory_order_acquire); }
+
+    // Prober side, whenever it wakes
+    LinkProbeStep poll(uint32_t now){
+      if (!active() || (int32_t)(now - _next) < 0) return PROBE_IDLE;
+      if (_sent == LINK_PROBES){
+        _active.store(false, std::memory_order_release);
+        return PROBE_EXPIRED;
+      }
+      _next = now + LINK_PROBE_MS[_sent++];
+      return PROBE_SEND;
+    }
+
+    // Prober side. ms until poll() has something to do.
+    uint32_t wait(uint32_t now) const {
+      int32_t left = (int32_t)(_next - now);
+      return left > 0 ? left : 0;
+    }
+
+    uint32_t elapsed(uint32_t now) const { return now - _startMs; }
+    uint8_t sent() const { return _sent; }
+
+  private:
+    std::atomic<bool> _active{false};
+    uint32_t _startMs = 0;
+    uint32_t _next = 0;
+    uint8_t _sent = 0;
+};
+
+// RTT over the last LINK_WINDOW heartbeats. Loss is counted since the start,
+// a window this short holds too few lost heartbeats for a usable rate.
+const uint8_t LINK_WINDOW = 32;
+
+struct q8LinkQuality{
+  uint8_t samples;          // RTT samples in the window
+  uint16_t lossPermille;    // Lost heartbeats since the start, per mille
+  uint32_t received;        // Heartbeats since the start
+  uint32_t lost;            // Missing from the seq since the start
+  uint32_t rttMinUs;
+  uint32_t rttMeanUs;
+  uint32_t rttP99Us;
+};
+
+class q8LinkStats
+{
+  public:
+    // A heartbeat (or its echo) with this seq arrived. Missing seqs since the
+    // previous one count as lost; late or repeated ones are ignored.
+    void received(uint16_t seq){
+      if (_started){
+        int16_t gap = (int16_t)(seq - _lastSeq);
+        if (gap <= 0) return;
+        _lost += gap - 1;
+      }
+      _started = true;
+      _lastSeq = seq;
+      _received++;
+    }
+
+    // The sender restarted its seq, e.g. after a reset
+    void reset(){ *this = q8LinkStats(); }
+
+    void rtt(uint32_t us){
+      _rtt[_rttHead] = us;
+      _rttHead = (_rttHead + 1) % LINK_WINDOW;
+      if (_rttCount < LINK_WINDOW) _rttCount++;
+    }
+
+    q8LinkQuality summary() const {
+      q8LinkQuality q = {};
+      q.samples = _rttCount;
+      q.received = _received;
+      q.lost = _lost;
+      uint32_t total = _received + _lost;
+      q.lossPermille = total ? (uint64_t)_lost * 1000 / total : 0;
+      if (_rttCount == 0) return q;
+
+      uint32_t sorted[LINK_WINDOW];
+      uint64_t sum = 0;
+      for (uint8_t i = 0; i < _rttCount; i++){
+        sorted[i] = _rtt[i];
+        sum += _rtt[i];
+      }
+      std::sort(sorted, sorted + _rttCount);
+      q.rttMinUs = sorted[0];
+      q.rttMeanUs = sum / _rttCount;
+      q.rttP99Us = sorted[(_rttCount * 99) / 100];
+      return q;
+    }
+
+  private:
+    uint32_t _received = 0;
+    uint32_t _lost = 0;
+    uint16_t _lastSeq = 0;
+    bool _started = false;
+    uint32_t _rtt[LINK_WINDOW] = {0};
+    uint8_t _rttHead = 0;
+    uint8_t _rttCount = 0;
+};
+
+#endif
@@ -0,0 +1,72 @@
+/*
+  q8PacketPool.h - Preallocated ESP-NOW receive packets. The receive callback
+  copies each packet once into a free slot and passes only the pointer through
+  the RX queue; the RX task parses it in place and releases the slot. Shared
+  by the robot and controller firmware. Keep both copies of this file identical.
+
+  Lock-free: one bit per free slot, so acquire() (receive callback) and
+  release() (RX task) never wait on each other.
+*/
+#ifndef q8PacketPool_h
+#define q8PacketPool_h
+
+#include <Arduino.h>
+#include <atomic>
+
+struct q8Packet{
+  uint8_t data[250 + 1];   // ESP-NOW payload, NUL terminated for the CSV path
+  uint8_t len;
+  uint8_t mac[6];
+  uint32_t timestamp;      // micros() in the receive callback
+};
+
+struct q8PacketPoolStats{
+  uint32_t received;       // Packets that got a slot
+  uint32_t exhausted;      // Packets lost, no free slot
+  uint32_t dropped;        // Packets lost, RX queue full
+  uint8_t peak;            // Most slots in use at once
+};
+
+template <uint8_t N>
+class q8PacketPool
+{
+  static_assert(N > 0 && N <= 32, "one bit per slot");
+
+  public:
+    // Receive callback. Returns nullptr when every slot is in use.
+    q8Packet* acquire(){
+      uint32_t freeMask = _free.load(std::memory_order_acquire);
+      while (freeMask != 0){
+        uint32_t bit = freeMask & (~freeMask + 1);    // Lowest free slot
+        if (_free.compare_exchange_weak(freeMask, freeMask & ~bit, std::memory_order_acq_rel)){
+          uint8_t inUse = N - __builtin_popcount(freeMask & ~bit);
+          if (inUse > _stats.peak) _stats.peak = inUse;
+          _stats.received++;
+          return &_slots[__builtin_ctz(bit)];
+        }
+      }
+      _stats.exhausted++;
+      return nullptr;
+    }
+
+    // RX task, once the packet is handled
+    void release(q8Packet* packet){
+      _free.fetch_or(1u << (packet - _slots), std::memory_order_release);
+    }
+
+    // Receive callback, when the packet could not be queued
+    void drop(q8Packet* packet){
+      _stats.dropped++;
+      release(packet);
+    }
+
+    uint8_t available() const { return __builtin_popcount(_free.load()); }
+    const q8PacketPoolStats& stats() const { return _stats; }
+
+  private:
+    q8Packet _slots[N];
+    std::atomic<uint32_t> _free{N == 32 ? 0xFFFFFFFFu : (1u << N) - 1};
+    q8PacketPoolStats _stats = {};
+};
+
+#endif
@@ -0,0 +1,279 @@
+/*
+  q8Protocol.h - ESP-NOW message definitions shared by the Q8bot robot and
+  controller firmware. Keep both copies of this file identical.
+*/
+#ifndef q8Protocol_h
+#define q8Protocol_h
+
+#include <Arduino.h>
+
+// ESP-NOW Messaging Types
+enum MsgType : uint8_t{
+  PAIRING,
+  DATA,
+  HEARTBEAT,
+  COMMAND,
+  TELEMETRY,
+  BULK_DATA,      // Chunk of a bulk transfer, see q8Bulk.h
+  BULK_ACK,
+  TRACE,          // Latency trace records, robot to controller to PC
+  LINK_STATS,     // Link quality summary, controller to PC
+  SYNC_START,     // Group start of held commands, controller broadcast to robots
+  FLEET,          // FleetHeader, PC and controller only
+};
+
+// Special commands carried by the 9th CSV value / CommandMessage::special
+enum SpecialCmd : uint8_t{
+  CMD_NONE = 0,
+  CMD_BATTERY = 1,
+  CMD_RECORD = 2,
+  CMD_SEND_RECORDED = 3,
+  CMD_JUMP = 4,
+  CMD_GAIT = 5,         // pos[0..3] = gait, direction, stride %, period ms
+  CMD_TELEMETRY = 6,    // pos[0] = sample rate in Hz, 0 stops the stream
+  CMD_MOTION = 7,       // pos[0] = MotionId, runs a keyframe sequence on the robot
+};
+
+// Motion primitives for CMD_MOTION (CMD_JUMP is MOTION_JUMP)
+enum MotionId : uint8_t{
+  MOTION_JUMP,
+  MOTION_GREET,
+  MOTION_SHOW_RANGE,
+};
+
+// Gait directions for CMD_GAIT, same names as the GaitManager directions
+enum GaitDir : uint8_t{
+  GAIT_STOP = 0,
+  GAIT_F, GAIT_B, GAIT_L, GAIT_R,
+  GAIT_FL_075, GAIT_FL_05, GAIT_FR_075, GAIT_FR_05,
+  GAIT_BL_075, GAIT_BL_05, GAIT_BR_075, GAIT_BR_05,
+};
+
+// CommandMessage::flags
+enum CmdFlag : uint8_t{
+  CMD_FLAG_RECORD    = 1 << 0,  // Record a data sample after this move
+  CMD_FLAG_PROFILE   = 1 << 1,  // profile field is valid
+  CMD_FLAG_TORQUE    = 1 << 2,  // Torque state is valid
+  CMD_FLAG_TORQUE_ON = 1 << 3,  // Requested torque state
+  CMD_FLAG_FOOT_XY   = 1 << 4,  // pos holds foot x/y per leg, solved by onboard IK
+  CMD_FLAG_TIMED     = 1 << 5,  // profile goes out with the goals in one sync write
+  CMD_FLAG_TRACE     = 1 << 6,  // A CommandTrace follows the message
+  CMD_FLAG_HOLD      = 1 << 7,  // Wait for the next SYNC_START before moving
+};
+
+// Foot coordinates in CommandMessage::pos are in 1/CMD_FOOT_SCALE mm
+const int16_t CMD_FOOT_SCALE = 100;
+
+// Binary joint command frame. Replaces the "q1,...,q8,special,profile,torque"
+// CSV string in CharMessage, which the robot still accepts as a legacy path.
+// Joint targets are absolute Dynamixel ticks, so the robot does no parsing.
+const uint8_t CMD_FRAME_VERSION = 1;
+struct CommandMessage{
+  uint8_t msgType = COMMAND;
+  uint8_t version = CMD_FRAME_VERSION;
+  uint8_t flags = 0;
+  uint8_t special = CMD_NONE;
+  uint16_t seq = 0;
+  uint16_t profile = 0;    // Move duration (ms) for time-based profiles
+  int16_t pos[8] = {0};    // Goal position of each joint in Dynamixel ticks,
+                           // or x0,y0,..,x3,y3 of each foot with CMD_FLAG_FOOT_XY
+} __attribute__((packed));
+
+// Latency trace of one command, appended to a CommandMessage that has
+// CMD_FLAG_TRACE. The PC picks the id, the controller fills in its time.
+struct CommandTrace{
+  uint16_t id;
+  uint16_t ingestUs;       // Controller: first serial byte to parsed command
+} __attribute__((packed));
+
+// Time each stage took for one traced command, in us (0xFFFF = longer).
+// The robot fills in its stages and reports the record in a TraceMessage,
+// the controller adds airUs on the way to the PC.
+struct TraceRecord{
+  uint16_t id;
+  uint16_t ingestUs;       // Controller: first serial byte to parsed command
+  uint16_t airUs;          // Controller: esp_now_send() to the robot's MAC ack
+  uint16_t queueUs;        // Robot: onRecv() to espnowRxTask (rxQueue)
+  uint16_t parseUs;        // Robot: espnowRxTask until the setpoint is posted
+  uint16_t latchUs;        // Robot: posted until the control task latches it
+  uint16_t writeUs;        // Robot: latch to the end of the servo write
+} __attribute__((packed));
+
+const uint8_t TRACE_PER_FRAME = (250 - 2) / sizeof(TraceRecord);
+struct TraceMessage{
+  uint8_t msgType = TRACE;
+  uint8_t count = 0;
+  TraceRecord records[TRACE_PER_FRAME];
+} __attribute__((packed));
+
+inline uint16_t q8TraceUs(uint32_t us){
+  return us > 0xFFFF ? 0xFFFF : us;
+}
+
+// Heartbeat, controller to robot and echoed back. seq and timestamp come back
+// as they were sent; the robot fills in what it saw of the heartbeats.
+struct HeartbeatMessage{
+  uint8_t msgType = HEARTBEAT;
+  uint8_t id = 0;
+  uint16_t seq = 0;          // Counts heartbeats sent, a gap means some were lost
+  uint32_t timestamp = 0;    // Controller micros() when sent
+  uint32_t rttUs = 0;        // Controller: round trip of the previous echo
+  uint16_t lossPermille = 0; // Robot, in the echo: heartbeats it missed, since pairing
+} __attribute__((packed));
+
+// Link quality, sent to the PC after every heartbeat echo, see q8LinkStats
+struct LinkStatsMessage{
+  uint8_t msgType = LINK_STATS;
+  uint8_t samples = 0;          // RTT samples in the window
+  uint16_t lossPermille = 0;    // Heartbeats without an echo, since pairing
+  uint16_t robotLossPermille = 0;  // Heartbeats that did not reach the robot
+  uint32_t rttMinUs = 0;
+  uint32_t rttMeanUs = 0;
+  uint32_t rttP99Us = 0;
+  uint32_t sent = 0;            // Heartbeats sent
+  uint32_t skipped = 0;         // Heartbeats not needed, robot traffic proved the link
+  uint32_t echoes = 0;          // Echoes received since pairing
+  uint32_t lost = 0;            // Echoes missing from the seq since pairing
+} __attribute__((packed));
+
+// Group start, broadcast by the controller. The robots apply the commands
+// they hold (CMD_FLAG_HOLD) delayUs after receiving it. The controller sends
+// a few copies, each with the time left, so every copy names the same moment.
+struct SyncStartMessage{
+  uint8_t msgType = SYNC_START;
+  uint8_t id = 0;            // Same for all copies of one start
+  uint32_t delayUs = 0;
+} __attribute__((packed));
+
+// Fleet addressing between the PC and a controller driving several robots.
+// From the PC it comes before a CommandMessage and names the robots it goes
+// to; to the PC it comes before each robot packet and names the robot. A
+// robot is its slot number in the controller's q8Fleet.
+struct FleetHeader{
+  uint8_t msgType = FLEET;
+  uint8_t robots = 0;        // Bit n is robot n
+} __attribute__((packed));
+
+// Telemetry stream (robot to controller). Raw register values of all joints,
+// batched into as few ESP-NOW frames as possible.
+struct TelemetrySample{
+  uint32_t timestamp;      // Robot micros() at the end of the sync read
+  uint8_t okMask;          // Bit i set if joint i answered
+  uint8_t reserved;
+  int16_t current[8];      // Present current, 1 mA units on the XL330
+  int16_t velocity[8];     // Present velocity, 0.229 rpm units
+  int16_t position[8];     // Present position, ticks
+} __attribute__((packed));
+
+const uint8_t TELEMETRY_HEADER_LEN = 6;
+const uint8_t TELEMETRY_PER_FRAME = (250 - TELEMETRY_HEADER_LEN) / sizeof(TelemetrySample);
+struct TelemetryMessage{
+  uint8_t msgType = TELEMETRY;
+  uint8_t count = 0;       // Valid samples in this frame
+  uint16_t seq = 0;        // Frame counter, a gap means frames were lost on air
+  uint16_t dropped = 0;    // Samples the robot dropped since the previous frame
+  TelemetrySample samples[TELEMETRY_PER_FRAME];
+} __attribute__((packed));
+static_assert(offsetof(TelemetryMessage, samples) == TELEMETRY_HEADER_LEN, "telemetry header size");
+static_assert(sizeof(TelemetryMessage) <= 250, "telemetry frame exceeds ESP-NOW payload");
+
+// Binary frames over USB serial, both ways: 0xA5 0x5A, length byte, payload,
+// then q8Crc16() of length and payload, low byte first. From the PC the
+// payload is a CommandMessage, and the legacy CSV text ("...;") is accepted
+// alongside. To the PC it is an ESP-NOW payload from a robot behind its
+// FleetHeader, mixed with the controller's text output.
+const uint8_t SERIAL_FRAME_SYNC[2] = {0xA5, 0x5A};
+const uint8_t SERIAL_FRAME_MAX = 250 + sizeof(FleetHeader);
+const uint8_t SERIAL_FRAME_OVERHEAD = 5;   // Sync, length and CRC
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), binascii.crc_hqx in Python
+inline uint16_t q8Crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF){
+  for (size_t i = 0; i < len; i++){
+    crc ^= static_cast<uint16_t>(data[i]) << 8;
+    for (uint8_t b = 0; b < 8; b++){
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// Build a serial frame around payload, out needs len + SERIAL_FRAME_OVERHEAD
+// bytes. Returns the frame length.
+inline size_t q8SerialFrame(uint8_t* out, const uint8_t* payload, uint8_t len){
+  out[0] = SERIAL_FRAME_SYNC[0];
+  out[1] = SERIAL_FRAME_SYNC[1];
+  out[2] = len;
+  memcpy(&out[3], payload, len);
+  uint16_t crc = q8Crc16(&out[2], len + 1);
+  out[3 + len] = crc & 0xFF;
+  out[4 + len] = crc >> 8;
+  return len + SERIAL_FRAME_OVERHEAD;
+}
+
+// Joint angle (deg) to Dynamixel ticks. 0 to 360 deg is 0 to 4096 and 0 deg
+// sits at 4096, same as the Python deg2dxl. In double like the PC, through a
+// float a value near half a tick can round the other way.
+inline int32_t q8Deg2Dxl(double deg){
+  const double friendlyPerDxl = 360.0 / 4096.0;
+  return static_cast<int32_t>(deg / friendlyPerDxl + 0.5) + 4096;
+}
+
+// Convert a legacy CSV command into a binary frame. Joint values missing from
+// the string keep whatever cmd.pos already holds. An optional 12th value of 1
+// means the first 8 values are foot x/y (mm) for the onboard IK, an optional
+// 13th value of 1 makes the 10th value a timed move (CMD_FLAG_TIMED).
+inline void q8CsvToCommand(const char* csv, CommandMessage& cmd){
+  double values[13];
+  int count = 0;
+  const char* p = csv;
+
+  while (*p != '\0' && count < 13) {
+    // Skip empty fields the same way strtok does
+    if (*p == ',') { p++; continue; }
+    char* end;
+    values[count++] = strtod(p, &end);
+    // Move to the next field
+    p = end;
+    while (*p != '\0' && *p != ',') p++;
+  }
+
+  cmd.flags = 0;
+  cmd.special = CMD_NONE;
+  if (count > 8) {                                 // 9th value is for special token
+    long special = static_cast<long>(values[8]);
+    if (special == CMD_RECORD) {
+      cmd.flags |= CMD_FLAG_RECORD;
+    } else {
+      cmd.special = static_cast<uint8_t>(special);
+    }
+  }
+  bool footXY = (count > 11 && values[11] == 1);   // 12th value selects foot x/y mode
+  for (int i = 0; i < count && i < 8; i++) {       // First 8 contain joint positions
+    int32_t value;
+    if (cmd.special == CMD_GAIT || cmd.special == CMD_TELEMETRY ||
+        cmd.special == CMD_MOTION) {               // Parameters are sent as-is
+      value = lround(values[i]);
+    } else if (footXY) {
+      value = lround(values[i] * CMD_FOOT_SCALE);
+    } else {
+      value = q8Deg2Dxl(values[i]);
+    }
+    cmd.pos[i] = static_cast<int16_t>(constrain(value, -32768, 32767));
+  }
+  if (count > 9) {                                 // 10th value is vel/acc profiles
+    cmd.profile = static_cast<uint16_t>(values[9]);
+    cmd.flags |= CMD_FLAG_PROFILE;
+  }
+  if (count > 10) {                                // 11th value is torque enable/disable
+    cmd.flags |= CMD_FLAG_TORQUE;
+    if (static_cast<long>(values[10]) == 1) cmd.flags |= CMD_FLAG_TORQUE_ON;
+  }
+  if (footXY) {
+    cmd.flags |= CMD_FLAG_FOOT_XY;
+  }
+  if (count > 12 && values[12] == 1 && (cmd.flags & CMD_FLAG_PROFILE)) {
+    cmd.flags |= CMD_FLAG_TIMED;                   // 13th value selects a timed move
+  }
+}
+
+#endif
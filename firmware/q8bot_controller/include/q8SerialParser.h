@@ -0,0 +1,150 @@
+/*
+  q8SerialParser.h - Incremental parser for the PC to controller serial stream.
+  Takes one byte at a time, so a command is handled as soon as its last byte
+  arrives instead of on the next polling tick. Understands binary command
+  frames (SERIAL_FRAME_SYNC, length, payload, q8Crc16), the legacy CSV text
+  terminated by ';', and the single character keys 'd' and 'p'.
+*/
+#ifndef q8SerialParser_h
+#define q8SerialParser_h
+
+#include <Arduino.h>
+#include "q8Protocol.h"
+
+enum q8ParseResult : uint8_t{
+  PARSE_NONE,       // Need more bytes
+  PARSE_FRAME,      // payload()/length() hold a frame with a good CRC
+  PARSE_TEXT,       // text() holds a CSV command without the ';'
+  PARSE_KEY,        // key() holds a single character command
+  PARSE_CRC_ERROR,  // Frame dropped
+  PARSE_OVERFLOW,   // Text longer than the buffer, dropped up to the next ';'
+};
+
+class q8SerialParser
+{
+  public:
+    static const uint8_t TEXT_MAX = 99;   // Same limit as the old readBytesUntil buffer
+
+    q8ParseResult push(uint8_t c){
+      switch (_state){
+        case IDLE:
+          if (c == SERIAL_FRAME_SYNC[0]){
+            _state = SYNC;
+          } else if (c == 'd' || c == 'p'){
+            _key = c;
+            return PARSE_KEY;
+          } else if (c == ';' || c == '\r' || c == '\n' || c == ' '){
+            // Separators between commands
+          } else {
+            _textLen = 0;
+            _state = TEXT;
+            return _pushText(c);
+          }
+          return PARSE_NONE;
+
+        case SYNC:
+          if (c == SERIAL_FRAME_SYNC[1]){
+            _state = LENGTH;
+          } else if (c != SERIAL_FRAME_SYNC[0]){
+            resync++;
+            _state = IDLE;
+          }
+          return PARSE_NONE;
+
+        case LENGTH:
+          if (c == 0 || c > SERIAL_FRAME_MAX){
+            resync++;
+            _state = IDLE;
+          } else {
+            _len = c;
+            _pos = 0;
+            _state = PAYLOAD;
+          }
+          return PARSE_NONE;
+
+        case PAYLOAD:
+          _payload[_pos++] = c;
+          if (_pos == _len) _state = CRC_LO;
+          return PARSE_NONE;
+
+        case CRC_LO:
+          _crc = c;
+          _state = CRC_HI;
+          return PARSE_NONE;
+
+        case CRC_HI: {
+          _crc |= static_cast<uint16_t>(c) << 8;
+          _state = IDLE;
+          uint16_t crc = q8Crc16(&_len, 1);
+          if (q8Crc16(_payload, _len, crc) != _crc){
+            crcErrors++;
+            return PARSE_CRC_ERROR;
+          }
+          frames++;
+          return PARSE_FRAME;
+        }
+
+        case TEXT:
+          return _pushText(c);
+
+        case SKIP_TEXT:
+          if (c == ';') _state = IDLE;
+          return PARSE_NONE;
+      }
+      return PARSE_NONE;
+    }
+
+    // Drop a partial command, e.g. when the stream has been quiet too long
+    void reset(){
+      if (_state != IDLE) resync++;
+      _state = IDLE;
+    }
+    bool busy() const { return _state != IDLE; }
+
+    const uint8_t* payload() const { return _payload; }
+    uint8_t length() const { return _len; }
+    const char* text() const { return _text; }
+    char key() const { return _key; }
+
+    // Counters since power up
+    uint32_t frames = 0;
+    uint32_t texts = 0;
+    uint32_t crcErrors = 0;
+    uint32_t overflows = 0;
+    uint32_t resync = 0;      // Partial commands dropped
+
+  private:
+    enum State : uint8_t { IDLE, SYNC, LENGTH, PAYLOAD, CRC_LO, CRC_HI, TEXT, SKIP_TEXT };
+    State _state = IDLE;
+    uint8_t _payload[SERIAL_FRAME_MAX];
+    uint8_t _len = 0;
+    uint8_t _pos = 0;
+    uint16_t _crc = 0;
+    char _text[TEXT_MAX + 1];
+    uint8_t _textLen = 0;
+    char _key = 0;
+
+    q8ParseResult _pushText(uint8_t c){
+      if (c == ';'){
+        _text[_textLen] = '\0';
+        _state = IDLE;
+        texts++;
+        return PARSE_TEXT;
+      }
+      if (c == SERIAL_FRAME_SYNC[0]){
+        // Never part of CSV text: a frame starts here, drop the partial text
+        resync++;
+        _state = SYNC;
+        return PARSE_NONE;
+      }
+      if (_textLen >= TEXT_MAX){
+        overflows++;
+        _state = SKIP_TEXT;
+        return PARSE_OVERFLOW;
+      }
+      _text[_textLen++] = c;
+      return PARSE_NONE;
+    }
+};
+
+#endif
@@ -4,19 +4,23 @@
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
 #include <freertos/event_groups.h>
+#include <freertos/stream_buffer.h>
+#include <freertos/message_buffer.h>
+#include "q8Protocol.h"
+#include "q8Bulk.h"
+#include "q8PacketPool.h"
+#include "q8Log.h"
+#include "q8Link.h"
+#include "q8Fleet.h"
 
-// ESP-NOW Messaging Types
-enum MsgType : uint8_t{
-  PAIRING,
-  DATA,
-  HEARTBEAT,
-};
+// ESP-NOW Message Structures
 struct PairingMessage{
   uint8_t msgType = PAIRING;
   uint8_t id;
   uint8_t macAddr[6];
   uint8_t channel;
 };
+// Legacy CSV command, superseded by CommandMessage
 struct CharMessage{
   uint8_t msgType = DATA;
   uint8_t id;
@@ -27,29 +31,43 @@ struct IntMessage{
   uint8_t id;
   uint16_t data[100];
 };
-struct HeartbeatMessage{
-  uint8_t msgType = HEARTBEAT;
-  uint8_t id;
-  uint32_t timestamp;
-};
 
 // ESP-NOW Comms
 PairingMessage pairingData;
-CharMessage sendMsg;
-IntMessage recvMsg;
-HeartbeatMessage heartbeatMsg;
+CommandMessage sendMsg;
+q8BulkReceiver bulkRx;  // Recorded data dump from the robot
+BulkAck bulkAck;
 int chan = 1;  // Must be the same(similar) across server and client
-bool paired = false;
-uint8_t serverMac[6];
+bool paired = false;   // Any robot paired
 uint8_t clientMac[6];  // This device
 uint8_t broadcastMAC[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 unsigned long lastPairAttempt;
 
-// Heartbeat tracking
+// Fleet mode: robots this controller pairs with. Build with -DFLEET_ROBOTS=n
+// for up to FLEET_MAX robots; the pairing broadcast goes on until all are in.
+#ifndef FLEET_ROBOTS
+#define FLEET_ROBOTS 1
+#endif
+static_assert(FLEET_ROBOTS >= 1 && FLEET_ROBOTS <= FLEET_MAX, "FLEET_ROBOTS out of range");
+
+// Group start (SYNC_START): copies broadcast, each after the previous one has gone out
+const uint8_t SYNC_COPIES = 3;
+const uint32_t SYNC_SEND_TIMEOUT_MS = 10;   // Next copy anyway if no send callback by then
+
+// Heartbeat tracking, per robot in q8Fleet (intervals in q8Fleet.h)
 unsigned long lastHeartbeatSent = 0;
-unsigned long lastHeartbeatReceived = 0;
-const unsigned long HEARTBEAT_INTERVAL = 2000;      // Send every 5s
-const unsigned long HEARTBEAT_TIMEOUT = 5000;      // Unpair after 15s no response
+
+// Serial command ingest
+const size_t SERIAL_RX_BUFFER_SIZE = 1024;         // Ring buffer, about 35 binary commands
+const unsigned long SERIAL_IDLE_TIMEOUT = 100;     // Drop a partial command after 100ms quiet
+
+// Serial uplink to the PC: binary frames (q8SerialFrame) written by serialUplinkTask.
+// The baud rate only matters on boards where Serial is a UART, USB CDC ignores it;
+// q8_espnow(baud=...) in Python has to match.
+const uint32_t SERIAL_BAUD = 115200;
+const size_t SERIAL_TX_BUFFER_SIZE = 1024;         // Driver TX buffer
+const size_t SERIAL_UPLINK_BUFFER_SIZE = 4096;     // Frames waiting for serialUplinkTask
+const size_t SERIAL_OUTPUT_BATCH = 512;            // Text written per Serial.write by serialOutputTask
 
 // Debug mode - default false
 bool debugMode = false;
@@ -58,13 +76,10 @@ bool debugMode = false;
 // FreeRTOS Data Structures
 // ============================================================================
 
-// Message queue structure for ISR → RX Handler
-typedef struct {
-  uint8_t mac[6];
-  uint8_t data[250];
-  int len;
-  uint32_t timestamp;
-} ESPNowMessage;
+// ESP-NOW packets in flight between onRecv() and the RX Handler
+const uint8_t RX_POOL_SIZE = 8;
+extern q8PacketPool<RX_POOL_SIZE> rxPool;
+extern q8LinkProbe linkProbe;  // Probes the saved robot, polled by pairingTask
 
 // Serial output message types
 enum SerialMsgType : uint8_t {
@@ -77,6 +92,55 @@ typedef struct {
   char text[128];
 } SerialMessage;
 
+// Binary log of the hot tasks (q8Log.h), formatted by serialOutputTask.
+// Formats take %u/%X only, every argument is a uint32_t.
+enum LogEvent : uint8_t {
+  LOG_FRAME_IGNORED,
+  LOG_CRC_ERROR,
+  LOG_CSV_OVERFLOW,
+  LOG_PAIRED,
+  LOG_MAC_SAVED,
+  LOG_CONNECTED,
+  LOG_HEARTBEAT_ACK,
+  LOG_BULK_DONE,
+  LOG_HEARTBEAT_SENT,
+  LOG_HEARTBEAT_TIMEOUT,
+  LOG_LINK_UP,
+  LOG_FIRST_COMMAND,
+  LOG_LINK_STATS,
+  LOG_FLEET_FULL,
+  LOG_SYNC_START,
+  LOG_EVENT_COUNT
+};
+
+typedef struct {
+  SerialMsgType type;
+  const char* text;
+} LogFormat;
+
+const LogFormat LOG_FORMATS[LOG_EVENT_COUNT] = {
+  {MSG_DEBUG, "[SERIAL] Ignored frame, type %u, %u bytes\n"},
+  {MSG_DEBUG, "[SERIAL] Frame dropped, bad CRC (%u so far)\n"},
+  {MSG_DEBUG, "[SERIAL] CSV command too long, dropped\n"},
+  {MSG_DEBUG, "[PAIRING] Paired with server: %02X:%02X:%02X:%02X:%02X:%02X\n"},
+  {MSG_DEBUG, "[STORAGE] Saved peer MAC\n"},
+  {MSG_DEBUG, "[HEARTBEAT] Robot %u connected, heartbeat timer started\n"},
+  {MSG_DEBUG, "[HEARTBEAT] Robot %u: ACK %u received, RTT: %uus\n"},
+  {MSG_INFO,  "[DATA] %u B in %u chunks, %u ms, %u B/s, %u lost on first pass, %u duplicates\n"},
+  {MSG_DEBUG, "[HEARTBEAT] Robot %u: sending heartbeat %u (last response: %ums ago)\n"},
+  {MSG_DEBUG, "[HEARTBEAT] Robot %u: timeout detected (%ums since last response)\n"},
+  {MSG_INFO,  "[LINK] Robot answered after %u ms, %u probes\n"},
+  {MSG_INFO,  "[LINK] First command %u ms after reset\n"},
+  {MSG_DEBUG, "[LINK] Robot %u: RTT min %u, mean %u, p99 %u us; loss %u/1000, at the robot %u/1000\n"},
+  {MSG_INFO,  "[PAIRING] Fleet full, %02X:%02X:%02X:%02X:%02X:%02X not paired\n"},
+  {MSG_DEBUG, "[SYNC] Group start %u in %u us\n"},
+};
+
+const uint8_t LOG_RING_SIZE = 16;              // Records per task
+extern q8LogRing<LOG_RING_SIZE> commandLog;    // Written by commandForwardingTask only
+extern q8LogRing<LOG_RING_SIZE> rxLog;         // Written by espnowRxTask only
+extern q8LogRing<LOG_RING_SIZE> heartbeatLog;  // Written by heartbeatTask only
+
 // Lock-free shared state
 typedef struct {
   volatile bool paired;
@@ -88,10 +152,14 @@ typedef struct {
 // FreeRTOS Handles (to be initialized in setup)
 extern QueueHandle_t rxQueue;
 extern QueueHandle_t debugQueue;
-extern QueueHandle_t dataOutputQueue;
+extern MessageBufferHandle_t uplinkBuffer;
 extern EventGroupHandle_t eventGroup;
+extern StreamBufferHandle_t serialRxBuffer;
+extern QueueHandle_t syncQueue;
+extern SemaphoreHandle_t sendMutex;
 
 // Event group bits
 #define EVENT_PAIRED        (1 << 0)
 #define EVENT_UNPAIRED      (1 << 1)
-#define EVENT_HEARTBEAT_RX  (1 << 2)
\ No newline at end of file
+#define EVENT_HEARTBEAT_RX  (1 << 2)
+#define EVENT_PROBE         (1 << 3)   // linkProbe started, wakes pairingTask
\ No newline at end of file
@@ -2,22 +2,79 @@
 #include <WiFi.h>
 #include <esp_wifi.h>
 #include <esp_now.h>
-#include <Preferences.h>
 
 // Q8bot-specific Modules
 #include "systemParams.h"
-#include "macStorage.h"
+#include "q8Config.h"
+#include "q8SerialParser.h"
 
 // Initialize global objects
 esp_now_peer_info_t peerInfo;
-Preferences prefs;
-macStorage storage;
+q8Config storage;
+q8LinkProbe linkProbe;               // Probes robot 0, the saved one
+q8Fleet fleet(FLEET_ROBOTS);
+bool commandSent = false;  // First command since reset reported
 
 // FreeRTOS Handles
 QueueHandle_t rxQueue = NULL;
+q8PacketPool<RX_POOL_SIZE> rxPool;
+q8LogRing<LOG_RING_SIZE> commandLog;
+q8LogRing<LOG_RING_SIZE> rxLog;
+q8LogRing<LOG_RING_SIZE> heartbeatLog;
 QueueHandle_t debugQueue = NULL;
-QueueHandle_t dataOutputQueue = NULL;
 EventGroupHandle_t eventGroup = NULL;
+StreamBufferHandle_t serialRxBuffer = NULL;
+MessageBufferHandle_t uplinkBuffer = NULL;  // Written by espnowRxTask only
+TaskHandle_t serialOutputHandle = NULL;
+TaskHandle_t heartbeatHandle = NULL;
+QueueHandle_t syncQueue = NULL;              // Group starts for syncStartTask, newest wins
+TaskHandle_t syncStartHandle = NULL;
+SemaphoreHandle_t sendMutex = NULL;          // Held around esp_now_send(), see espnowSend()
+volatile uint32_t outputDropped = 0;         // queuePrint() messages lost, debugQueue full
+
+// Serial command ingest
+q8SerialParser serialParser;
+volatile uint32_t serialRxLost = 0;  // Bytes dropped because the ring buffer was full
+volatile uint32_t serialRxUs = 0;    // micros() of the latest RX callback
+
+// Serial uplink to the PC
+uint32_t uplinkFrames = 0;
+uint32_t uplinkDropped = 0;          // Frames dropped because the uplink buffer was full
+// Finished recorded dump in bulkRx, framed by serialUplinkTask. Until then
+// handlePacket() turns away chunks of a new transfer.
+volatile bool dumpPending = false;
+uint8_t dumpId = 0;                  // Robot the dump came from
+
+// Latency trace (CMD_FLAG_TRACE): air time of the last traced commands, added
+// to the robot's trace records on their way to the PC
+struct TraceAir {
+  uint16_t id;
+  uint16_t airUs;
+};
+TraceAir traceAir[8];
+
+// Send callbacks come in the order of the sends. Each send notes what it
+// was, so OnDataSent() knows which one is done instead of going by the MAC.
+enum SendKind : uint8_t {
+  SEND_OTHER,
+  SEND_TRACE,       // Traced command, its air time goes to traceAir
+  SEND_SYNC,        // Group start copy, syncStartTask sends the next one
+};
+struct SendNote {
+  SendKind kind;
+  uint16_t traceId;                  // SEND_TRACE: id of the trace
+  uint32_t us;                       // micros() of the send
+};
+const uint8_t SEND_KINDS = 16;       // Sends waiting for their callback
+SendNote sendNotes[SEND_KINDS];
+volatile uint8_t sendHead = 0;       // Next callback, advanced by OnDataSent() only
+volatile uint8_t sendTail = 0;       // Next send, under sendMutex
+
+// Group start for syncStartTask: id of the copies and the moment they name
+struct SyncRequest {
+  uint8_t id;
+  uint32_t atUs;
+};
 
 
 // ============================================================================
@@ -32,9 +89,29 @@ void queuePrint(SerialMsgType type, const char* format, ...) {
   vsnprintf(msg.text, sizeof(msg.text), format, args);
   va_end(args);
 
-  xQueueSend(debugQueue, &msg, 0);
+  if (xQueueSend(debugQueue, &msg, 0) != pdTRUE) {
+    outputDropped++;
+  } else if (serialOutputHandle != NULL) {
+    xTaskNotifyGive(serialOutputHandle);
+  }
 }
 
+// Log from a hot task: no formatting, debug events are dropped right here
+// unless debugMode is on
+template <typename... Args>
+void logEvent(q8LogRing<LOG_RING_SIZE>& ring, LogEvent event, Args... args) {
+  if (LOG_FORMATS[event].type == MSG_DEBUG && !debugMode) return;
+  if (ring.push(event, args...) && serialOutputHandle != NULL) {
+    xTaskNotifyGive(serialOutputHandle);
+  }
+}
+
+// Text of one serialOutputTask wake, collected for a single Serial.write
+void serialWrite(const uint8_t* data, size_t len) {
+  Serial.write(data, len);
+}
+q8LogOutput<SERIAL_OUTPUT_BATCH> output(serialWrite);
+
 bool addPeer(const uint8_t* mac) {
   esp_now_peer_info_t peer = {};
   memcpy(peer.peer_addr, mac, 6);
@@ -43,20 +120,74 @@ bool addPeer(const uint8_t* mac) {
   return esp_now_add_peer(&peer) == ESP_OK;
 }
 
-void unpair() {
-  queuePrint(MSG_DEBUG, "[HEARTBEAT] Connection lost - returning to pairing mode\n");
+// esp_now_send() for every task, noting the kind of send for OnDataSent().
+// Not sent if too many callbacks are still outstanding.
+bool espnowSend(const uint8_t* mac, const void* data, size_t len, SendKind kind = SEND_OTHER,
+                uint16_t traceId = 0) {
+  xSemaphoreTake(sendMutex, portMAX_DELAY);
+  uint8_t tail = sendTail;
+  bool sent = (uint8_t)(tail - sendHead) < SEND_KINDS;
+  if (sent) {
+    SendNote& note = sendNotes[tail % SEND_KINDS];
+    note.kind = kind;
+    note.traceId = traceId;
+    note.us = micros();
+    sendTail = tail + 1;
+    sent = esp_now_send(mac, (const uint8_t*)data, len) == ESP_OK;
+    if (!sent) sendTail = tail;  // No callback will come for it
+  }
+  xSemaphoreGive(sendMutex);
+  return sent;
+}
+
+// Pairing broadcast, also the probe to a saved robot
+void sendPairing(const uint8_t* mac) {
+  PairingMessage pairingMsg;
+  pairingMsg.msgType = PAIRING;
+  pairingMsg.id = 1;
+  memcpy(pairingMsg.macAddr, clientMac, 6);
+  pairingMsg.channel = chan;
+  espnowSend(mac, &pairingMsg, sizeof(pairingMsg));
+}
 
-  esp_now_del_peer(serverMac);
-  storage.clearPeerMAC();
-  queuePrint(MSG_DEBUG, "[STORAGE] Cleared peer MAC from EEPROM\n");
+// Heartbeat with the robot's next seq, heartbeatTask only
+uint16_t sendHeartbeat(uint8_t id) {
+  q8Robot& robot = fleet[id];
+  HeartbeatMessage hb;
+  hb.id = 1;
+  hb.seq = ++robot.heartbeatSeq;
+  hb.rttUs = robot.heartbeatRttUs;
+  hb.timestamp = micros();
+  lastHeartbeatSent = millis();
+  robot.heartbeatsSent++;
+  espnowSend(robot.mac, &hb, sizeof(hb));
+  return hb.seq;
+}
 
-  memset(serverMac, 0, sizeof(serverMac));
-  paired = false;
+// A lost robot keeps its slot, robot 0 is probed; forget (forced pairing)
+// drops the whole fleet
+void unpair(int8_t id, bool forget) {
+  if (forget) {
+    queuePrint(MSG_DEBUG, "[PAIRING] Dropping all robots - returning to pairing mode\n");
+    linkProbe.stop();
+    for (uint8_t i = 0; i < fleet.size(); i++) {
+      if (fleet[i].used) esp_now_del_peer(fleet[i].mac);
+    }
+    fleet.forget();
+    storage.clearPeerMAC();
+    queuePrint(MSG_DEBUG, "[STORAGE] Cleared peer MAC\n");
+  } else {
+    queuePrint(MSG_DEBUG, "[HEARTBEAT] Robot %d lost - returning to pairing mode\n", id);
+    fleet.unpair(id);
+    if (id == 0) linkProbe.start(millis());
+  }
+  paired = fleet.pairedCount() > 0;
   lastPairAttempt = millis();
 
-  // Signal pairing task to resume broadcasting (if FreeRTOS is running)
+  // Signal pairing task to probe or resume broadcasting (if FreeRTOS is running)
   if (eventGroup != NULL) {
-    xEventGroupSetBits(eventGroup, EVENT_UNPAIRED);
+    xEventGroupClearBits(eventGroup, EVENT_PAIRED);
+    xEventGroupSetBits(eventGroup, forget || id != 0 ? EVENT_UNPAIRED : EVENT_UNPAIRED | EVENT_PROBE);
   }
 }
 
@@ -68,153 +199,435 @@ void onRecv(const uint8_t* mac, const uint8_t* data, int len) {
   // Validate minimum length
   if (len < 1 || len > 250) return;
 
-  // Copy to queue structure
-  ESPNowMessage msg;
-  memcpy(msg.mac, mac, 6);
-  memcpy(msg.data, data, len);
-  msg.len = len;
-  msg.timestamp = millis();
+  // Copy into a pool slot, only the pointer goes through the queue
+  q8Packet* packet = rxPool.acquire();
+  if (packet == NULL) return;
+  memcpy(packet->mac, mac, 6);
+  memcpy(packet->data, data, len);
+  packet->data[len] = '\0';
+  packet->len = len;
+  packet->timestamp = micros();
 
   // Non-blocking send; drop if full
-  (void)xQueueSend(rxQueue, &msg, 0);
+  if (xQueueSend(rxQueue, &packet, 0) != pdTRUE) rxPool.drop(packet);
 }
 
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
+  // Runs in the Wi-Fi task: note the result, sending is left to the tasks
+  uint8_t head = sendHead;
+  if (head == sendTail) return;
+  SendNote note = sendNotes[head % SEND_KINDS];
+  sendHead = head + 1;
+
+  if (note.kind == SEND_SYNC) {
+    // The group start copy is out, syncStartTask sends the next one
+    xTaskNotify(syncStartHandle, 1, eSetValueWithOverwrite);
+  } else if (note.kind == SEND_TRACE) {
+    TraceAir& slot = traceAir[note.traceId % 8];
+    slot.id = note.traceId;
+    slot.airUs = status == ESP_NOW_SEND_SUCCESS ? q8TraceUs(micros() - note.us) : 0xFFFF;
+  }
+}
+
+// ============================================================================
+// Serial RX Callback: runs in the serial driver's event task when bytes arrive
+// ============================================================================
+void onSerialRx() {
+  // Move everything the driver holds into the ring buffer, which wakes the
+  // command forwarding task
+  uint8_t buf[64];
+  int n;
+  serialRxUs = micros();
+  while ((n = Serial.available()) > 0) {
+    n = Serial.read(buf, n < (int)sizeof(buf) ? n : sizeof(buf));
+    if (n <= 0) break;
+    serialRxLost += n - xStreamBufferSend(serialRxBuffer, buf, n, 0);
+  }
 }
 
+#if ARDUINO_USB_CDC_ON_BOOT && ARDUINO_USB_MODE
+// Serial is the USB Serial/JTAG port (HWCDC), which reports RX as an event
+void onSerialEvent(void* arg, esp_event_base_t base, int32_t id, void* data) {
+  onSerialRx();
+}
+#endif
+
 // ============================================================================
 // FreeRTOS Tasks (Ranked by Priority)
 // ============================================================================
 // FreeRTOS Task: Command Forwarding (Priority 4 - HIGHEST)
+void sendCommand(uint8_t robots, const CommandTrace* trace = NULL) {
+  // sendMsg holds the command, stamp it and send it to each robot named in
+  // robots (FleetHeader bits) that is paired. Each robot gets its own seq, so
+  // commands to other robots never show up as gaps on its link.
+  sendMsg.msgType = COMMAND;
+  sendMsg.version = CMD_FRAME_VERSION;
+  if (!commandSent) {
+    commandSent = true;
+    logEvent(commandLog, LOG_FIRST_COMMAND, millis());
+  }
+  unsigned long now = millis();
+  for (uint8_t id = 0; id < fleet.size(); id++) {
+    q8Robot& robot = fleet[id];
+    if (!(robots & (1 << id)) || !robot.paired) continue;
+    robot.lastCommandSent = now;
+    sendMsg.seq = ++robot.commandSeq;
+    if (trace == NULL) {
+      espnowSend(robot.mac, &sendMsg, sizeof(sendMsg));
+      continue;
+    }
+
+    // Traced command: the trace goes along to the first robot only, the send
+    // callback times the air hop
+    uint8_t packet[sizeof(CommandMessage) + sizeof(CommandTrace)];
+    memcpy(packet, &sendMsg, sizeof(sendMsg));
+    memcpy(packet + sizeof(sendMsg), trace, sizeof(CommandTrace));
+    espnowSend(robot.mac, packet, sizeof(packet), SEND_TRACE, trace->id);
+    sendMsg.flags &= ~CMD_FLAG_TRACE;
+    trace = NULL;
+  }
+}
+
+// Group start from the PC: every robot holding commands (CMD_FLAG_HOLD)
+// applies them delayUs from now, in the same control tick. Broadcast by
+// syncStartTask.
+void startGroup(uint32_t delayUs) {
+  static uint8_t groupId = 0;
+  SyncRequest sync;
+  sync.id = ++groupId;
+  sync.atUs = micros() + delayUs;
+  xQueueOverwrite(syncQueue, &sync);
+  logEvent(commandLog, LOG_SYNC_START, sync.id, delayUs);
+}
+
 void commandForwardingTask(void *param) {
-  TickType_t lastWake = xTaskGetTickCount();
+  uint8_t buf[64];
+  uint32_t cmdStartUs = 0;  // RX callback that brought the first byte of the command
 
   while (1) {
-    if (Serial.available()) {
-      char c = Serial.peek();
+    // Block until the serial RX callback fills the ring buffer
+    size_t n = xStreamBufferReceive(serialRxBuffer, buf, sizeof(buf),
+                                    pdMS_TO_TICKS(SERIAL_IDLE_TIMEOUT));
+    if (n == 0) {
+      // Line quiet, a half received command will not be completed
+      serialParser.reset();
+      continue;
+    }
 
-      if (c == 'd') {
-        Serial.read();
-        debugMode = !debugMode;
-        queuePrint(MSG_INFO, "Debug mode: %s\n", debugMode ? "ON" : "OFF");
-      }
+    // Each command goes out as soon as its last byte is parsed
+    uint32_t chunkUs = serialRxUs;
+    for (size_t i = 0; i < n; i++) {
+      if (!serialParser.busy()) cmdStartUs = chunkUs;
+      switch (serialParser.push(buf[i])) {
+        case PARSE_KEY:
+          if (serialParser.key() == 'd') {
+            debugMode = !debugMode;
+            queuePrint(MSG_INFO, "Debug mode: %s (serial: %lu frames, %lu CSV, %lu CRC errors, "
+                       "%lu overflows, %lu dropped, %lu bytes lost)\n", debugMode ? "ON" : "OFF",
+                       (unsigned long)serialParser.frames, (unsigned long)serialParser.texts,
+                       (unsigned long)serialParser.crcErrors, (unsigned long)serialParser.overflows,
+                       (unsigned long)serialParser.resync, (unsigned long)serialRxLost);
+            queuePrint(MSG_INFO, "Uplink: %lu frames, %lu dropped; text output: %lu messages dropped\n",
+                       (unsigned long)uplinkFrames, (unsigned long)uplinkDropped, (unsigned long)outputDropped);
+            const q8PacketPoolStats& rx = rxPool.stats();
+            queuePrint(MSG_INFO, "ESP-NOW RX: %lu packets, %lu pool exhausted, %lu queue full, peak %u of %u slots\n",
+                       (unsigned long)rx.received, (unsigned long)rx.exhausted, (unsigned long)rx.dropped,
+                       rx.peak, RX_POOL_SIZE);
+            for (uint8_t id = 0; id < fleet.size(); id++) {
+              const q8Robot& robot = fleet[id];
+              if (!robot.used) continue;
+              queuePrint(MSG_INFO, "Robot %u %02X:%02X:%02X:%02X:%02X:%02X %s, heartbeats: %lu sent, "
+                         "%lu skipped for robot traffic\n", id, robot.mac[0], robot.mac[1], robot.mac[2],
+                         robot.mac[3], robot.mac[4], robot.mac[5], robot.paired ? "paired" : "lost",
+                         (unsigned long)robot.heartbeatsSent, (unsigned long)robot.heartbeatsSkipped);
+            }
+          }
 #ifdef PERMANENT_PAIRING_MODE
-      else if (c == 'p') {
-        Serial.read();
-        queuePrint(MSG_DEBUG, "[PAIRING] Force pairing mode requested\n");
-        unpair();
-      }
+          else if (serialParser.key() == 'p') {
+            queuePrint(MSG_DEBUG, "[PAIRING] Force pairing mode requested\n");
+            unpair(-1, true);
+          }
 #endif
-      else if (paired) {
-        // Forward joint commands to robot
-        int bytesRead = Serial.readBytesUntil(';', sendMsg.data, sizeof(sendMsg.data) - 1);
-        if (bytesRead > 0) {
-          sendMsg.data[bytesRead] = '\0';
-
-          // Send to robot's MAC address
-          sendMsg.msgType = DATA;
-          sendMsg.id = 1;
-          esp_now_send(serverMac, (uint8_t*)&sendMsg, sizeof(sendMsg));
+          break;
+
+        case PARSE_FRAME: {
+          // Binary command from the PC, already in the ESP-NOW layout. It goes
+          // to every robot, or to those named by a FleetHeader in front.
+          const uint8_t* payload = serialParser.payload();
+          uint8_t len = serialParser.length();
+          uint8_t robots = 0xFF;
+          if (len > sizeof(FleetHeader) && payload[0] == FLEET) {
+            robots = ((const FleetHeader*)payload)->robots;
+            payload += sizeof(FleetHeader);
+            len -= sizeof(FleetHeader);
+          }
+          if (len == sizeof(CommandMessage) && payload[0] == COMMAND) {
+            if (paired) {
+              memcpy(&sendMsg, payload, sizeof(sendMsg));
+              sendCommand(robots);
+            }
+          } else if (len == sizeof(CommandMessage) + sizeof(CommandTrace) &&
+                     payload[0] == COMMAND && (payload[2] & CMD_FLAG_TRACE)) {
+            if (paired) {
+              CommandTrace trace;
+              memcpy(&sendMsg, payload, sizeof(sendMsg));
+              memcpy(&trace, payload + sizeof(sendMsg), sizeof(trace));
+              trace.ingestUs = q8TraceUs(micros() - cmdStartUs);
+              sendCommand(robots, &trace);
+            }
+          } else if (len == sizeof(SyncStartMessage) && payload[0] == SYNC_START) {
+            if (paired) {
+              SyncStartMessage sync;
+              memcpy(&sync, payload, sizeof(sync));
+              startGroup(sync.delayUs);
+            }
+          } else {
+            logEvent(commandLog, LOG_FRAME_IGNORED, serialParser.payload()[0], serialParser.length());
+          }
+          break;
         }
+
+        case PARSE_TEXT:
+          // Legacy CSV command, encoded as a binary frame so the robot does no string parsing
+          if (paired) {
+            q8CsvToCommand(serialParser.text(), sendMsg);
+            sendCommand(0xFF);
+          }
+          break;
+
+        case PARSE_CRC_ERROR:
+          logEvent(commandLog, LOG_CRC_ERROR, serialParser.crcErrors);
+          break;
+
+        case PARSE_OVERFLOW:
+          logEvent(commandLog, LOG_CSV_OVERFLOW);
+          break;
+
+        default:
+          break;
       }
     }
-
-    // Run at 250 Hz (4ms period)
-    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(4));
   }
 }
 
-// FreeRTOS Task: ESP-NOW RX Handler (Priority 3)
-void espnowRxTask(void *param) {
-  ESPNowMessage msg;
+// FreeRTOS Task: Group Start (Priority 4)
+void syncStartTask(void *param) {
+  SyncRequest sync;
+  SyncStartMessage msg;
 
   while (1) {
-    // Block waiting for messages from ISR queue
-    if (xQueueReceive(rxQueue, &msg, portMAX_DELAY) == pdTRUE) {
-
-      // Process based on message type
-      if (msg.data[0] == PAIRING) {
-        // Validate PAIRING message length
-        if (msg.len < sizeof(PairingMessage)) continue;
-
-        memcpy(&pairingData, msg.data, sizeof(PairingMessage));
-        queuePrint(MSG_DEBUG, "[PAIRING] Paired with server: %02X:%02X:%02X:%02X:%02X:%02X\n",
-                   msg.mac[0], msg.mac[1], msg.mac[2], msg.mac[3], msg.mac[4], msg.mac[5]);
-
-        memcpy(serverMac, msg.mac, sizeof(serverMac));
-        addPeer(serverMac);
-        paired = true;
-        lastHeartbeatReceived = millis();
-
-        // Save the MAC address to EEPROM
-        storage.savePeerMAC(serverMac);
-        queuePrint(MSG_DEBUG, "[STORAGE] Saved peer MAC to EEPROM\n");
-        queuePrint(MSG_DEBUG, "[HEARTBEAT] Connection established, heartbeat timer started\n");
-
-        // Signal pairing task to stop broadcasting
-        if (eventGroup != NULL) {
-          xEventGroupSetBits(eventGroup, EVENT_PAIRED);
-        }
+    xQueueReceive(syncQueue, &sync, portMAX_DELAY);
+
+    // Copies back to back, each with the time left once the previous one is out
+    msg.id = sync.id;
+    for (uint8_t i = 0; i < SYNC_COPIES; i++) {
+      int32_t left = sync.atUs - micros();
+      if (left <= 0) break;
+      msg.delayUs = left;
+      if (!espnowSend(broadcastMAC, &msg, sizeof(msg), SEND_SYNC)) break;
+      xTaskNotifyWait(0, UINT32_MAX, NULL, pdMS_TO_TICKS(SYNC_SEND_TIMEOUT_MS));
+    }
+  }
+}
 
-      } else if (msg.data[0] == HEARTBEAT) {
-        // Robot echoed heartbeat back
-        if (msg.len < sizeof(HeartbeatMessage)) continue;
+// Queue a packet from robot id for the PC as one binary serial frame behind
+// its FleetHeader, written out by serialUplinkTask. Without space the frame
+// is dropped.
+bool forwardFrame(uint8_t id, const uint8_t* data, uint8_t len) {
+  uint8_t payload[SERIAL_FRAME_MAX];
+  uint8_t frame[SERIAL_FRAME_MAX + SERIAL_FRAME_OVERHEAD];
+  if (len > SERIAL_FRAME_MAX - sizeof(FleetHeader)) return false;
+  size_t n = q8SerialFrame(frame, payload, q8FleetWrap(payload, id, data, len));
+  if (xMessageBufferSend(uplinkBuffer, frame, n, 0) != n) {
+    uplinkDropped++;
+    return false;
+  }
+  uplinkFrames++;
+  return true;
+}
 
-        lastHeartbeatReceived = millis();
+// Handle one packet in place, the slot goes back to the pool afterwards
+void handlePacket(q8Packet& msg) {
+  int8_t id = fleet.find(msg.mac);
 
-        HeartbeatMessage hbMsg;
-        memcpy(&hbMsg, msg.data, sizeof(HeartbeatMessage));
-        uint32_t rtt = millis() - hbMsg.timestamp;
-        queuePrint(MSG_DEBUG, "[HEARTBEAT] ACK received, RTT: %ums\n", rtt);
+  // Process based on message type
+  if (msg.data[0] == PAIRING) {
+    // Validate PAIRING message length
+    if (msg.len < sizeof(PairingMessage)) return;
 
-      } else if (msg.data[0] == DATA) {
-        // Validate DATA message length
-        if (msg.len < sizeof(IntMessage)) continue;
+    id = fleet.slotFor(msg.mac);
+    if (id < 0) {
+      logEvent(rxLog, LOG_FLEET_FULL, msg.mac[0], msg.mac[1], msg.mac[2], msg.mac[3], msg.mac[4], msg.mac[5]);
+      return;
+    }
+    memcpy(&pairingData, msg.data, sizeof(PairingMessage));
+    logEvent(rxLog, LOG_PAIRED, msg.mac[0], msg.mac[1], msg.mac[2], msg.mac[3], msg.mac[4], msg.mac[5]);
+    if (id == 0 && linkProbe.stop()) {
+      logEvent(rxLog, LOG_LINK_UP, linkProbe.elapsed(millis()), linkProbe.sent());
+    }
 
-        memcpy(&recvMsg, msg.data, sizeof(IntMessage));
-        lastHeartbeatReceived = millis();  // Any DATA also counts as "alive"
+    q8Robot& robot = fleet[id];
+    if (robot.used && memcmp(robot.mac, msg.mac, 6) != 0) {
+      esp_now_del_peer(robot.mac);   // Lost robot replaced by another one
+    }
+    fleet.pair(id, msg.mac, millis());
+    addPeer(robot.mac);
+    paired = true;
 
-        // Print data array
-        for (int i = 0; i < 100; i++) {
-          Serial.print(recvMsg.data[i]);
-          Serial.print(" ");
-        }
-        Serial.println();
-        memset(&recvMsg, 0, sizeof(recvMsg));
-      }
+    // Heartbeat at once, so a robot that probes us after its reset hears
+    // back. Sent by heartbeatTask, which owns the heartbeat fields.
+    xTaskNotify(heartbeatHandle, 1 << id, eSetBits);
+
+    // Robot 0 is the one probed after a reset. Save its MAC address, written
+    // to flash by the pairing task
+    if (id == 0) {
+      storage.savePeerMAC(robot.mac, pairingData.channel);
+      logEvent(rxLog, LOG_MAC_SAVED);
+    }
+    logEvent(rxLog, LOG_CONNECTED, id);
+
+    // Signal pairing task to stop broadcasting once the fleet is complete
+    if (eventGroup != NULL) {
+      xEventGroupSetBits(eventGroup, EVENT_PAIRED);
+    }
+    return;
+  }
+
+  // Everything else only from robots of the fleet
+  if (id < 0) return;
+  q8Robot& robot = fleet[id];
+
+  if (msg.data[0] == HEARTBEAT) {
+    // Robot echoed heartbeat back
+    if (msg.len < sizeof(HeartbeatMessage)) return;
+
+    robot.lastHeartbeatReceived = millis();
+
+    HeartbeatMessage hbMsg;
+    memcpy(&hbMsg, msg.data, sizeof(HeartbeatMessage));
+    uint32_t rtt = micros() - hbMsg.timestamp;
+    robot.heartbeatRttUs = rtt;
+    robot.heartbeatEchoSeq = hbMsg.seq;
+    robot.linkStats.received(hbMsg.seq);
+    robot.linkStats.rtt(rtt);
+    logEvent(rxLog, LOG_HEARTBEAT_ACK, id, hbMsg.seq, rtt);
+
+    // Link quality to the PC, with what the robot saw of the heartbeats
+    q8LinkQuality q = robot.linkStats.summary();
+    LinkStatsMessage stats;
+    stats.samples = q.samples;
+    stats.lossPermille = q.lossPermille;
+    stats.robotLossPermille = hbMsg.lossPermille;
+    stats.rttMinUs = q.rttMinUs;
+    stats.rttMeanUs = q.rttMeanUs;
+    stats.rttP99Us = q.rttP99Us;
+    stats.sent = robot.heartbeatsSent;
+    stats.skipped = robot.heartbeatsSkipped;
+    stats.echoes = q.received;
+    stats.lost = q.lost;
+    forwardFrame(id, (const uint8_t*)&stats, sizeof(stats));
+    logEvent(rxLog, LOG_LINK_STATS, id, q.rttMinUs, q.rttMeanUs, q.rttP99Us, q.lossPermille, hbMsg.lossPermille);
+
+  } else if (msg.data[0] == DATA) {
+    // Validate DATA message length
+    if (msg.len < sizeof(IntMessage)) return;
+
+    robot.lastHeartbeatReceived = millis();  // Any DATA also counts as "alive"
+    robot.lastDataReceived = robot.lastHeartbeatReceived;
+    forwardFrame(id, msg.data, msg.len);
+
+  } else if (msg.data[0] == BULK_DATA) {
+    // Recorded data dump: reassemble, ack every poll with the missing chunks.
+    // One dump at a time, the PC asks the robots in turn.
+    robot.lastHeartbeatReceived = millis();  // Any DATA also counts as "alive"
+    robot.lastDataReceived = robot.lastHeartbeatReceived;
+    // A new transfer waits (unacked, the robot polls again) until the last
+    // dump is out, repeats of the finished one are still acked
+    if (dumpPending && !bulkRx.sameTransfer(msg.data, msg.len)) return;
+    if (bulkRx.onChunk(msg.data, msg.len, millis(), bulkAck)) {
+      espnowSend(robot.mac, &bulkAck, sizeof(bulkAck));
+    }
+    if (bulkRx.completedNow()) {
+      // Framed by serialUplinkTask, which may block on Serial. A one byte
+      // message wakes it; if the buffer is full it is awake anyway.
+      dumpId = id;
+      dumpPending = true;
+      uint8_t wake = 0;
+      xMessageBufferSend(uplinkBuffer, &wake, 1, 0);
+      uint32_t ms = bulkRx.elapsedMs();
+      logEvent(rxLog, LOG_BULK_DONE, bulkRx.length(), bulkRx.chunks(), ms,
+               ms ? bulkRx.length() * 1000UL / ms : 0, bulkRx.firstPassLost(), bulkRx.duplicates());
+    }
+
+  } else if (msg.data[0] == TELEMETRY) {
+    // Validate TELEMETRY message length
+    if (msg.len < TELEMETRY_HEADER_LEN) return;
+    robot.lastHeartbeatReceived = millis();  // Any DATA also counts as "alive"
+    robot.lastDataReceived = robot.lastHeartbeatReceived;
+    forwardFrame(id, msg.data, msg.len);
+
+  } else if (msg.data[0] == TRACE) {
+    // Latency trace records, add the air time measured here
+    if (msg.len < 2) return;
+    TraceMessage* traces = (TraceMessage*)msg.data;
+    for (uint8_t i = 0; i < traces->count && 2 + (i + 1) * (int)sizeof(TraceRecord) <= msg.len; i++) {
+      const TraceAir& slot = traceAir[traces->records[i].id % 8];
+      if (slot.id == traces->records[i].id) traces->records[i].airUs = slot.airUs;
+    }
+    forwardFrame(id, msg.data, msg.len);
+  }
+}
+
+// FreeRTOS Task: ESP-NOW RX Handler (Priority 3)
+void espnowRxTask(void *param) {
+  q8Packet* packet;
+
+  while (1) {
+    // Block waiting for packets from onRecv()
+    if (xQueueReceive(rxQueue, &packet, portMAX_DELAY) == pdTRUE) {
+      handlePacket(*packet);
+      rxPool.release(packet);
     }
   }
 }
 
 // FreeRTOS Task: Heartbeat Manager (Priority 2)
 void heartbeatTask(void *param) {
-  TickType_t lastWake = xTaskGetTickCount();
+  unsigned long due[FLEET_MAX] = {0};  // When each robot is looked at next
+  uint32_t greet = 0;                  // Robots just paired by the RX task
 
   while (1) {
-    // Only send heartbeat when paired
-    if (paired) {
-      // Send heartbeat
-      heartbeatMsg.msgType = HEARTBEAT;
-      heartbeatMsg.id = 1;
-      heartbeatMsg.timestamp = millis();
-      lastHeartbeatSent = millis();
+    unsigned long now = millis();
+    unsigned long sleep = HEARTBEAT_INTERVAL;
 
-      unsigned long timeSinceLastHB = millis() - lastHeartbeatReceived;
-      queuePrint(MSG_DEBUG, "[HEARTBEAT] Sending heartbeat (last response: %lums ago)\n", timeSinceLastHB);
+    for (uint8_t id = 0; id < fleet.size(); id++) {
+      if ((greet & (1 << id)) && fleet[id].paired) sendHeartbeat(id);
+    }
 
-      esp_now_send(serverMac, (uint8_t*)&heartbeatMsg, sizeof(heartbeatMsg));
+    // Each paired robot on its own schedule
+    for (uint8_t id = 0; id < fleet.size(); id++) {
+      unsigned long wait = (long)(due[id] - now) > 0 ? due[id] - now : 0;
+      if (wait == 0) {
+        q8Robot& robot = fleet[id];
+        unsigned long timeSinceLastHB = now - robot.lastHeartbeatReceived;
+        if (fleet.beat(id, now, wait) == BEAT_SEND) {
+          robot.lastSeq = sendHeartbeat(id);
+          logEvent(heartbeatLog, LOG_HEARTBEAT_SENT, id, robot.lastSeq, timeSinceLastHB);
+        }
 
-      // Check for timeout (only in auto-pairing mode)
+        // Check for timeout (only in auto-pairing mode)
 #ifndef PERMANENT_PAIRING_MODE
-      if (timeSinceLastHB > HEARTBEAT_TIMEOUT) {
-        queuePrint(MSG_DEBUG, "[HEARTBEAT] Timeout detected (%lums since last response)\n", timeSinceLastHB);
-        unpair();
-      }
+        if (fleet.timedOut(id, now)) {
+          logEvent(heartbeatLog, LOG_HEARTBEAT_TIMEOUT, id, timeSinceLastHB);
+          unpair(id, false);
+        }
 #endif
+        due[id] = now + wait;
+      }
+      if (wait < sleep) sleep = wait;
     }
 
-    // Run at frequency defined by constant
-    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(HEARTBEAT_INTERVAL));
+    if (xTaskNotifyWait(0, UINT32_MAX, &greet, pdMS_TO_TICKS(sleep)) != pdTRUE) greet = 0;
   }
 }
 
@@ -223,79 +636,109 @@ void serialOutputTask(void *param) {
   SerialMessage msg;
 
   while (1) {
-    // Check for serial output messages (blocking with timeout)
-    if (xQueueReceive(debugQueue, &msg, pdMS_TO_TICKS(10)) == pdTRUE) {
-      // Print based on message type
-      if (msg.type == MSG_INFO) {
-        // INFO messages always printed
-        Serial.print(msg.text);
-      } else if (msg.type == MSG_DEBUG && debugMode) {
-        // DEBUG messages only when debugMode is ON
-        Serial.print(msg.text);
-      }
+    // Sleep until queuePrint() or logEvent() has something
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    // Drain everything waiting, INFO always, DEBUG only when debugMode is ON
+    SerialMsgType shown = debugMode ? MSG_DEBUG : MSG_INFO;
+    while (xQueueReceive(debugQueue, &msg, 0) == pdTRUE) {
+      if (msg.type <= shown) output.append(msg.text);
     }
 
-    // Low priority - yield to other tasks
-    vTaskDelay(pdMS_TO_TICKS(10));
+    // Binary log of the hot tasks
+    output.print(commandLog, LOG_FORMATS, shown);
+    output.print(rxLog, LOG_FORMATS, shown);
+    output.print(heartbeatLog, LOG_FORMATS, shown);
+    output.reportDropped(outputDropped + commandLog.dropped() + rxLog.dropped() + heartbeatLog.dropped());
+    output.flush();
   }
 }
 
-// FreeRTOS Task: Pairing Manager (Priority 0 - LOWEST)
-void pairingTask(void *param) {
-  TickType_t lastWake = xTaskGetTickCount();
-
-  // On first run, check for saved MAC address
-  if (storage.loadPeerMAC(serverMac)) {
-    char macStr[18];
-    sprintf(macStr, "%02X:%02X:%02X:%02X:%02X:%02X",
-            serverMac[0], serverMac[1], serverMac[2],
-            serverMac[3], serverMac[4], serverMac[5]);
-    queuePrint(MSG_DEBUG, "[PAIRING] Found saved MAC: %s\n", macStr);
+// Recorded dump in bulkRx to the PC as DATA frames of up to 100 values, as
+// the robot sends them
+void writeDump() {
+  const uint16_t* values = (const uint16_t*)bulkRx.data();
+  size_t count = bulkRx.length() / sizeof(uint16_t);
+  IntMessage out;
+  out.id = 0;
+  uint8_t payload[SERIAL_FRAME_MAX];
+  uint8_t frame[SERIAL_FRAME_MAX + SERIAL_FRAME_OVERHEAD];
+  for (size_t i = 0; i < count; i += 100) {
+    size_t n = count - i < 100 ? count - i : 100;
+    memcpy(out.data, &values[i], n * sizeof(uint16_t));
+    size_t len = q8FleetWrap(payload, dumpId, (const uint8_t*)&out, 2 + n * sizeof(uint16_t));
+    Serial.write(frame, q8SerialFrame(frame, payload, len));
+    uplinkFrames++;
+  }
+}
 
-    addPeer(serverMac);
-    paired = true;
-    lastHeartbeatReceived = millis();
-    lastHeartbeatSent = millis();
+// FreeRTOS Task: Serial Uplink (Priority 2)
+void serialUplinkTask(void *param) {
+  // A slow or stalled PC blocks this task instead of espnowRxTask. Frames
+  // waiting together go out in one write, never split, so text output from
+  // serialOutputTask only lands between frames.
+  uint8_t buf[1024];
+  const size_t frameMax = SERIAL_FRAME_MAX + SERIAL_FRAME_OVERHEAD;
 
-    queuePrint(MSG_DEBUG, "[PAIRING] Attempting to reconnect to saved peer\n");
-
-    // Signal that we're already paired
-    xEventGroupSetBits(eventGroup, EVENT_PAIRED);
-  } else {
-    queuePrint(MSG_DEBUG, "[PAIRING] No saved MAC found - entering pairing mode\n");
+  while (1) {
+    size_t n = 0;
+    size_t m = xMessageBufferReceive(uplinkBuffer, buf, sizeof(buf), portMAX_DELAY);
+    while (m > 0) {
+      if (m > 1) n += m;  // One byte: wake-up for a dump, not a frame
+      if (n + frameMax > sizeof(buf)) break;
+      m = xMessageBufferReceive(uplinkBuffer, buf + n, sizeof(buf) - n, 0);
+    }
+    if (n > 0) {
+      Serial.write(buf, n);
+    }
+    if (dumpPending) {
+      writeDump();
+      dumpPending = false;
+    }
   }
+}
 
+// FreeRTOS Task: Pairing Manager (Priority 0 - LOWEST)
+void pairingTask(void *param) {
   while (1) {
-    // Check pairing state (use old global for now, will migrate to atomic later)
-    bool isPaired = paired;
-
-    if (!isPaired) {
-      // Send pairing broadcast every 2s
+    // Robots still missing from the fleet
+    bool complete = fleet.full();
+
+    if (linkProbe.active()) {
+      // Saved robot: probe it directly until it answers, see handlePacket().
+      // Unpaired, the broadcast takes over when the schedule runs out.
+      LinkProbeStep step = linkProbe.poll(millis());
+      if (step == PROBE_SEND) {
+        sendPairing(fleet[0].mac);
+      } else if (step == PROBE_EXPIRED) {
+        queuePrint(MSG_DEBUG, "[PAIRING] Saved robot not answering\n");
+      }
+      if (linkProbe.active()) {
+        xEventGroupWaitBits(eventGroup, EVENT_PAIRED | EVENT_PROBE, pdTRUE, pdFALSE,
+                            pdMS_TO_TICKS(linkProbe.wait(millis())));
+      }
+    } else if (!complete) {
+      // Send pairing broadcast every 2s, unless a probe is started
       if (debugQueue != NULL) {
         queuePrint(MSG_DEBUG, "[PAIRING] Sending broadcast...\n");
       }
+      sendPairing(broadcastMAC);
 
-      PairingMessage pairingMsg;
-      pairingMsg.msgType = PAIRING;
-      pairingMsg.id = 1;
-      memcpy(pairingMsg.macAddr, clientMac, 6);
-      pairingMsg.channel = chan;
-
-      esp_now_send(broadcastMAC, (uint8_t*)&pairingMsg, sizeof(pairingMsg));
-
-      vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(2000));
+      xEventGroupWaitBits(eventGroup, EVENT_PROBE, pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
     } else {
-      // Block until unpaired event
-      EventBits_t bits = xEventGroupWaitBits(
+      // Block until unpaired event, waking now and then to commit the config
+      xEventGroupWaitBits(
         eventGroup,
         EVENT_UNPAIRED,
         pdTRUE,   // Clear on exit
         pdFALSE,  // Wait for any bit
-        portMAX_DELAY
+        pdMS_TO_TICKS(CONFIG_COMMIT_DELAY_MS)
       );
+    }
 
-      // Reset timing after unpair event
-      lastWake = xTaskGetTickCount();
+    // Flash writes only happen here, never in the RX task
+    if (storage.commit(millis())) {
+      queuePrint(MSG_DEBUG, "[STORAGE] Config written to flash\n");
     }
   }
 }
@@ -305,15 +748,15 @@ void pairingTask(void *param) {
 // Arduino Setup. Configures ESP-NOW and FreeRTOS tasks.
 // ============================================================================
 void setup() {
-  Serial.begin(115200);
-  Serial.setTimeout(100);
+  Serial.setTxBufferSize(SERIAL_TX_BUFFER_SIZE);
+  Serial.begin(SERIAL_BAUD);
   // delay(2000);  // Useful for debugging
 
   bool initSuccess = true;
 
   // FreeRTOS Initialization
   // Create queues
-  rxQueue = xQueueCreate(10, sizeof(ESPNowMessage));
+  rxQueue = xQueueCreate(RX_POOL_SIZE, sizeof(q8Packet*));
   if (rxQueue == NULL) {
     Serial.println("[RTOS] Failed to create RX queue");
     initSuccess = false;
@@ -325,6 +768,34 @@ void setup() {
     initSuccess = false;
   }
 
+  // Ring buffer between the serial RX callback and the command forwarding task
+  serialRxBuffer = xStreamBufferCreate(SERIAL_RX_BUFFER_SIZE, 1);
+  if (serialRxBuffer == NULL) {
+    Serial.println("[RTOS] Failed to create serial RX buffer");
+    initSuccess = false;
+  }
+
+  // Frames to the PC, written out by the serial uplink task
+  uplinkBuffer = xMessageBufferCreate(SERIAL_UPLINK_BUFFER_SIZE);
+  if (uplinkBuffer == NULL) {
+    Serial.println("[RTOS] Failed to create serial uplink buffer");
+    initSuccess = false;
+  }
+
+  // Group starts from the command forwarding task, copies sent by their own task
+  syncQueue = xQueueCreate(1, sizeof(SyncRequest));
+  if (syncQueue == NULL) {
+    Serial.println("[RTOS] Failed to create group start queue");
+    initSuccess = false;
+  }
+
+  // Serialises esp_now_send() with the note of what was sent
+  sendMutex = xSemaphoreCreateMutex();
+  if (sendMutex == NULL) {
+    Serial.println("[RTOS] Failed to create ESP-NOW send mutex");
+    initSuccess = false;
+  }
+
   // Create event group for task synchronization
   eventGroup = xEventGroupCreate();
   if (eventGroup == NULL) {
@@ -340,13 +811,27 @@ void setup() {
     3072,               // Stack size (bytes)
     NULL,               // Parameters
     1,                  // Priority (low - non-critical output)
-    NULL                // Task handle
+    &serialOutputHandle // Task handle
   );
   if (taskCreated != pdPASS) {
     Serial.println("[RTOS] Failed to create serial output task");
     initSuccess = false;
   }
 
+  // Create serial uplink task (Priority 2)
+  taskCreated = xTaskCreate(
+    serialUplinkTask,   // Task function
+    "SerialUp",         // Task name
+    4096,               // Stack size (bytes)
+    NULL,               // Parameters
+    2,                  // Priority (medium - telemetry and dumps to the PC)
+    NULL                // Task handle
+  );
+  if (taskCreated != pdPASS) {
+    Serial.println("[RTOS] Failed to create serial uplink task");
+    initSuccess = false;
+  }
+
   // Create ESP-NOW RX handler task (Priority 3)
   taskCreated = xTaskCreate(
     espnowRxTask,       // Task function
@@ -368,20 +853,34 @@ void setup() {
     3072,               // Stack size (bytes)
     NULL,               // Parameters
     2,                  // Priority (medium - send/monitor heartbeats)
-    NULL                // Task handle
+    &heartbeatHandle    // Task handle
   );
   if (taskCreated != pdPASS) {
     Serial.println("[RTOS] Failed to create heartbeat task");
     initSuccess = false;
   }
 
+  // Create group start task (Priority 4)
+  taskCreated = xTaskCreate(
+    syncStartTask,      // Task function
+    "SyncStart",        // Task name
+    2048,               // Stack size (bytes)
+    NULL,               // Parameters
+    4,                  // Priority (highest - copies follow each other at once)
+    &syncStartHandle    // Task handle
+  );
+  if (taskCreated != pdPASS) {
+    Serial.println("[RTOS] Failed to create group start task");
+    initSuccess = false;
+  }
+
   // Create command forwarding task (Priority 4 - HIGHEST)
   taskCreated = xTaskCreate(
     commandForwardingTask, // Task function
     "CmdFwd",              // Task name
     3072,                  // Stack size (bytes)
     NULL,                  // Parameters
-    4,                     // Priority (highest - 200 Hz critical timing)
+    4,                     // Priority (highest - forwards each command on arrival)
     NULL                   // Task handle
   );
   if (taskCreated != pdPASS) {
@@ -409,6 +908,23 @@ void setup() {
     while(1) { delay(1000); }  // Halt system indefinitely
   }
 
+  // Serial commands are pushed to the forwarding task as they arrive
+#if ARDUINO_USB_CDC_ON_BOOT && ARDUINO_USB_MODE
+  Serial.onEvent(ARDUINO_HW_CDC_RX_EVENT, onSerialEvent);
+#else
+  Serial.onReceive(onSerialRx);
+#endif
+
+  // Open the config store; a saved peer brings its channel along
+  if (!storage.begin()) {
+    Serial.println("[STORAGE] Failed to open config namespace");
+  }
+  uint8_t savedMac[6];
+  bool savedPeer = storage.loadPeerMAC(savedMac);
+  if (savedPeer) {
+    chan = storage.channel();
+  }
+
   // Init Wi-Fi; set device as a Wi-Fi Station (after FreeRTOS primitives are ready)
   WiFi.mode(WIFI_STA);
   WiFi.macAddress(clientMac);
@@ -424,6 +940,21 @@ void setup() {
   esp_now_register_recv_cb(onRecv);
   esp_now_register_send_cb(OnDataSent);
   addPeer(broadcastMAC);
+
+  // Saved robot: robot 0 again, forward commands at once and probe it until
+  // it answers, instead of waiting for the next pairing broadcast
+  if (savedPeer) {
+    queuePrint(MSG_DEBUG, "[PAIRING] Found saved MAC: %02X:%02X:%02X:%02X:%02X:%02X\n",
+               savedMac[0], savedMac[1], savedMac[2], savedMac[3], savedMac[4], savedMac[5]);
+    fleet.pair(0, savedMac, millis());
+    addPeer(savedMac);
+    paired = true;
+    linkProbe.start(millis());
+    xEventGroupSetBits(eventGroup, EVENT_PROBE);
+    queuePrint(MSG_DEBUG, "[PAIRING] Attempting to reconnect to saved peer\n");
+  } else {
+    queuePrint(MSG_DEBUG, "[PAIRING] No saved MAC found - entering pairing mode\n");
+  }
 }
 
 // Loop does nothing - all work done in FreeRTOS tasks
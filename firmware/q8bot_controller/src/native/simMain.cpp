@@ -0,0 +1,571 @@
+/*
+  simMain.cpp - Host entry point for the native environment. Replays serial
+  traffic recorded from the PC (python-tools/q8bot/serial_capture.py) through
+  two models of the controller's command ingest and reports the latency from
+  each PC write to its esp_now_send():
+
+    polled  the old commandForwardingTask: wakes every 4 ms, forwards at most
+            one CSV command per wake with Serial.readBytesUntil(';')
+    event   the RX callback fills the ring buffer and the task runs
+            q8SerialParser on the bytes as they arrive
+
+  Without arguments a 200 Hz stream with the jitter of a pygame loop is
+  generated in both encodings. Also checks that the binary frames from Python
+  match what q8CsvToCommand() makes of the same commands, and that the parser
+  recovers from corrupted frames, and compares the old text output of
+  recorded data with the binary uplink frames. checkFleet runs one controller
+  and several robots on a simulated ESP-NOW medium.
+
+  Run with: pio run -e native -t exec
+  or:       .pio/build/native/program capture.txt capture_csv.txt
+*/
+#include <Arduino.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "q8Protocol.h"
+#include "q8SerialParser.h"
+#include "q8Fleet.h"
+#include <deque>
+
+// Link timing, the same for both models. USB full speed moves a write in
+// 64 byte packets, the RX event reaches the task some time after a packet.
+const uint32_t USB_PACKET_US = 50;
+const uint32_t RX_EVENT_US = 30;
+const uint32_t POLL_PERIOD_US = 4000;
+const uint32_t READ_TIMEOUT_US = 100000;   // Serial.setTimeout(100) of the old code
+
+struct HostWrite{
+  uint64_t t;                   // us since the start of the capture
+  std::vector<uint8_t> data;
+};
+
+struct Capture{
+  std::string name;
+  bool binary = false;
+  std::vector<HostWrite> writes;
+};
+
+// Every byte of a capture with the time it reaches the controller
+struct RxByte{
+  uint8_t c;
+  uint64_t arrival;
+  size_t write;                 // Index of the host write it came from
+};
+
+struct LatencyStats{
+  std::vector<uint32_t> us;
+  uint32_t commands = 0;
+  uint32_t broken = 0;          // Commands not forwarded intact
+
+  void add(uint64_t sent, uint64_t written){ us.push_back(sent - written); }
+  void print(const char* model, const Capture& cap){
+    std::sort(us.begin(), us.end());
+    double mean = 0;
+    for (uint32_t v : us) mean += v;
+    mean = us.empty() ? 0 : mean / us.size();
+    auto pct = [&](double p){ return us.empty() ? 0u : us[std::min(us.size() - 1, (size_t)(p * us.size()))]; };
+    printf("%-7s %-20s %5u sent, %u broken | mean %6.0f us  p50 %5u  p99 %5u  max %5u\n",
+           model, cap.name.c_str(), commands, broken, mean, pct(0.5), pct(0.99),
+           us.empty() ? 0u : us.back());
+  }
+};
+
+std::vector<RxByte> arrive(const Capture& cap){
+  std::vector<RxByte> rx;
+  uint64_t busy = 0;    // Host writes queue behind each other on the link
+  for (size_t w = 0; w < cap.writes.size(); w++){
+    const HostWrite& hw = cap.writes[w];
+    uint64_t start = std::max(hw.t, busy);
+    for (size_t i = 0; i < hw.data.size(); i++){
+      uint64_t packetEnd = start + (i / 64 + 1) * USB_PACKET_US;
+      rx.push_back({hw.data[i], packetEnd, w});
+    }
+    busy = start + ((hw.data.size() + 63) / 64) * USB_PACKET_US;
+  }
+  return rx;
+}
+
+// Old commandForwardingTask, CSV only
+LatencyStats runPolled(const Capture& cap){
+  LatencyStats st;
+  std::vector<RxByte> rx = arrive(cap);
+  size_t pos = 0;
+  uint64_t lastWake = 0;
+  uint64_t now = 0;
+  while (pos < rx.size()){
+    if (rx[pos].arrival <= now){
+      char c = rx[pos].c;
+      if (c == 'd' || c == 'p'){
+        pos++;
+      } else {
+        // readBytesUntil: waits up to the timeout for each byte, stops at ';'
+        // or after 99 bytes
+        std::string text;
+        bool terminated = false;
+        size_t last = pos;
+        while (text.size() < 99 && pos < rx.size()){
+          if (rx[pos].arrival > now + READ_TIMEOUT_US){
+            now += READ_TIMEOUT_US;
+            break;
+          }
+          now = std::max(now, rx[pos].arrival);
+          last = pos;
+          if (rx[pos++].c == ';'){
+            terminated = true;
+            break;
+          }
+          text += rx[last].c;
+        }
+        st.commands++;
+        if (!terminated) st.broken++;
+        st.add(now, cap.writes[rx[last].write].t);
+      }
+    }
+    // vTaskDelayUntil returns at once if the next wake is already past
+    lastWake += POLL_PERIOD_US;
+    now = std::max(now, lastWake);
+  }
+  return st;
+}
+
+// New ingest, both encodings
+LatencyStats runEvent(const Capture& cap, q8SerialParser& parser){
+  LatencyStats st;
+  std::vector<RxByte> rx = arrive(cap);
+  for (const RxByte& b : rx){
+    uint64_t now = b.arrival + RX_EVENT_US;
+    q8ParseResult r = parser.push(b.c);
+    if (r == PARSE_FRAME || r == PARSE_TEXT){
+      st.commands++;
+      st.add(now, cap.writes[b.write].t);
+    } else if (r == PARSE_CRC_ERROR || r == PARSE_OVERFLOW){
+      st.broken++;
+    }
+  }
+  return st;
+}
+
+bool load(const char* path, Capture& cap){
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) return false;
+  cap.name = path;
+  const char* slash = strrchr(path, '/');
+  if (slash) cap.name = slash + 1;
+  char line[1024];
+  while (fgets(line, sizeof(line), f)){
+    if (line[0] == '#' || line[0] == '\n') continue;
+    char* comma = strchr(line, ',');
+    if (comma == nullptr) continue;
+    HostWrite hw;
+    hw.t = strtoull(line, nullptr, 10);
+    for (char* p = comma + 1; isxdigit(p[0]) && isxdigit(p[1]); p += 2){
+      char hex[3] = {p[0], p[1], 0};
+      hw.data.push_back(strtoul(hex, nullptr, 16));
+    }
+    cap.writes.push_back(hw);
+  }
+  fclose(f);
+  cap.binary = !cap.writes.empty() && cap.writes[0].data[0] == SERIAL_FRAME_SYNC[0];
+  return true;
+}
+
+std::vector<uint8_t> frame(const CommandMessage& cmd){
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&cmd);
+  std::vector<uint8_t> out;
+  out.push_back(SERIAL_FRAME_SYNC[0]);
+  out.push_back(SERIAL_FRAME_SYNC[1]);
+  out.push_back(sizeof(cmd));
+  for (size_t i = 0; i < sizeof(cmd); i++) out.push_back(p[i]);
+  uint16_t crc = q8Crc16(&out[2], out.size() - 2);
+  out.push_back(crc & 0xFF);
+  out.push_back(crc >> 8);
+  return out;
+}
+
+// Trot-like CSV commands at 200 Hz. pygame's clock.tick() makes the interval
+// wander between 2 and 7 ms, as seen in the captures.
+void synthesize(Capture& csv, Capture& bin){
+  csv.name = "synthetic csv";
+  bin.name = "synthetic binary";
+  bin.binary = true;
+  uint32_t seed = 1;
+  uint64_t t = 0;
+  CommandMessage cmd;
+  for (int i = 0; i < 1000; i++){
+    seed = seed * 1103515245 + 12345;
+    t += 2000 + (seed >> 8) % 5000;
+    char text[100];
+    float a = 25 + 40 * sinf(i * 0.2f);
+    float b = 125 + 45 * cosf(i * 0.2f);
+    snprintf(text, sizeof(text), "%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,0,0,1;",
+             a, b, 50 - a, 250 - b, 50 - a, 250 - b, a, b);
+    csv.writes.push_back({t, std::vector<uint8_t>(text, text + strlen(text))});
+    text[strlen(text) - 1] = '\0';
+    q8CsvToCommand(text, cmd);
+    cmd.seq = i + 1;
+    bin.writes.push_back({t, frame(cmd)});
+  }
+}
+
+// Binary frames from Python against q8CsvToCommand() on the CSV of the same session
+void checkEncoding(const Capture& csv, const Capture& bin){
+  q8SerialParser textParser, frameParser;
+  std::vector<CommandMessage> fromCsv, fromPython;
+  CommandMessage cmd;
+  for (const HostWrite& hw : csv.writes){
+    for (uint8_t c : hw.data){
+      if (textParser.push(c) == PARSE_TEXT){
+        q8CsvToCommand(textParser.text(), cmd);
+        fromCsv.push_back(cmd);
+      }
+    }
+  }
+  for (const HostWrite& hw : bin.writes){
+    for (uint8_t c : hw.data){
+      if (frameParser.push(c) == PARSE_FRAME){
+        memcpy(&cmd, frameParser.payload(), sizeof(cmd));
+        fromPython.push_back(cmd);
+      }
+    }
+  }
+  size_t same = 0;
+  size_t n = std::min(fromCsv.size(), fromPython.size());
+  for (size_t i = 0; i < n; i++){
+    fromPython[i].seq = fromCsv[i].seq = 0;
+    if (memcmp(&fromPython[i], &fromCsv[i], sizeof(CommandMessage)) == 0) same++;
+  }
+  printf("encoding: %zu of %zu binary commands identical to q8CsvToCommand (%zu CSV)\n",
+         same, fromPython.size(), fromCsv.size());
+}
+
+// Corrupt every 50th frame, add keys and CSV in between
+void checkRecovery(const Capture& bin){
+  q8SerialParser parser;
+  uint32_t good = 0, keys = 0, texts = 0, expected = 0, corrupted = 0;
+  const char* extra = "d0,0,0,0,0,0,0,0,0,0,1;";
+  for (size_t w = 0; w < bin.writes.size(); w++){
+    std::vector<uint8_t> data = bin.writes[w].data;
+    if (w % 50 == 25){
+      data[3 + w % sizeof(CommandMessage)] ^= 0x10;
+      corrupted++;
+    } else if (w % 50 == 40){
+      data.resize(data.size() / 2);   // PC died halfway through a write
+      corrupted++;
+    } else {
+      expected++;
+    }
+    if (w % 100 == 10) data.insert(data.begin(), extra, extra + strlen(extra));
+    for (uint8_t c : data){
+      switch (parser.push(c)){
+        case PARSE_FRAME: good++; break;
+        case PARSE_KEY: keys++; break;
+        case PARSE_TEXT: texts++; break;
+        default: break;
+      }
+    }
+    if (w % 50 == 40) parser.reset();   // Quiet line timeout
+  }
+  printf("recovery: %u of %u intact frames, %u corrupted dropped (%u CRC errors, %u resyncs), "
+         "%u keys, %u CSV\n", good, expected, corrupted, parser.crcErrors, parser.resync, keys, texts);
+}
+
+// Recorded data dump of 4096 values (8 kB, joint current and position) to
+// the PC: printed as text before, DATA frames through the uplink now
+void checkUplink(){
+  const size_t count = 4096;
+  std::vector<uint16_t> values(count);
+  uint32_t seed = 3;
+  for (size_t i = 0; i < count; i++){
+    seed = seed * 1103515245 + 12345;
+    values[i] = (i % 4 < 2) ? (seed >> 8) % 400 : 1024 + (seed >> 8) % 2048;
+  }
+
+  size_t textBytes = 0;
+  char num[8];
+  for (size_t i = 0; i < count; i++){
+    textBytes += snprintf(num, sizeof(num), "%u", values[i]) + 1;
+  }
+
+  std::vector<uint8_t> wire;
+  uint8_t frame[SERIAL_FRAME_MAX + SERIAL_FRAME_OVERHEAD];
+  uint8_t payload[2 + 200] = {DATA, 0};
+  for (size_t i = 0; i < count; i += 100){
+    size_t n = std::min<size_t>(100, count - i);
+    memcpy(&payload[2], &values[i], n * 2);
+    size_t len = q8SerialFrame(frame, payload, 2 + n * 2);
+    for (size_t k = 0; k < len; k++) wire.push_back(frame[k]);
+  }
+
+  // The PC side framing is the same as the command frames, so the parser reads it back
+  q8SerialParser parser;
+  std::vector<uint16_t> back;
+  for (uint8_t c : wire){
+    if (parser.push(c) == PARSE_FRAME && parser.payload()[0] == DATA){
+      for (size_t k = 2; k + 1 < parser.length(); k += 2){
+        back.push_back(parser.payload()[k] | parser.payload()[k + 1] << 8);
+      }
+    }
+  }
+  // 115200 baud is 11520 B/s, USB full speed bulk about 1 MB/s
+  printf("uplink: %zu values, text %zu B (%.0f ms at 115200, %u Serial.print calls), "
+         "binary %zu B in %u frames (%.0f ms), %s\n",
+         count, textBytes, textBytes / 11.52, (unsigned)(2 * count), wire.size(),
+         parser.frames, wire.size() / 11.52, back == values ? "data verified" : "MISMATCH");
+}
+
+// Fleet mode on a simulated ESP-NOW medium. Packets arrive 1 ms after they
+// are sent. The controller side is q8Fleet with the decisions of the
+// firmware's tasks; the robots pair, echo heartbeats, count commands and
+// stream telemetry, which goes to the PC behind a FleetHeader and is told
+// apart there again.
+struct FleetSimPacket{
+  uint32_t at;
+  int8_t from;                  // Robot index, -1 for the controller
+  int8_t to;                    // Robot index, -1 for the controller, -2 broadcast
+  std::vector<uint8_t> data;
+};
+
+struct FleetSimRobot{
+  uint8_t mac[6];
+  uint32_t onAt, offAt;
+  bool paired = false;
+  bool telemetry = false;       // Streams at 100 Hz while commands come in
+  uint32_t commands = 0;
+  uint16_t commandSeq = 0;      // Last command seq received
+  uint32_t seqGaps = 0;         // Commands whose seq did not follow the last one
+  uint32_t heartbeats = 0;
+  uint32_t telemetrySent = 0;
+  uint16_t telemetrySeq = 0;
+};
+
+void checkFleet(){
+  const uint8_t ROBOTS = 5, SIZE = 4;
+  const uint32_t END_MS = 40000, STREAM_MS = 5000, STREAM_END_MS = 30000;
+  q8Fleet fleet(SIZE);
+  FleetSimRobot robots[ROBOTS];
+  const uint32_t onAt[ROBOTS] = {0, 300, 700, 1500, 2500};
+  for (uint8_t i = 0; i < ROBOTS; i++){
+    uint8_t mac[6] = {0x34, 0x85, 0x18, 0x00, 0x00, (uint8_t)(0x10 + i)};
+    memcpy(robots[i].mac, mac, 6);
+    robots[i].onAt = onAt[i];
+    robots[i].offAt = i == 1 ? 20000 : UINT32_MAX;   // Robot 1 runs out of battery
+    robots[i].telemetry = i == 0 || i == 2;
+  }
+  auto slotOf = [&](int8_t robot){ return fleet.find(robots[robot].mac); };
+  auto on = [&](int8_t robot, uint32_t t){ return t >= robots[robot].onAt && t < robots[robot].offAt; };
+
+  std::deque<FleetSimPacket> air;
+  auto send = [&](uint32_t t, int8_t from, int8_t to, const void* data, size_t len){
+    FleetSimPacket p;
+    p.at = t + 1;
+    p.from = from;
+    p.to = to;
+    p.data.assign((const uint8_t*)data, (const uint8_t*)data + len);
+    air.push_back(p);
+  };
+
+  q8SerialParser pc;
+  uint32_t pcTelemetry[FLEET_MAX] = {0}, pcStats[FLEET_MAX] = {0}, pcOther = 0;
+  uint32_t expected[ROBOTS] = {0}, timeouts[ROBOTS] = {0}, rejected = 0, broadcasts = 0;
+  uint32_t lostAt = 0, timedOutAt = 0, replacedAt = 0;
+  unsigned long due[FLEET_MAX] = {0};
+  uint32_t nextBroadcast = 0, commandSeq = 0;
+
+  auto uplink = [&](uint8_t id, const std::vector<uint8_t>& data){
+    uint8_t payload[SERIAL_FRAME_MAX];
+    uint8_t frame[SERIAL_FRAME_MAX + SERIAL_FRAME_OVERHEAD];
+    size_t n = q8SerialFrame(frame, payload, q8FleetWrap(payload, id, data.data(), data.size()));
+    for (size_t k = 0; k < n; k++){
+      if (pc.push(frame[k]) != PARSE_FRAME) continue;
+      const FleetHeader* h = (const FleetHeader*)pc.payload();
+      uint8_t robot = __builtin_ctz(h->robots);
+      uint8_t type = pc.payload()[sizeof(FleetHeader)];
+      if (h->msgType == FLEET && type == TELEMETRY) pcTelemetry[robot]++;
+      else if (h->msgType == FLEET && type == LINK_STATS) pcStats[robot]++;
+      else pcOther++;
+    }
+  };
+
+  for (uint32_t t = 0; t < END_MS; t++){
+    // Deliver what is due
+    while (!air.empty() && air.front().at <= t){
+      FleetSimPacket p = air.front();
+      air.pop_front();
+      uint8_t type = p.data[0];
+      if (p.to == -1){
+        // Controller, as handlePacket()
+        if (!on(p.from, t)) continue;
+        int8_t id = slotOf(p.from);
+        if (type == PAIRING){
+          id = fleet.slotFor(robots[p.from].mac);
+          if (id < 0){
+            rejected++;
+            continue;
+          }
+          if (fleet[id].used && memcmp(fleet[id].mac, robots[p.from].mac, 6) != 0){
+            replacedAt = t;       // Its ID now names the new robot on the PC
+            pcTelemetry[id] = 0;
+            pcStats[id] = 0;
+          }
+          fleet.pair(id, robots[p.from].mac, t);
+        } else if (id >= 0 && type == HEARTBEAT){
+          HeartbeatMessage hb;
+          memcpy(&hb, p.data.data(), sizeof(hb));
+          fleet[id].lastHeartbeatReceived = t;
+          fleet[id].heartbeatEchoSeq = hb.seq;
+          fleet[id].linkStats.received(hb.seq);
+          LinkStatsMessage stats;
+          uplink(id, std::vector<uint8_t>((uint8_t*)&stats, (uint8_t*)&stats + sizeof(stats)));
+        } else if (id >= 0 && type == TELEMETRY){
+          fleet[id].lastHeartbeatReceived = t;
+          fleet[id].lastDataReceived = t;
+          uplink(id, p.data);
+        }
+        continue;
+      }
+      // Robots
+      for (int8_t r = 0; r < ROBOTS; r++){
+        if ((p.to != r && p.to != -2) || !on(r, t)) continue;
+        FleetSimRobot& robot = robots[r];
+        if (type == PAIRING && !robot.paired){
+          robot.paired = true;
+          uint8_t answer[9] = {PAIRING};   // PairingMessage
+          send(t, r, -1, answer, sizeof(answer));
+        } else if (type == HEARTBEAT && robot.paired){
+          robot.heartbeats++;
+          send(t, r, -1, p.data.data(), p.data.size());
+        } else if (type == COMMAND && robot.paired){
+          CommandMessage cmd;
+          memcpy(&cmd, p.data.data(), sizeof(cmd));
+          if (robot.commandSeq != 0 && cmd.seq != (uint16_t)(robot.commandSeq + 1)) robot.seqGaps++;
+          robot.commandSeq = cmd.seq;
+          robot.commands++;
+        }
+      }
+    }
+
+    // Pairing task: broadcast every 2 s until the fleet is complete
+    if (!fleet.full() && t >= nextBroadcast){
+      uint8_t pairing[9] = {PAIRING};
+      send(t, -1, -2, pairing, sizeof(pairing));
+      broadcasts++;
+      nextBroadcast = t + 2000;
+    }
+
+    // Heartbeat task, as in the firmware
+    for (uint8_t id = 0; id < fleet.size(); id++){
+      if ((long)(due[id] - t) > 0) continue;
+      unsigned long wait;
+      if (fleet.beat(id, t, wait) == BEAT_SEND){
+        HeartbeatMessage hb;
+        hb.seq = ++fleet[id].heartbeatSeq;
+        fleet[id].lastSeq = hb.seq;
+        fleet[id].heartbeatsSent++;
+        for (int8_t r = 0; r < ROBOTS; r++){
+          if (memcmp(robots[r].mac, fleet[id].mac, 6) == 0) send(t, -1, r, &hb, sizeof(hb));
+        }
+      }
+      if (fleet.timedOut(id, t)){
+        for (int8_t r = 0; r < ROBOTS; r++){
+          if (memcmp(robots[r].mac, fleet[id].mac, 6) == 0) timeouts[r]++;
+        }
+        if (timedOutAt == 0) timedOutAt = t;
+        fleet.unpair(id);
+      }
+      due[id] = t + wait;
+    }
+
+    // PC commands at 50 Hz: robot 0, 1, 2, 3 alone, robots 0 and 2, everyone
+    if (t >= STREAM_MS && t < STREAM_END_MS && t % 20 == 0){
+      static const uint8_t targets[] = {0x01, 0x02, 0x04, 0x08, 0x05, 0xFF};
+      uint8_t mask = targets[commandSeq++ % sizeof(targets)];
+      CommandMessage cmd;
+      for (uint8_t id = 0; id < fleet.size(); id++){
+        if (!(mask & (1 << id)) || !fleet[id].paired) continue;
+        fleet[id].lastCommandSent = t;
+        cmd.seq = ++fleet[id].commandSeq;
+        for (int8_t r = 0; r < ROBOTS; r++){
+          if (memcmp(robots[r].mac, fleet[id].mac, 6) != 0) continue;
+          send(t, -1, r, &cmd, sizeof(cmd));
+          if (on(r, t)) expected[r]++;
+        }
+      }
+    }
+
+    // Robots stream telemetry while commanded
+    for (int8_t r = 0; r < ROBOTS; r++){
+      if (!robots[r].telemetry || !robots[r].paired || !on(r, t)) continue;
+      if (t >= STREAM_MS && t < STREAM_END_MS && t % 10 == 0){
+        TelemetryMessage tm;
+        tm.seq = robots[r].telemetrySeq++;
+        tm.count = 0;
+        send(t, r, -1, &tm, TELEMETRY_HEADER_LEN);
+        robots[r].telemetrySent++;
+      }
+    }
+    if (t == robots[1].offAt) lostAt = t;
+  }
+
+  bool routed = true, demuxed = true;
+  printf("fleet: %u robots for %u slots, %u pairing broadcasts, %u turned away while full\n",
+         ROBOTS, SIZE, broadcasts, rejected);
+  for (int8_t r = 0; r < ROBOTS; r++){
+    int8_t id = slotOf(r);
+    routed &= robots[r].commands == expected[r] && robots[r].seqGaps == 0;
+    if (id >= 0 && robots[r].telemetry) demuxed &= pcTelemetry[id] == robots[r].telemetrySent;
+    char slot[16];
+    snprintf(slot, sizeof(slot), id >= 0 ? "slot %d" : "no slot", id);
+    printf("  robot %02X: %s%s, %u/%u commands, %u seq gaps, %u heartbeats, %u telemetry frames sent, "
+           "%u on the PC under its ID, %u link reports\n", robots[r].mac[5], slot,
+           id >= 0 && !fleet[id].paired ? " (lost)" : "", robots[r].commands, expected[r], robots[r].seqGaps,
+           robots[r].heartbeats, robots[r].telemetrySent, id >= 0 ? pcTelemetry[id] : 0,
+           id >= 0 ? pcStats[id] : 0);
+  }
+  uint32_t falseTimeouts = 0;
+  for (int8_t r = 0; r < ROBOTS; r++){
+    if (r != 1) falseTimeouts += timeouts[r];
+  }
+  printf("fleet: robot 1 off at %u ms, timed out %u ms later, its slot taken over at %u ms; "
+         "%u other timeouts; commands %s, telemetry %s, %u frames not told apart\n",
+         lostAt, timedOutAt - lostAt, replacedAt, falseTimeouts, routed ? "routed exactly" : "MISROUTED",
+         demuxed ? "demultiplexed" : "MIXED UP", pcOther);
+}
+
+int main(int argc, char** argv){
+  std::vector<Capture> caps;
+  for (int i = 1; i < argc; i++){
+    Capture cap;
+    if (!load(argv[i], cap)){
+      printf("cannot read %s\n", argv[i]);
+      return 1;
+    }
+    caps.push_back(cap);
+  }
+  if (caps.empty()){
+    Capture csv, bin;
+    synthesize(csv, bin);
+    caps.push_back(csv);
+    caps.push_back(bin);
+  }
+
+  printf("serial write to esp_now_send(), USB packet %u us, RX event %u us, poll period %u us\n",
+         USB_PACKET_US, RX_EVENT_US, POLL_PERIOD_US);
+  for (const Capture& cap : caps){
+    if (!cap.binary) runPolled(cap).print("polled", cap);
+    q8SerialParser parser;
+    runEvent(cap, parser).print("event", cap);
+  }
+
+  const Capture* csv = nullptr;
+  const Capture* bin = nullptr;
+  for (const Capture& cap : caps){
+    if (cap.binary && bin == nullptr) bin = &cap;
+    if (!cap.binary && csv == nullptr) csv = &cap;
+  }
+  if (csv && bin) checkEncoding(*csv, *bin);
+  if (bin) checkRecovery(*bin);
+  checkUplink();
+  checkFleet();
+  return 0;
+}
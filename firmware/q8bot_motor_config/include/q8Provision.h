@@ -0,0 +1,98 @@
+/*
+  q8Provision.h - One pass provisioning of the Q8bot servos.
+  Scans every baud rate and ID once, plans the ID, drive mode, operating mode,
+  homing offset, return delay and baud rate of each servo found, applies the
+  changes with sync writes and checks them by reading the EEPROM back.
+
+  Servos that already carry a joint ID keep it. Any other servo (factory
+  default is ID 1 at 57600 bps) takes the lowest joint ID still missing, as in
+  the connect-one-at-a-time workflow. Several new servos with the same ID
+  cannot be told apart on the bus, so they are reported and left alone.
+*/
+#ifndef q8Provision_h
+#define q8Provision_h
+
+#include <Arduino.h>
+#include <Dynamixel2Arduino.h>
+
+// Target configuration of each joint
+const uint8_t PROV_JOINTS = 8;
+const uint8_t PROV_ID[PROV_JOINTS] = {11, 12, 13, 14, 15, 16, 17, 18};
+const uint8_t PROV_DRIVE_MODE[PROV_JOINTS] = {4, 4, 5, 5, 4, 4, 5, 5};
+const uint32_t PROV_HOMING_OFFSET[PROV_JOINTS] = {2048, 4096, 4294965248, 4294963200,
+                                                  2048, 4096, 4294965248, 4294963200};
+const uint8_t PROV_OPERATING_MODE = 4;      // Extended position
+// Bus profile, same as q8BusConfig in the robot firmware
+const uint32_t PROV_FINAL_BAUD = 1000000;
+const uint8_t PROV_RETURN_DELAY = 0;        // 2 us units, factory default 250
+
+const uint8_t PROV_MAX_SERVOS = 16;
+const uint8_t PROV_MAX_ID = 252;
+const uint8_t PROV_READBACK_TRIES = 20;     // 1 ms apart, EEPROM writes are not instant
+
+enum q8ProvisionState : uint8_t{
+  PROV_DONE,        // Already provisioned, nothing written
+  PROV_PLANNED,     // Needs changes
+  PROV_APPLIED,     // Written and read back at the final ID and baud rate
+  PROV_FAILED,      // Read-back did not match
+  PROV_SKIPPED,     // No free joint, or its joint ID is taken
+  PROV_DUPLICATE,   // Several servos answer this ID, cannot be addressed
+};
+
+struct q8ProvisionServo{
+  uint8_t id;             // As found
+  uint32_t baud;          // As found
+  int8_t joint;           // Index into PROV_ID, -1 if not assigned
+  q8ProvisionState state;
+};
+
+class q8Provision
+{
+  public:
+    q8Provision(Dynamixel2Arduino& dxl);
+
+    uint8_t scan();     // Servos (and duplicate IDs) found at all baud rates
+    uint8_t plan();     // Servos that need changes
+    uint8_t apply();    // Servos written and verified
+    void print();
+
+    uint8_t count() const { return _count; }
+    const q8ProvisionServo& servo(uint8_t i) const { return _servos[i]; }
+    bool duplicates() const;
+    uint8_t jointMask() const;    // Bit i set if joint i is provisioned
+
+  private:
+    Dynamixel2Arduino& _dxl;
+    q8ProvisionServo _servos[PROV_MAX_SERVOS];
+    uint8_t _count = 0;
+
+    // Per servo data of the sync writes: 9..11 and 20..23, then 7..8
+    struct config_data{
+      uint8_t return_delay;
+      uint8_t drive_mode;
+      uint8_t operating_mode;
+    } __attribute__((packed));
+    struct homing_data{
+      uint32_t homing_offset;
+    } __attribute__((packed));
+    struct id_data{
+      uint8_t id;
+      uint8_t baud_rate;
+    } __attribute__((packed));
+
+    config_data _config[PROV_MAX_SERVOS];
+    homing_data _homing[PROV_MAX_SERVOS];
+    id_data _ids[PROV_MAX_SERVOS];
+    DYNAMIXEL::InfoSyncWriteInst_t _sw_infos;
+    DYNAMIXEL::XELInfoSyncWrite_t _info_xels_sw[PROV_MAX_SERVOS];
+
+    void _add(uint8_t id, uint32_t baud, q8ProvisionState state);
+    bool _matches(uint8_t id, int8_t joint);   // Already provisioned as this joint
+    bool _readBack(uint8_t id, uint16_t addr, const uint8_t* expect, uint16_t len,
+                   uint8_t tries = PROV_READBACK_TRIES);
+    void _syncWrite(uint16_t addr, uint16_t len, const uint8_t* idx, uint8_t n, uint8_t* data);
+};
+
+uint8_t q8ProvisionBaudIndex(uint32_t baud);   // Baud rate register value, 0xFF if none
+
+#endif
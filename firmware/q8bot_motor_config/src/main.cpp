@@ -10,18 +10,30 @@ Start with nothing connected and open the serial monitor
 - Connect second new Dynamixel to the slot for ID 12 (front left horizontal)
 - Serial monitor should prompt configuration successful
 - Repeat until all 8 motors are configured and have baudrate set at 1M
+  (FINAL_BAUD) and return delay set to 0 (RETURN_DELAY)
 - Program will now switch hardware serial to 1Mb and command all joints to 
 go to the starting condition and prompt you to install the legs.
+
+Provisioning mode (env:provision, PROVISION_MODE): each pass scans every baud
+rate and ID, then sets up all servos found at once (see q8Provision.h). Servos
+already carrying joint IDs can be connected together, new factory-default
+servos still one at a time since they all answer as ID 1.
 */
 
 #include <Arduino.h>
 #include <HardwareSerial.h>
 #include <Dynamixel2Arduino.h>
+#ifdef PROVISION_MODE
+#include <q8Provision.h>
+#endif
 
 // Objects and Constants
 HardwareSerial ser(0);
 const uint32_t STARTING_BAUD = 57600;
+// Bus profile, same as q8BusConfig in the robot firmware. The robot finds
+// the servos at 1, 2, 3 or 4 Mbps and sets its own status return level.
 const uint32_t FINAL_BAUD = 1000000;
+const uint8_t RETURN_DELAY = 0;       // 2 us units, factory default 250
 const float DXL_PROTOCOL_VERSION = 2.0;
 const uint8_t DXL_DIR_PIN = 8;
 const uint8_t BROADCAST_ID = 254;
@@ -34,11 +46,13 @@ const uint8_t idList[8] = {11, 12, 13, 14, 15, 16, 17, 18};
 const uint8_t driveMode[8] = {4, 4, 5, 5, 4, 4, 5, 5};
 const uint8_t operateMode = 4;
 const uint32_t homingOffset[8] = {2048, 4096, 4294965248, 4294963200, 2048, 4096, 4294965248, 4294963200};
-const uint8_t baudRate = 3; // Corresponds to 1Mb baudrate
 const int32_t idlePos[8]   = {4618, 5622, 4618, 5622, 4618, 5622, 4618, 5622};
 const uint16_t moveTime = 1000;
 uint8_t count = 0;
 bool pingValue;
+#ifdef PROVISION_MODE
+q8Provision prov(dxl);
+#endif
 
 // put function declarations here:
 void finishSetup();
@@ -52,6 +66,25 @@ void setup() {
   dxl.setPortProtocolVersion(DXL_PROTOCOL_VERSION);
 }
 
+#ifdef PROVISION_MODE
+void loop() {
+  // One pass over the whole bus, then wait for the next motor
+  uint32_t start = millis();
+  prov.scan();
+  if (prov.plan() > 0) {
+    prov.apply();
+  }
+  prov.print();
+  uint8_t done = __builtin_popcount(prov.jointMask());
+  Serial.printf("%d of 8 joints set up (%lu ms).\n", done, millis() - start);
+  if (done == sizeof(idList)) {
+    finishSetup();
+  } else if (prov.duplicates()) {
+    Serial.println("Several new motors answer with the same ID. Connect new motors one at a time.");
+  }
+  delay(1000);
+}
+#else
 void loop() {
   // Repeat param config for all 8 Dynamixel motors here.
   if (count < sizeof(idList)) {
@@ -65,6 +98,8 @@ void loop() {
       delay(100);
       dxl.writeControlTableItem(HOMING_OFFSET, idList[count], homingOffset[count]);
       delay(100);
+      dxl.writeControlTableItem(RETURN_DELAY_TIME, idList[count], RETURN_DELAY);
+      delay(100);
       count++;
     // If not, wait for the first new motor to connect and set it up for the ID
     } else {
@@ -74,11 +109,12 @@ void loop() {
         dxl.writeControlTableItem(DRIVE_MODE, STARTING_ID, driveMode[count]);
         dxl.writeControlTableItem(OPERATING_MODE, STARTING_ID, operateMode);
         dxl.writeControlTableItem(HOMING_OFFSET, STARTING_ID, homingOffset[count]);
-        // Finally set 1Mb baudrate and move to next ID
+        dxl.writeControlTableItem(RETURN_DELAY_TIME, STARTING_ID, RETURN_DELAY);
+        // Finally set the final baudrate and move to next ID
         Serial.print("DXL Params set. Changing ID to "); Serial.println(idList[count]);
         dxl.writeControlTableItem(ID, STARTING_ID, idList[count]);
         delay(100);
-        dxl.writeControlTableItem(BAUD_RATE, idList[count], 3);
+        dxl.setBaudrate(idList[count], FINAL_BAUD);
         delay(100);
         count++;
       } else {
@@ -94,15 +130,17 @@ void loop() {
     finishSetup();
   }
 }
+#endif
 
 void finishSetup() {
-  // Reopen dxl port at 1M baudrate
+  // Reopen dxl port at the final baudrate
   dxl.begin(FINAL_BAUD);
   dxl.torqueOn(BROADCAST_ID);
   for (int i = 0; i < sizeof(idList); i++) {
     Serial.printf("Motor ID %d connection ", idList[i]);
     if (dxl.ping(idList[i])) {
-      Serial.println("successful.");
+      Serial.printf("successful, return delay %d us.\n",
+                    (int)dxl.readControlTableItem(RETURN_DELAY_TIME, idList[i]) * 2);
       dxl.writeControlTableItem(PROFILE_VELOCITY, idList[i], moveTime);
       dxl.writeControlTableItem(PROFILE_ACCELERATION, idList[i], moveTime / 3);
       dxl.writeControlTableItem(GOAL_POSITION, idList[i], idlePos[i]);
@@ -0,0 +1,112 @@
+/*
+  simMain.cpp - Host entry point for the native environment. Runs q8Provision
+  against the simulated Dynamixel bus of the robot firmware
+  (../q8bot_robot/lib/dxlSim) for the bus states met while building robots,
+  and checks every servo's EEPROM against the target configuration.
+
+  Run with: pio run -e native -t exec
+*/
+#include <Arduino.h>
+#include <Dynamixel2Arduino.h>
+#include <dxlSimBus.h>
+#include "q8Provision.h"
+
+HardwareSerial ser(0);
+Dynamixel2Arduino dxl(ser, 8);
+q8Provision prov(dxl);
+
+uint8_t provisioned(){
+  // Joints whose servo is at 1 Mbps with the full target configuration
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < simBus.servoCount(); i++){
+    const dxlSimServo* s = simBus.servo(i);
+    for (uint8_t j = 0; j < PROV_JOINTS; j++){
+      if (s->id() == PROV_ID[j] && s->baud() == PROV_FINAL_BAUD &&
+          s->get(dxlSimAddr::RETURN_DELAY_TIME, 1) == PROV_RETURN_DELAY &&
+          s->get(dxlSimAddr::DRIVE_MODE, 1) == PROV_DRIVE_MODE[j] &&
+          s->get(dxlSimAddr::OPERATING_MODE, 1) == PROV_OPERATING_MODE &&
+          s->get(dxlSimAddr::HOMING_OFFSET, 4) == PROV_HOMING_OFFSET[j]){
+        mask |= 1 << j;
+      }
+    }
+  }
+  return mask;
+}
+
+uint32_t eepromWrites(){
+  uint32_t n = 0;
+  for (uint8_t i = 0; i < simBus.servoCount(); i++){
+    n += simBus.servo(i)->eepromWrites;
+  }
+  return n;
+}
+
+void pass(const char* name){
+  uint32_t writes = eepromWrites();
+  simBus.resetStats();
+  uint64_t start = simBus.now();
+  uint8_t found = prov.scan();
+  uint8_t todo = prov.plan();
+  uint8_t applied = todo > 0 ? prov.apply() : 0;
+  const dxlSimStats& st = simBus.stats();
+  printf("%-28s found %2u, planned %u, applied %u, joints 0x%02X (bus 0x%02X), dup %d, "
+         "%5.0f ms, %4u txn, %u EEPROM writes\n",
+         name, found, todo, applied, prov.jointMask(), provisioned(), prov.duplicates(),
+         (simBus.now() - start) / 1000.0, st.transactions, eepromWrites() - writes);
+}
+
+int main(){
+  dxl.setPortProtocolVersion(2.0);
+
+  // Legacy workflow, one factory-default servo connected per pass
+  simBus.clear();
+  uint64_t start = simBus.now();
+  for (uint8_t j = 0; j < PROV_JOINTS; j++){
+    simBus.addServo(1, 1);
+    prov.scan();
+    if (prov.plan() > 0) prov.apply();
+  }
+  printf("one at a time: 8 passes, joints 0x%02X, %.1f s on the bus\n", provisioned(),
+         (simBus.now() - start) / 1e6);
+  pass("provisioned robot");
+
+  // Batch: joints 11-17 numbered by a jig but otherwise factory state, one new servo
+  simBus.clear();
+  for (uint8_t j = 0; j < PROV_JOINTS - 1; j++){
+    simBus.addServo(PROV_ID[j], 1);
+  }
+  simBus.addServo(1, 1);
+  pass("7 numbered + 1 new");
+  prov.print();
+  pass("rerun");
+
+  // Three new servos at ID 1 next to five provisioned ones
+  simBus.clear();
+  for (uint8_t j = 0; j < 5; j++){
+    simBus.addServo(PROV_ID[j], 1);
+  }
+  pass("5 joints");
+  for (uint8_t j = 0; j < 3; j++){
+    simBus.addServo(1, 1);
+  }
+  uint32_t writes = eepromWrites();
+  pass("5 joints + 3 new at ID 1");
+  uint32_t newWrites = 0;
+  for (uint8_t i = 5; i < simBus.servoCount(); i++){
+    newWrites += simBus.servo(i)->eepromWrites;
+  }
+  printf("duplicates left alone: %s (%u EEPROM writes to them, %u in total)\n",
+         newWrites == 0 ? "yes" : "NO", newWrites, eepromWrites() - writes);
+
+  // Joint 12 twice, at 1 Mbps and at the factory rate
+  simBus.clear();
+  for (uint8_t j = 0; j < PROV_JOINTS; j++){
+    simBus.addServo(PROV_ID[j], 1);
+  }
+  pass("8 numbered");
+  simBus.addServo(12, 1);
+  pass("8 joints + stray ID 12");
+  prov.print();
+
+  return 0;
+}
@@ -0,0 +1,225 @@
+/*
+  q8Provision.cpp - One pass provisioning of the Q8bot servos. See q8Provision.h.
+*/
+
+#include <Arduino.h>
+#include <Dynamixel2Arduino.h>
+#include <q8Provision.h>
+
+// Control table addresses of the X-series EEPROM area
+const uint16_t ADDR_ID = 7;               // ID, then baud rate
+const uint16_t ADDR_RETURN_DELAY = 9;     // Return delay, drive mode, operating mode
+const uint16_t ADDR_HOMING_OFFSET = 20;
+
+// Factory rate first, then the ones a provisioned robot may use
+const uint32_t SCAN_BAUDS[] = {57600, 1000000, 2000000, 3000000, 4000000, 9600, 115200, 4500000};
+
+uint8_t q8ProvisionBaudIndex(uint32_t baud){
+  const uint32_t table[] = {9600, 57600, 115200, 1000000, 2000000, 3000000, 4000000, 4500000};
+  for (uint8_t i = 0; i < 8; i++){
+    if (table[i] == baud) return i;
+  }
+  return 0xFF;
+}
+
+q8Provision::q8Provision(Dynamixel2Arduino& dxl) : _dxl(dxl) {
+}
+
+uint8_t q8Provision::scan(){
+  _count = 0;
+  for (size_t b = 0; b < sizeof(SCAN_BAUDS) / sizeof(SCAN_BAUDS[0]); b++){
+    _dxl.begin(SCAN_BAUDS[b]);
+    if (!_dxl.ping(DXL_BROADCAST_ID)) continue;   // One timeout where nobody listens
+    for (uint16_t id = 0; id <= PROV_MAX_ID; id++){
+      if (_dxl.ping(id)){
+        _add(id, SCAN_BAUDS[b], PROV_PLANNED);
+      } else if (_dxl.getLastLibErrCode() == DXL_LIB_ERROR_CHECK_SUM){
+        _add(id, SCAN_BAUDS[b], PROV_DUPLICATE);
+      }
+    }
+  }
+  return _count;
+}
+
+uint8_t q8Provision::plan(){
+  bool taken[PROV_JOINTS] = {false};
+
+  // Servos that already carry a joint ID keep it, the one at the final rate first
+  for (int pass = 0; pass < 2; pass++){
+    for (uint8_t i = 0; i < _count; i++){
+      q8ProvisionServo& s = _servos[i];
+      if (s.state != PROV_PLANNED || (s.baud == PROV_FINAL_BAUD) != (pass == 0)) continue;
+      for (uint8_t j = 0; j < PROV_JOINTS; j++){
+        if (PROV_ID[j] != s.id) continue;
+        if (taken[j]){
+          s.state = PROV_SKIPPED;
+        } else {
+          taken[j] = true;
+          s.joint = j;
+        }
+      }
+    }
+  }
+
+  // Any other servo takes the lowest joint still missing
+  for (uint8_t i = 0; i < _count; i++){
+    q8ProvisionServo& s = _servos[i];
+    if (s.state != PROV_PLANNED || s.joint >= 0) continue;
+    s.state = PROV_SKIPPED;
+    for (uint8_t j = 0; j < PROV_JOINTS; j++){
+      if (!taken[j]){
+        taken[j] = true;
+        s.joint = j;
+        s.state = PROV_PLANNED;
+        break;
+      }
+    }
+  }
+
+  uint8_t todo = 0;
+  for (uint8_t i = 0; i < _count; i++){
+    q8ProvisionServo& s = _servos[i];
+    if (s.state != PROV_PLANNED) continue;
+    _dxl.begin(s.baud);
+    if (_matches(s.id, s.joint)){
+      s.state = PROV_DONE;
+    } else {
+      todo++;
+    }
+  }
+  return todo;
+}
+
+uint8_t q8Provision::apply(){
+  // One group per baud rate the planned servos were found at
+  bool handled[PROV_MAX_SERVOS] = {false};
+  for (uint8_t i = 0; i < _count; i++){
+    if (_servos[i].state != PROV_PLANNED || handled[i]) continue;
+    uint32_t baud = _servos[i].baud;
+    uint8_t group[PROV_MAX_SERVOS];
+    uint8_t n = 0;
+    for (uint8_t k = i; k < _count; k++){
+      if (_servos[k].state == PROV_PLANNED && _servos[k].baud == baud){
+        group[n++] = k;
+        handled[k] = true;
+      }
+    }
+
+    _dxl.begin(baud);
+    _dxl.torqueOff(DXL_BROADCAST_ID);    // EEPROM is locked while torque is on
+    for (uint8_t k = 0; k < n; k++){
+      int8_t joint = _servos[group[k]].joint;
+      _config[group[k]].return_delay = PROV_RETURN_DELAY;
+      _config[group[k]].drive_mode = PROV_DRIVE_MODE[joint];
+      _config[group[k]].operating_mode = PROV_OPERATING_MODE;
+      _homing[group[k]].homing_offset = PROV_HOMING_OFFSET[joint];
+    }
+    _syncWrite(ADDR_RETURN_DELAY, sizeof(config_data), group, n, reinterpret_cast<uint8_t*>(_config));
+    _syncWrite(ADDR_HOMING_OFFSET, sizeof(homing_data), group, n, reinterpret_cast<uint8_t*>(_homing));
+
+    // Only servos that took the settings move on to their final ID and rate
+    uint8_t verified[PROV_MAX_SERVOS];
+    uint8_t v = 0;
+    for (uint8_t k = 0; k < n; k++){
+      q8ProvisionServo& s = _servos[group[k]];
+      if (_readBack(s.id, ADDR_RETURN_DELAY, reinterpret_cast<uint8_t*>(&_config[group[k]]), sizeof(config_data)) &&
+          _readBack(s.id, ADDR_HOMING_OFFSET, reinterpret_cast<uint8_t*>(&_homing[group[k]]), sizeof(homing_data))){
+        _ids[group[k]].id = PROV_ID[s.joint];
+        _ids[group[k]].baud_rate = q8ProvisionBaudIndex(PROV_FINAL_BAUD);
+        verified[v++] = group[k];
+      } else {
+        s.state = PROV_FAILED;
+      }
+    }
+    _syncWrite(ADDR_ID, sizeof(id_data), verified, v, reinterpret_cast<uint8_t*>(_ids));
+  }
+
+  uint8_t applied = 0;
+  _dxl.begin(PROV_FINAL_BAUD);
+  for (uint8_t i = 0; i < _count; i++){
+    q8ProvisionServo& s = _servos[i];
+    if (s.state != PROV_PLANNED) continue;
+    if (_readBack(PROV_ID[s.joint], ADDR_ID, reinterpret_cast<uint8_t*>(&_ids[i]), sizeof(id_data))){
+      s.state = PROV_APPLIED;
+      applied++;
+    } else {
+      s.state = PROV_FAILED;
+    }
+  }
+  return applied;
+}
+
+void q8Provision::print(){
+  static const char* names[] = {"already set up", "planned", "set up", "FAILED",
+                                "skipped, joint ID taken or none free", "DUPLICATE ID"};
+  for (uint8_t i = 0; i < _count; i++){
+    const q8ProvisionServo& s = _servos[i];
+    Serial.printf("ID %3u at %7lu bps", s.id, (unsigned long)s.baud);
+    if (s.joint >= 0) Serial.printf(" -> joint ID %u", PROV_ID[s.joint]);
+    Serial.printf(": %s\n", names[s.state]);
+  }
+}
+
+bool q8Provision::duplicates() const {
+  for (uint8_t i = 0; i < _count; i++){
+    if (_servos[i].state == PROV_DUPLICATE) return true;
+  }
+  return false;
+}
+
+uint8_t q8Provision::jointMask() const {
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < _count; i++){
+    const q8ProvisionServo& s = _servos[i];
+    if (s.state == PROV_DONE || s.state == PROV_APPLIED) mask |= 1 << s.joint;
+  }
+  return mask;
+}
+
+void q8Provision::_add(uint8_t id, uint32_t baud, q8ProvisionState state){
+  if (_count >= PROV_MAX_SERVOS) return;
+  _servos[_count].id = id;
+  _servos[_count].baud = baud;
+  _servos[_count].joint = -1;
+  _servos[_count].state = state;
+  _count++;
+}
+
+bool q8Provision::_matches(uint8_t id, int8_t joint){
+  // Everything from ID to operating mode, and the homing offset
+  const uint8_t expect[5] = {PROV_ID[joint], q8ProvisionBaudIndex(PROV_FINAL_BAUD),
+                             PROV_RETURN_DELAY, PROV_DRIVE_MODE[joint], PROV_OPERATING_MODE};
+  homing_data homing = {PROV_HOMING_OFFSET[joint]};
+  return _readBack(id, ADDR_ID, expect, sizeof(expect), 1) &&
+         _readBack(id, ADDR_HOMING_OFFSET, reinterpret_cast<uint8_t*>(&homing), sizeof(homing), 1);
+}
+
+bool q8Provision::_readBack(uint8_t id, uint16_t addr, const uint8_t* expect, uint16_t len, uint8_t tries){
+  // Poll until the value shows up instead of sleeping a fixed time per write.
+  // A servo busy writing its EEPROM may not answer at all.
+  uint8_t buf[8];
+  for (uint8_t t = 0; t < tries; t++){
+    if (t > 0) delay(1);
+    if (_dxl.read(id, addr, len, buf, sizeof(buf)) == len && memcmp(buf, expect, len) == 0){
+      return true;
+    }
+  }
+  return false;
+}
+
+void q8Provision::_syncWrite(uint16_t addr, uint16_t len, const uint8_t* idx, uint8_t n, uint8_t* data){
+  if (n == 0) return;
+  _sw_infos.packet.p_buf = nullptr;
+  _sw_infos.packet.is_completed = false;
+  _sw_infos.addr = addr;
+  _sw_infos.addr_length = len;
+  _sw_infos.p_xels = _info_xels_sw;
+  _sw_infos.xel_count = 0;
+  for (uint8_t k = 0; k < n; k++){
+    _info_xels_sw[k].id = _servos[idx[k]].id;
+    _info_xels_sw[k].p_data = data + idx[k] * len;
+    _sw_infos.xel_count++;
+  }
+  _sw_infos.is_info_changed = true;
+  _dxl.syncWrite(&_sw_infos);
+}
@@ -0,0 +1,138 @@
+/*
+  q8Control.h - Fixed-rate control loop for the Q8bot robot.
+  Incoming commands only update the desired state and post it to a lock-free
+  mailbox. The control task latches the newest state once per period and is
+  the only place that talks to the Dynamixel bus, so actuation timing no
+  longer follows radio jitter.
+*/
+#ifndef q8Control_h
+#define q8Control_h
+
+#include <Arduino.h>
+#include <atomic>
+#include "q8Protocol.h"
+#include "q8Dynamixel.h"
+#include "q8Gait.h"
+#include "q8Motion.h"
+#include "q8Mailbox.h"
+#include "q8Smoother.h"
+
+// Stage times of a traced command (CMD_FLAG_TRACE), micros() on the robot
+struct q8TraceStamp{
+  bool active = false;
+  uint16_t id = 0;
+  uint16_t ingestUs = 0;       // From the controller
+  uint32_t rxUs = 0;           // onRecv()
+  uint32_t taskUs = 0;         // espnowRxTask picked it up
+  uint32_t postUs = 0;         // Setpoint posted, set by command()
+};
+
+// Desired robot state, as accumulated from commands. Events (moves, motions,
+// record requests) are counters so they survive being overwritten.
+struct q8Setpoint{
+  uint32_t seq = 0;
+  int16_t pos[8] = {0};        // Same units as CommandMessage::pos
+  bool footXY = false;
+  bool timed = false;          // Write profile with pos, see CMD_FLAG_TIMED
+  uint8_t posCount = 0;        // Incremented for every new joint target
+  uint16_t posSeq = 0;         // CommandMessage::seq of the joint target
+  uint32_t posUs = 0;          // micros() when the joint target came in
+  bool torque = false;
+  uint16_t profile = 1000;     // Profile set by q8Dynamixel::begin()
+  uint8_t gait = 0;
+  uint8_t gaitDir = GAIT_STOP;
+  uint16_t gaitStride = 100;
+  uint16_t gaitPeriod = 0;
+  uint8_t motion = 0;          // MotionId
+  uint8_t motionCount = 0;     // Incremented for every motion request
+  uint8_t recordCount = 0;
+  uint16_t telemetryHz = 0;    // 0 = no telemetry stream
+  bool startAt = false;        // Group start: not latched before startUs
+  uint32_t startUs = 0;
+  q8TraceStamp trace;          // Only set on the setpoint of a traced command
+};
+
+struct q8ControlStats{
+  uint32_t cycles;
+  uint32_t setpoints;          // New setpoints latched from the mailbox
+  uint32_t writes;             // bulkWrites issued, at most one per cycle
+  uint32_t overruns;           // Cycles that took longer than the period
+  uint32_t maxJitterUs;        // Worst deviation of the cycle start from the period
+  uint32_t maxExecUs;          // Longest cycle
+};
+
+// Returned by cycle() for work the caller does after the write
+enum q8CycleEvent : uint8_t{
+  CYCLE_RECORD        = 1 << 0,  // Record a sample of the new position
+  CYCLE_GAIT_REJECTED = 1 << 1,  // Requested gait/direction or motion is not available
+  CYCLE_TELEMETRY     = 1 << 2,  // Take a telemetry sample
+  CYCLE_TELEMETRY_END = 1 << 3,  // Stream stopped, send what is left
+  CYCLE_TRACE         = 1 << 4,  // trace() holds the record of a traced command
+  CYCLE_STREAM_STALE  = 1 << 5,  // Streamed joint targets stopped, see SmoothStale
+};
+
+class q8Control
+{
+  public:
+    q8Control(q8Dynamixel& dxl, uint32_t periodMs);
+
+    // Producer side (ESP-NOW RX task). Returns CMD_BATTERY or CMD_SEND_RECORDED
+    // for the caller to answer, otherwise 0. A trace stamp comes back as a
+    // TraceRecord from the cycle that writes the setpoint (CYCLE_TRACE).
+    uint8_t command(const CommandMessage& cmd, const q8TraceStamp* trace = nullptr);
+    uint8_t commandCsv(const char* csv);
+
+    // Producer side. Commands with CMD_FLAG_HOLD only build up the desired
+    // state; this posts it to be latched at micros() atUs, by the first cycle
+    // that starts then or later. False if nothing is held. A command that is
+    // not held posts the held state along with it at once.
+    bool startHeld(uint32_t atUs);
+
+    // Any task. Torque off and stop the gait at the next cycle.
+    void requestStop();
+
+    // Before the tasks start. Profile of moves that do not bring their own.
+    void setDefaultProfile(uint16_t dur);
+
+    // Before the tasks start. Playback of streamed joint targets, i.e. joint
+    // commands with profile 0; SMOOTH_OFF (the default) writes them as they come.
+    void setSmoothing(const q8SmoothConfig& config);
+
+    // Control task, once per period. startUs is micros() at wakeup.
+    uint8_t cycle(uint32_t startUs);
+
+    // Control task, after cycle(). us from nowUs to a group start that comes
+    // before the next regular cycle, for the caller to run the next cycle
+    // right then instead; -1 if there is none.
+    int32_t startIn(uint32_t nowUs) const;
+
+    uint32_t periodMs() const { return _periodMs; }
+    bool motionActive() const { return _motion.active(); }
+    const q8ControlStats& stats() const { return _stats; }
+    const TraceRecord& trace() const { return _trace; }
+    const q8Smoother& smoother() const { return _smooth; }
+    void resetStats();
+
+  private:
+    q8Dynamixel& _dxl;
+    uint32_t _periodMs;
+    q8Mailbox<q8Setpoint> _mailbox;
+    q8Setpoint _next;            // Producer's desired state
+    q8Setpoint _sp;              // Last latched setpoint, owned by the control task
+    bool _held = false;          // _next has changes waiting for startHeld()
+    q8Setpoint _start;           // Fetched group start waiting for its time
+    bool _starting = false;
+    q8Gait _gait;
+    q8Motion _motion;
+    q8Smoother _smooth;
+    std::atomic<bool> _stopRequest{false};
+    uint32_t _lastStartUs = 0;
+    uint32_t _telemetryAcc = 0;  // Hz * ms, one sample per 1000
+    q8ControlStats _stats;
+    TraceRecord _trace;
+
+    void _writeTarget();
+    void _writeSmoothed(const float target[8]);
+};
+
+#endif
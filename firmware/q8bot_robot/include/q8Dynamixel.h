@@ -8,14 +8,46 @@
 
 #include <Arduino.h>
 #include <Dynamixel2Arduino.h>
+#include "q8Protocol.h"
+#include "q8Kinematics.h"
 
 using namespace ControlTableItem;
 
+// One sync read of all joints, raw register values in joint order
+struct q8JointState{
+  uint32_t timestamp;     // micros() when the read completed
+  uint8_t okMask;         // Bit i set if joint i answered
+  int16_t current[8];     // Present current, 1 mA units on the XL330
+  int32_t velocity[8];    // Present velocity, 0.229 rpm units
+  int32_t position[8];    // Present position, ticks
+};
+
+// Bus timing set up by begin(). Baud rate and return delay are kept in the
+// servos' EEPROM, the status return level goes back to 2 at every power up.
+struct q8BusConfig{
+  uint32_t baudrate = 1000000;     // 1, 2, 3 or 4 Mbps
+  uint8_t statusReturnLevel = 1;   // 0 = ping only, 1 = ping and read, 2 = all
+  uint8_t returnDelay = 0;         // 2 us units, factory default 250 (500 us)
+};
+
+// What configureBus() ended up with, for the caller to log
+struct q8BusStatus{
+  uint32_t baudrate = 1000000;
+  uint8_t statusReturnLevel = 2;
+  uint16_t returnDelayUs = 500;
+  uint8_t joints = 0;              // Bit i set if joint i answered
+  bool applied = false;            // Every setting verified
+};
+
 class q8Dynamixel
 {
   public:
     q8Dynamixel(Dynamixel2Arduino& dxl);
-    void begin();
+    bool begin(const q8BusConfig& bus = q8BusConfig());   // Result of configureBus()
+    bool configureBus(const q8BusConfig& bus);   // True if every setting verified
+    const q8BusStatus& busStatus() const { return _busStatus; }
+    uint8_t pingSweep();                          // Bit i set if joint i answers
+    uint32_t busBaud() const { return _baudrate; }
     bool checkComms(uint8_t ID);
     bool commStart();
     uint16_t checkBattery();
@@ -25,12 +57,24 @@ class q8Dynamixel
     void resetTorqueState();  // Reset internal torque flag without changing hardware state
     void setOpMode();
     void setProfile(uint16_t dur);
+    void setProfile(const uint16_t dur[8]);   // Per joint, one sync write
     void setGain(uint16_t p_gain);
+    void setGain(const uint16_t p_gain[8]);   // Per joint, one sync write
     void moveSingle(int32_t val);
     void bulkWrite(int32_t values[8]);
-    uint16_t* syncRead();
-    void jump();
+    void moveFeet(const float feet[8]);   // Foot x/y (mm) of each leg, solved by IK
+    void moveFeet(const float feet[8], uint16_t dur);
+    void moveTimed(const int32_t values[8], uint16_t dur);         // Goals and profile,
+    void moveTimed(const int32_t values[8], const uint16_t dur[8]); // one sync write
+    void updateProfile(uint16_t dur);     // setProfile only if dur changed
+    void updateGain(uint16_t p_gain);     // setGain only if p_gain changed
+    void updateTorque(bool flag);         // toggleTorque only if flag changed
+    bool syncRead(q8JointState& state);   // True if every joint answered, no allocation
+    bool syncRead(uint16_t* out);         // Current/position of each joint into out[16]
+    uint16_t* syncRead();                 // Allocates, caller must delete[]
     uint8_t parseData(const char* myData);
+    uint8_t executeCommand(const CommandMessage& cmd);
+    const int32_t* posArray() const { return _posArray; }   // Goals of the last command
 
   private:
     Dynamixel2Arduino& _dxl; // Member variable to store the object of Dynamixel2Arduino
@@ -40,8 +84,14 @@ class q8Dynamixel
     const uint16_t SR_ADDR_LEN = 10;
     const uint16_t SW_START_ADDR = 116; //Goal position
     const uint16_t SW_ADDR_LEN = 4;
+    const uint16_t SW_PROFILE_ADDR = 108; //Profile acceleration, then profile velocity
+    const uint16_t SW_GAIN_ADDR = 84;     //Position P gain
+    const uint16_t BAUD_RATE_ADDR = 8;
+    const uint16_t RETURN_DELAY_ADDR = 9;
+    const uint16_t STATUS_RETURN_ADDR = 68;
+    static const uint16_t PROFILE_MIXED = 0xFFFF;  // Set by a per joint write
 
-    uint32_t _baudrate = 1000000;
+    uint32_t _baudrate = 1000000;   // Current bus rate, changed by configureBus()
     float _protocolVersion = 2.0;
     static const uint8_t _idCount = 8;
     const uint8_t _DXL[_idCount] = {11, 12, 13, 14, 15, 16, 17, 18};
@@ -51,22 +101,24 @@ class q8Dynamixel
     const int16_t _zeroOffset = 4096;
     const uint8_t _gearRatio = 1;
     int32_t _posArray[8];
+    q8Kinematics _leg[4];    // One solver per leg so each keeps its own previous solution
     uint16_t _profile = 0;
     uint16_t _prevProfile;
+    uint16_t _gain = 0;
+    uint8_t _statusLevel = 2;
+    q8BusStatus _busStatus;
     bool _torqueFlag = false;
     bool _prevTorqueFlag = false;
     uint8_t _specialCmd = 0;
     int32_t _deg2Dxl(float deg);
     float _dxl2Deg(int32_t dxlRaw);
-    void expandArrays();
-    const float _idlePos[2]   = {30, 150};
-    int32_t _idleArray[8];
-    const float _jumpLow[2]   = {-40, 220};
-    int32_t _lowArray[8];
-    const float _jumpHigh[2] = {90, 90};
-    int32_t _highArray[8];
-    const float _jumpRest[2]  = {30, 150};
-    int32_t _restArray[8];
+    void _feetToPos(const float feet[8]);
+    bool _findBus(uint32_t preferred);
+    bool _setReturnDelay(uint8_t delay);
+    bool _setBaud(uint32_t baud);
+    bool _setStatusLevel(uint8_t level);
+    bool _writeByte(uint8_t id, uint16_t addr, uint8_t value);
+    bool _readByte(uint8_t id, uint16_t addr, uint8_t& value);
 
     // Struct definitions for br (bulk read) and bw (bulk write)
     struct br_data_xel{
@@ -85,6 +137,18 @@ class q8Dynamixel
     typedef struct sw_data{
       int32_t goal_position;
     } __attribute__((packed)) sw_data_t;
+    typedef struct sw_profile_data{
+      uint32_t profile_acceleration;
+      uint32_t profile_velocity;
+    } __attribute__((packed)) sw_profile_data_t;
+    typedef struct sw_gain_data{
+      uint16_t position_p_gain;
+    } __attribute__((packed)) sw_gain_data_t;
+    typedef struct sw_timed_data{
+      uint32_t profile_acceleration;
+      uint32_t profile_velocity;
+      int32_t goal_position;
+    } __attribute__((packed)) sw_timed_data_t;
 
     struct br_data_xel _br_data_xel[_idCount];
     DYNAMIXEL::InfoBulkReadInst_t _br_infos;
@@ -99,6 +163,15 @@ class q8Dynamixel
     sw_data_t _sw_data[_idCount];
     DYNAMIXEL::InfoSyncWriteInst_t _sw_infos;
     DYNAMIXEL::XELInfoSyncWrite_t _info_xels_sw[_idCount];
+    sw_profile_data_t _sw_profile_data[_idCount];
+    DYNAMIXEL::InfoSyncWriteInst_t _sw_profile_infos;
+    DYNAMIXEL::XELInfoSyncWrite_t _info_xels_sw_profile[_idCount];
+    sw_gain_data_t _sw_gain_data[_idCount];
+    DYNAMIXEL::InfoSyncWriteInst_t _sw_gain_infos;
+    DYNAMIXEL::XELInfoSyncWrite_t _info_xels_sw_gain[_idCount];
+    sw_timed_data_t _sw_timed_data[_idCount];
+    DYNAMIXEL::InfoSyncWriteInst_t _sw_timed_infos;
+    DYNAMIXEL::XELInfoSyncWrite_t _info_xels_sw_timed[_idCount];
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+/*
+  q8Gait.h - Onboard gait trajectory generator.
+  Port of python-tools/q8bot/gait_generator.py. Instead of precomputing joint
+  tables, foot positions are evaluated per tick from the gait parameters, so a
+  CMD_GAIT command (gait, direction, stride, period) is all the link carries.
+*/
+#ifndef q8Gait_h
+#define q8Gait_h
+
+#include <Arduino.h>
+#include "q8Protocol.h"
+#include "q8Kinematics.h"
+
+enum q8GaitType : uint8_t{
+  GAIT_TYPE_TROT,
+  GAIT_TYPE_WALK,
+  GAIT_TYPE_BOUND,
+  GAIT_TYPE_PRONK,
+  GAIT_TYPE_CRAWL,
+};
+
+// Same fields as the GAITS entries in gait_manager.py
+struct q8GaitParams{
+  q8GaitType type;
+  float x0, y0, xrange, yrange, yrange2;
+  uint8_t s1Count, s2Count;
+};
+
+// Indexed by CMD_GAIT pos[0]. Keep in the order of GAITS in gait_manager.py.
+const q8GaitParams Q8_GAITS[] = {
+  {GAIT_TYPE_TROT,  9.75f, 43.36f, 40, 20, 0, 15, 30},   // TROT
+  {GAIT_TYPE_TROT,  9.75f, 60.0f,  20, 10, 0, 15, 30},   // TROT_HIGH
+  {GAIT_TYPE_TROT,  9.75f, 25.0f,  20, 10, 0, 15, 30},   // TROT_LOW
+  {GAIT_TYPE_TROT,  9.75f, 43.36f, 50, 20, 0, 12, 24},   // TROT_FAST
+  {GAIT_TYPE_WALK,  9.75f, 43.36f, 30, 20, 0, 20, 140},  // WALK
+  {GAIT_TYPE_CRAWL, 9.75f, 40.0f,  10, 20, 0, 50, 25},   // CRAWL
+  {GAIT_TYPE_BOUND, 9.75f, 33.36f, 40, 0, 20, 50, 10},   // BOUND
+  {GAIT_TYPE_PRONK, 9.75f, 33.36f, 40, 0, 20, 60, 10},   // PRONK
+};
+const uint8_t Q8_GAIT_COUNT = sizeof(Q8_GAITS) / sizeof(Q8_GAITS[0]);
+
+// operate.py ticks the GaitManager at 200 Hz, one trajectory point per tick
+const uint16_t GAIT_SAMPLE_MS = 5;
+
+class q8Gait
+{
+  public:
+    q8Gait();
+
+    // Start or switch direction. Switching keeps the phase like GaitManager.
+    // stridePct scales xrange, periodMs = 0 uses GAIT_SAMPLE_MS per point.
+    // Returns false (and stops) if the gait or direction is not available.
+    bool start(uint8_t gait, uint8_t dir, uint16_t stridePct = 100, uint16_t periodMs = 0);
+    void stop();
+    bool active() const { return _active; }
+    uint16_t cycleLength() const { return _n; }
+
+    // Foot x/y of each leg (x0,y0,..,x3,y3 in mm) at the current phase, then
+    // advance the phase by dtMs.
+    void tick(float dtMs, float feet[8]);
+
+    // Foot x/y at trajectory point idx, without touching the phase
+    void sample(uint16_t idx, float feet[8]);
+
+  private:
+    const q8GaitParams* _p = nullptr;
+    uint8_t _gait = 0xFF;
+    uint8_t _dir = GAIT_STOP;
+    bool _active = false;
+    bool _crawlBackward = false;
+    uint16_t _n = 0;              // Points per cycle
+    float _phase = 0;             // Current point, fractional
+    float _pointsPerMs = 0;
+    float _scale[4];              // Signed stride scale of each leg
+    uint16_t _shift[4];           // Phase shift of each leg in points
+    float _xrange[4], _yrange[4]; // Ranges after the IK reachability fit
+    q8Kinematics _ik;
+
+    uint8_t _resolveDir(const q8GaitParams* p, uint8_t dir) const;
+    bool _fitRange(const q8GaitParams* p, float scale, float& xrange, float& yrange);
+    void _basePoint(const q8GaitParams* p, float scale, float xrange, float yrange,
+                    uint16_t i, float& x, float& y) const;
+    void _crawlPoint(uint8_t leg, uint16_t i, float& x, float& y) const;
+};
+
+#endif
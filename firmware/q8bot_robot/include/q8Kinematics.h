@@ -0,0 +1,32 @@
+/*
+  q8Kinematics.h - Inverse/forward kinematics of the Q8bot 5-bar leg.
+  Port of python-tools/q8bot/kinematics_solver.py (k_solver) for onboard use.
+  Float-only and allocation-free so it can run inside the control loop.
+*/
+#ifndef q8Kinematics_h
+#define q8Kinematics_h
+
+#include <Arduino.h>
+
+// d - distance between motors; l1/l1p - upper linkage length; l2/l2p - lower linkage length
+// Unit is in mm, angles in degrees.
+class q8Kinematics
+{
+  public:
+    q8Kinematics(float d = 19.5f, float l1 = 25.0f, float l2 = 40.0f, float l1p = 25.0f, float l2p = 40.0f);
+
+    // Closed-form IK. On an unreachable target q1/q2 get the previous solution
+    // and false is returned, same as k_solver.ik_solve.
+    bool ikSolve(float x, float y, float& q1, float& q2);
+
+    // Closed-form FK (intersection of the lower links). Returns false and the
+    // previous solution if the links cannot meet.
+    bool fkSolve(float q1, float q2, float& x, float& y);
+
+  private:
+    float _d, _l1, _l2, _l1p, _l2p;
+    float _prevIk[2] = {45.0f, 135.0f};
+    float _prevFk[2];
+};
+
+#endif
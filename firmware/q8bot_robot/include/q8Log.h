@@ -0,0 +1,118 @@
+/*
+  q8Log.h - Binary log for the hot FreeRTOS tasks. A task logs an event ID and
+  its raw arguments into its own ring; the serial output task formats them at
+  low priority. Shared by the robot and controller firmware. Keep both copies
+  of this file identical.
+
+  Single producer, single consumer: each ring is written by one task only and
+  read by the serial output task, so neither side ever waits or locks.
+*/
+#ifndef q8Log_h
+#define q8Log_h
+
+#include <Arduino.h>
+#include <atomic>
+
+const uint8_t LOG_MAX_ARGS = 6;
+
+struct q8LogRecord{
+  uint8_t event;                   // Index into the board's log format table
+  uint32_t args[LOG_MAX_ARGS];     // Raw values, formatted with %u/%X later
+};
+
+template <uint8_t N>
+class q8LogRing
+{
+  static_assert(N > 1 && N <= 128 && (N & (N - 1)) == 0, "power of two, 8 bit indices");
+
+  public:
+    // Producer task. Returns false and counts the record when the ring is full.
+    bool push(uint8_t event, uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0,
+              uint32_t a3 = 0, uint32_t a4 = 0, uint32_t a5 = 0){
+      uint8_t head = _head.load(std::memory_order_relaxed);
+      if ((uint8_t)(head - _tail.load(std::memory_order_acquire)) >= N){
+        _dropped++;
+        return false;
+      }
+      q8LogRecord& r = _records[head & (N - 1)];
+      r.event = event;
+      r.args[0] = a0; r.args[1] = a1; r.args[2] = a2;
+      r.args[3] = a3; r.args[4] = a4; r.args[5] = a5;
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Serial output task
+    bool pop(q8LogRecord& out){
+      uint8_t tail = _tail.load(std::memory_order_relaxed);
+      if (tail == _head.load(std::memory_order_acquire)) return false;
+      out = _records[tail & (N - 1)];
+      _tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    uint32_t dropped() const { return _dropped; }
+
+  private:
+    q8LogRecord _records[N];
+    std::atomic<uint8_t> _head{0};
+    std::atomic<uint8_t> _tail{0};
+    uint32_t _dropped = 0;
+};
+
+// Text of one serial output task wake, collected for a single write of the
+// board's port. Records and messages of the wake are appended in order; only
+// a wake with more than N bytes of text writes more than once.
+template <size_t N>
+class q8LogOutput
+{
+  public:
+    typedef void (*WriteFn)(const uint8_t* data, size_t len);
+
+    explicit q8LogOutput(WriteFn write) : _write(write) {}
+
+    void append(const char* text){
+      size_t len = strlen(text);
+      if (_len + len > N) flush();
+      if (len > N) len = N;
+      memcpy(&_buf[_len], text, len);
+      _len += len;
+    }
+
+    // Format the records of one ring. Formats with a type above shown (e.g.
+    // MSG_DEBUG while debug mode is off) are skipped.
+    template <uint8_t R, typename Format, typename Type>
+    void print(q8LogRing<R>& ring, const Format* formats, Type shown){
+      q8LogRecord r;
+      char text[128];
+      while (ring.pop(r)){
+        const Format& f = formats[r.event];
+        if (f.type > shown) continue;
+        snprintf(text, sizeof(text), f.text, r.args[0], r.args[1], r.args[2], r.args[3], r.args[4], r.args[5]);
+        append(text);
+      }
+    }
+
+    // One line for everything lost since the last call, dropped being the
+    // running total of the board's rings and message queue
+    void reportDropped(uint32_t dropped){
+      if (dropped == _reported) return;
+      char text[48];
+      snprintf(text, sizeof(text), "[LOG] %lu messages dropped\n", (unsigned long)(dropped - _reported));
+      append(text);
+      _reported = dropped;
+    }
+
+    void flush(){
+      if (_len > 0) _write(_buf, _len);
+      _len = 0;
+    }
+
+  private:
+    WriteFn _write;
+    uint8_t _buf[N];
+    size_t _len = 0;
+    uint32_t _reported = 0;
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+  q8Mailbox.h - Lock-free single-producer/single-consumer mailbox.
+  Triple buffer: the writer never waits for the reader and the reader always
+  gets the newest complete value. Older values that were never read are
+  overwritten, which is what a setpoint wants.
+*/
+#ifndef q8Mailbox_h
+#define q8Mailbox_h
+
+#include <Arduino.h>
+#include <atomic>
+
+template <typename T>
+class q8Mailbox
+{
+  public:
+    // Producer side. Copies value into the back buffer and publishes it.
+    void post(const T& value){
+      _buf[_back] = value;
+      uint8_t prev = _middle.exchange(_back | _fresh, std::memory_order_acq_rel);
+      _back = prev & _indexMask;
+    }
+
+    // Consumer side. Returns false and leaves out untouched if nothing new
+    // was posted since the last fetch.
+    bool fetch(T& out){
+      if (!(_middle.load(std::memory_order_acquire) & _fresh)) return false;
+      uint8_t prev = _middle.exchange(_front, std::memory_order_acq_rel);
+      _front = prev & _indexMask;
+      out = _buf[_front];
+      return true;
+    }
+
+  private:
+    static const uint8_t _indexMask = 0x03;
+    static const uint8_t _fresh = 0x04;   // Middle buffer holds an unread value
+
+    T _buf[3];
+    uint8_t _back = 0;                    // Owned by the producer
+    uint8_t _front = 1;                   // Owned by the consumer
+    std::atomic<uint8_t> _middle{2};
+};
+
+#endif
@@ -0,0 +1,44 @@
+/*
+  q8Motion.h - Keyframe sequencer for scripted motions (jump, greet, ...).
+  Each keyframe sets profile and gain, writes a pose and holds it. The control
+  task advances the sequence every cycle instead of blocking in delay(), so a
+  torque-off or any new command can cut a motion short.
+*/
+#ifndef q8Motion_h
+#define q8Motion_h
+
+#include <Arduino.h>
+#include "q8Protocol.h"
+#include "q8Dynamixel.h"
+
+struct q8Keyframe{
+  uint16_t profile;       // Move duration (ms), 0 = as fast as possible
+  uint16_t gain;          // Position P gain
+  int16_t pose[8];        // Joint angles (deg), same order as move_all()
+  uint16_t holdMs;        // Time before the next keyframe
+};
+
+struct q8Primitive{
+  const q8Keyframe* frames;
+  uint8_t count;
+};
+
+class q8Motion
+{
+  public:
+    bool start(uint8_t id);     // MotionId, false if unknown
+    void stop();
+    bool active() const { return _motion != nullptr; }
+
+    // Advance by dtMs. Returns true if a keyframe was written this tick.
+    bool tick(uint32_t dtMs, q8Dynamixel& dxl);
+
+    static uint32_t durationMs(uint8_t id);
+
+  private:
+    const q8Primitive* _motion = nullptr;
+    uint8_t _frame = 0;
+    uint32_t _holdMs = 0;
+};
+
+#endif
@@ -0,0 +1,59 @@
+/*
+  q8Ring.h - Fixed-capacity circular buffer with O(1) push/pop.
+  Storage is part of the object, so nothing is allocated at runtime. When
+  full it either drops the new item or overwrites the oldest one; both count
+  as dropped. Not thread-safe, callers share it under a mutex.
+*/
+#ifndef q8Ring_h
+#define q8Ring_h
+
+#include <Arduino.h>
+
+template <typename T, uint16_t N>
+class q8Ring
+{
+  public:
+    explicit q8Ring(bool overwrite = false) : _overwrite(overwrite) {}
+
+    // Returns false if the item was dropped (full, stop policy)
+    bool push(const T& item){
+      if (_count == N){
+        _dropped++;
+        if (!_overwrite) return false;
+        _head = (_head + 1) % N;    // Oldest item makes room
+        _count--;
+      }
+      _buf[(_head + _count) % N] = item;
+      _count++;
+      return true;
+    }
+
+    bool pop(T& item){
+      if (_count == 0) return false;
+      item = _buf[_head];
+      _head = (_head + 1) % N;
+      _count--;
+      return true;
+    }
+
+    void clear(){
+      _head = 0;
+      _count = 0;
+      _dropped = 0;
+    }
+
+    uint16_t size() const { return _count; }
+    uint16_t capacity() const { return N; }
+    bool empty() const { return _count == 0; }
+    uint32_t dropped() const { return _dropped; }
+    void resetDropped() { _dropped = 0; }
+
+  private:
+    T _buf[N];
+    uint16_t _head = 0;
+    uint16_t _count = 0;
+    uint32_t _dropped = 0;
+    bool _overwrite;
+};
+
+#endif
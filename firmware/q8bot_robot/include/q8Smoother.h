@@ -0,0 +1,104 @@
+/*
+  q8Smoother.h - Setpoint smoother for streamed joint targets (profile 0).
+  Each received frame is timestamped on arrival, smoothed against the rate of
+  the stream, and the control task plays the stream back a frame interval or
+  two late (plus the arrival jitter), interpolating between frames at the
+  control rate. When the next frame is still missing the last motion is
+  extrapolated for a bounded time; a stream that stops for longer than the
+  staleness timeout is held or goes limp.
+
+  Owned by the control task. Times are micros().
+*/
+#ifndef q8Smoother_h
+#define q8Smoother_h
+
+#include <Arduino.h>
+
+enum SmoothMode : uint8_t{
+  SMOOTH_OFF,       // Frames are written as they come, no staleness timeout
+  SMOOTH_LINEAR,
+  SMOOTH_CUBIC,     // Hermite, tangents from the neighbouring frames
+};
+
+enum SmoothStale : uint8_t{
+  STALE_HOLD,       // Servos keep the last target
+  STALE_LIMP,       // Torque off
+};
+
+struct q8SmoothConfig{
+  SmoothMode mode;
+  SmoothStale stale;
+  uint8_t delayFrames;        // Playback delay, in frame intervals
+  uint8_t extrapolateFrames;  // Longest extrapolation, in frame intervals
+  uint16_t staleMs;           // No frame for this long ends the stream
+  uint16_t gapMs;             // Frames further apart do not form a stream
+};
+
+const q8SmoothConfig SMOOTH_DISABLED = {SMOOTH_OFF, STALE_HOLD, 0, 0, 0, 0};
+
+// Returned by target()
+enum SmoothStep : uint8_t{
+  SMOOTH_IDLE,      // No stream
+  SMOOTH_HOLD,      // Same target as last cycle, nothing to write
+  SMOOTH_WRITE,     // New target in out
+  SMOOTH_STALE,     // Stream timed out this cycle, see SmoothStale
+};
+
+struct q8SmoothStats{
+  uint32_t frames;            // Frames pushed
+  uint32_t lost;              // Frames missing from the seq
+  uint32_t extrapolated;      // Cycles past the newest frame
+  uint32_t stale;             // Streams that timed out
+};
+
+const uint8_t SMOOTH_HISTORY = 4;
+
+class q8Smoother
+{
+  public:
+    explicit q8Smoother(const q8SmoothConfig& config);
+
+    void configure(const q8SmoothConfig& config);
+    const q8SmoothConfig& config() const { return _config; }
+
+    // New frame of the stream: sender seq and micros() on arrival. A frame
+    // after a gap or out of order starts the stream over.
+    void push(const int16_t pos[8], uint16_t seq, uint32_t rxUs);
+
+    // Target at nowUs, in the units of the frames
+    SmoothStep target(uint32_t nowUs, float out[8]);
+
+    // Anything else took over the joints
+    void reset(){ _count = 0; }
+    bool active() const { return _count > 0; }
+
+    // Frame interval and arrival jitter of the stream, 0 until two frames arrived
+    uint32_t intervalUs() const { return _intervalUs; }
+    uint32_t jitterUs() const { return _jitterUs; }
+
+    const q8SmoothStats& stats() const { return _stats; }
+    void resetStats();
+
+  private:
+    struct Frame{
+      int16_t pos[8];
+      uint32_t us;              // Smoothed arrival time
+    };
+
+    q8SmoothConfig _config;
+    Frame _frames[SMOOTH_HISTORY];  // Ring, _head is the newest
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    uint16_t _lastSeq = 0;
+    uint32_t _lastRxUs = 0;
+    uint32_t _intervalUs = 0;
+    uint32_t _jitterUs = 0;      // Mean arrival deviation from the stream clock
+    float _out[8];               // Last target returned
+    bool _fresh = false;
+    q8SmoothStats _stats;
+
+    const Frame& _frame(uint8_t age) const;
+    float _tangent(uint8_t age, uint8_t joint) const;
+};
+
+#endif
@@ -0,0 +1,33 @@
+/*
+  q8Telemetry.h - Packs full joint state samples into TelemetryMessage frames.
+  The control task adds one sample per telemetry period and hands each full
+  frame to the ESP-NOW sender, so a frame carries TELEMETRY_PER_FRAME samples.
+*/
+#ifndef q8Telemetry_h
+#define q8Telemetry_h
+
+#include <Arduino.h>
+#include "q8Protocol.h"
+#include "q8Dynamixel.h"
+
+class q8Telemetry
+{
+  public:
+    // Adds one sample. Returns true when the frame is full and must be sent.
+    bool add(const q8JointState& state);
+
+    // Call once the frame has been handed off (or not). Samples of a frame
+    // that could not be queued are reported as dropped in the next frame.
+    void sent(bool ok);
+
+    bool pending() const { return _frame.count > 0; }
+    const TelemetryMessage& frame() const { return _frame; }
+    size_t frameLen() const { return TELEMETRY_HEADER_LEN + _frame.count * sizeof(TelemetrySample); }
+    uint32_t totalDropped() const { return _totalDropped; }
+
+  private:
+    TelemetryMessage _frame;
+    uint32_t _totalDropped = 0;
+};
+
+#endif
@@ -1,17 +1,20 @@
 #include <Arduino.h>
+#include "q8Protocol.h"
+#include "q8Ring.h"
+#include "q8Bulk.h"
+#include "q8PacketPool.h"
+#include "q8Log.h"
+#include "q8Link.h"
+#include "q8Smoother.h"
 
-// ESP-NOW Messaging Types
-enum MsgType : uint8_t{
-  PAIRING,
-  DATA,
-  HEARTBEAT,
-};
+// ESP-NOW Message Structures
 struct PairingMessage{
   uint8_t msgType = PAIRING;
   uint8_t id;
   uint8_t macAddr[6];
   uint8_t channel;
 };
+// Legacy CSV command, superseded by CommandMessage
 struct CharMessage{
   uint8_t msgType = DATA;
   uint8_t id;
@@ -22,17 +25,15 @@ struct DataMessage{
   uint8_t id;
   uint16_t data[100];
 };
-struct HeartbeatMessage{
-  uint8_t msgType = HEARTBEAT;
-  uint8_t id;
-  uint32_t timestamp;
-};
 
-// Dynamixel Variables
-bool recordData = false;
-size_t masterSize;
-size_t smallerSize = 4;
-uint16_t* rData = nullptr;
+// Recorded data (special command 2), sent in DataMessage chunks on command 3
+const uint16_t TELEMETRY_CAPACITY = 1024;   // Samples, 8 bytes each
+const bool TELEMETRY_OVERWRITE = false;     // Full buffer: false drops new samples, true drops oldest
+const size_t RECORD_SAMPLE_LEN = 4;         // First 4 syncRead values: current/position of joints 1-2
+struct RecordSample{
+  uint16_t data[RECORD_SAMPLE_LEN];
+};
+q8Ring<RecordSample, TELEMETRY_CAPACITY> recordBuf(TELEMETRY_OVERWRITE);
 
 // MAX17043 Variables
 float raw;
@@ -40,8 +41,6 @@ char intStr[10];
 
 // ESP-Now Comms
 bool incoming = false;
-PairingMessage pairingData;
-CharMessage theirMsg;
 DataMessage myMsg;
 int chan = 1;
 int paired = false;
@@ -52,18 +51,61 @@ uint8_t serverMac[6];  // This us. The robot is the server.
 unsigned long lastHeartbeatReceived = 0;
 const unsigned long HEARTBEAT_TIMEOUT_ROBOT = 5000;  // Unpair after 20s no heartbeat from controller
 
+// Control loop period, one setpoint write per cycle at most
+const uint32_t CONTROL_PERIOD_MS = 4;
+
+// Joint targets streamed with profile 0 go to the servos as they arrive. To
+// bridge lost frames, play them back two frames late and interpolate at the
+// control rate, extrapolating longer gaps for one more frame and holding after
+// 250 ms without a frame:
+//   {SMOOTH_LINEAR, STALE_HOLD, 2, 1, 250, 100}
+// This adds about 13 ms of lag on the 5 ms gait stream against 5 ms without.
+const q8SmoothConfig SETPOINT_SMOOTHING = SMOOTH_DISABLED;
+
+// Telemetry stream (special command 6). Rate is set by the command and capped
+// at one sample per control cycle; full frames wait here for the sender task.
+const uint8_t TELEMETRY_QUEUE_FRAMES = 4;
+
+// Latency trace records (CMD_FLAG_TRACE) waiting for the telemetry sender
+const uint8_t TRACE_QUEUE_LEN = 16;
+
+// Recorded data dump (special command 3), sent with the q8Bulk transfer
+struct BulkEvent{
+  bool start;       // Dump requested, otherwise ack holds a BULK_ACK
+  BulkAck ack;
+};
+const uint32_t BULK_SEND_TIMEOUT_MS = 20;   // Wait this long for the send callback
+
 // Debug mode
 bool debugMode = false;
 
+// Serial output: serialOutputTask wakes when there is something to print and
+// writes it all at once. With PERMANENT_PAIRING_MODE it also polls the keys.
+const size_t SERIAL_OUTPUT_BATCH = 512;
+#ifdef PERMANENT_PAIRING_MODE
+const TickType_t SERIAL_OUTPUT_WAIT = pdMS_TO_TICKS(100);
+#else
+const TickType_t SERIAL_OUTPUT_WAIT = portMAX_DELAY;
+#endif
+
 // FreeRTOS Handles (to be initialized in setup)
 extern QueueHandle_t rxQueue;
 extern QueueHandle_t debugQueue;
 extern EventGroupHandle_t eventGroup;
+extern SemaphoreHandle_t recordMutex;
+extern SemaphoreHandle_t sendMutex;
+extern QueueHandle_t telemetryQueue;
+extern QueueHandle_t traceQueue;
+extern QueueSetHandle_t telemetrySet;
+extern QueueHandle_t bulkQueue;
+extern TaskHandle_t bulkTaskHandle;
+extern TaskHandle_t serialOutputHandle;
 
 // FreeRTOS Event Bits
 #define EVENT_PAIRED    (1 << 0)
 #define EVENT_UNPAIRED  (1 << 1)
 #define EVENT_STARTED   (1 << 2)
+#define EVENT_PROBE     (1 << 3)   // linkProbe started, wakes heartbeatMonitorTask
 
 // Robot State Machine
 enum RobotState : uint8_t {
@@ -75,12 +117,9 @@ enum RobotState : uint8_t {
 extern volatile RobotState robotState;
 
 // FreeRTOS Message Structures
-struct ESPNowMessage {
-  uint8_t mac[6];
-  uint8_t data[250];
-  int len;
-  uint32_t timestamp;
-};
+const uint8_t RX_POOL_SIZE = 8;   // ESP-NOW packets in flight between onRecv() and espnowRxTask
+extern q8PacketPool<RX_POOL_SIZE> rxPool;
+extern q8LinkProbe linkProbe;  // Probes the saved controller, polled by heartbeatMonitorTask
 
 enum SerialMsgType : uint8_t {
   MSG_INFO,
@@ -90,4 +129,50 @@ enum SerialMsgType : uint8_t {
 struct SerialMessage {
   SerialMsgType type;
   char text[128];
-};
\ No newline at end of file
+};
+
+// Binary log of the hot tasks (q8Log.h), formatted by serialOutputTask.
+// Formats take %u/%X only, every argument is a uint32_t.
+enum LogEvent : uint8_t {
+  LOG_GAIT_REJECTED,
+  LOG_CONTROL_STATS,
+  LOG_RX_STATS,
+  LOG_PAIR_REQUEST,
+  LOG_MAC_SAVED,
+  LOG_PAIRED,
+  LOG_HEARTBEAT_ECHO,
+  LOG_BATTERY,
+  LOG_LINK_UP,
+  LOG_FIRST_COMMAND,
+  LOG_SYNC_START,
+  LOG_STREAM_HOLD,
+  LOG_STREAM_LIMP,
+  LOG_STREAM_STATS,
+  LOG_EVENT_COUNT
+};
+
+struct LogFormat {
+  SerialMsgType type;
+  const char* text;
+};
+
+const LogFormat LOG_FORMATS[LOG_EVENT_COUNT] = {
+  {MSG_INFO,  "[CONTROL] Requested gait/direction or motion not available\n"},
+  {MSG_DEBUG, "[CONTROL] %u cycles, %u writes, %u overruns, jitter %uus, exec %uus\n"},
+  {MSG_DEBUG, "[RX] %u packets, %u pool exhausted, %u queue full, peak %u of %u slots\n"},
+  {MSG_DEBUG, "[PAIRING] Pairing request from: %02X:%02X:%02X:%02X:%02X:%02X\n"},
+  {MSG_DEBUG, "[STORAGE] Saved controller MAC\n"},
+  {MSG_INFO,  "[PAIRING] Paired successfully\n"},
+  {MSG_DEBUG, "[HEARTBEAT] %u received, echoing back (RTT mean %u, p99 %u us, loss %u/1000)\n"},
+  {MSG_DEBUG, "[DATA] Send battery level\n"},
+  {MSG_INFO,  "[LINK] Controller answered after %u ms, %u probes\n"},
+  {MSG_INFO,  "[LINK] First command %u ms after reset\n"},
+  {MSG_DEBUG, "[CONTROL] Group start %u in %u us\n"},
+  {MSG_INFO,  "[CONTROL] Joint stream stopped for %u ms, holding\n"},
+  {MSG_INFO,  "[CONTROL] Joint stream stopped for %u ms, torque off\n"},
+  {MSG_DEBUG, "[CONTROL] Stream %u frames, %u lost, %u cycles extrapolated, interval %u us\n"},
+};
+
+const uint8_t LOG_RING_SIZE = 16;            // Records per task
+extern q8LogRing<LOG_RING_SIZE> controlLog;  // Written by controlTask only
+extern q8LogRing<LOG_RING_SIZE> rxLog;       // Written by espnowRxTask only
\ No newline at end of file
@@ -0,0 +1,41 @@
+/*
+  Arduino.cpp - Host stand-in for the Arduino core. See Arduino.h.
+*/
+#include <Arduino.h>
+#include <stdarg.h>
+#include "dxlSimBus.h"
+
+HardwareSerial Serial(0);
+
+unsigned long millis(){
+  return static_cast<unsigned long>(simBus.now() / 1000);
+}
+
+unsigned long micros(){
+  return static_cast<unsigned long>(simBus.now());
+}
+
+void delay(unsigned long ms){
+  simBus.advance(static_cast<uint64_t>(ms) * 1000);
+}
+
+void delayMicroseconds(unsigned int us){
+  simBus.advance(us);
+}
+
+size_t HardwareSerial::print(const char* str){ return fputs(str, stdout) < 0 ? 0 : strlen(str); }
+size_t HardwareSerial::print(char c){ return putchar(c) == EOF ? 0 : 1; }
+size_t HardwareSerial::print(int val){ return ::printf("%d", val); }
+size_t HardwareSerial::print(unsigned int val){ return ::printf("%u", val); }
+size_t HardwareSerial::print(long val){ return ::printf("%ld", val); }
+size_t HardwareSerial::print(unsigned long val){ return ::printf("%lu", val); }
+size_t HardwareSerial::print(double val){ return ::printf("%.2f", val); }
+size_t HardwareSerial::println(){ return print("\r\n"); }
+
+size_t HardwareSerial::printf(const char* format, ...){
+  va_list args;
+  va_start(args, format);
+  int len = vprintf(format, args);
+  va_end(args);
+  return len < 0 ? 0 : len;
+}
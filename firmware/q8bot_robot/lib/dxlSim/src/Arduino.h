@@ -0,0 +1,53 @@
+/*
+  Arduino.h - Minimal host stand-in for the Arduino core, used by the native
+  build. Time is virtual and owned by the simulated Dynamixel bus.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cstdlib>
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define OUTPUT 0x03
+#define D0 2
+#define PI 3.1415926535897932384626433832795
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class HardwareSerial
+{
+  public:
+    HardwareSerial(int uart_nr = 0) : _uart_nr(uart_nr) {}
+    void begin(unsigned long baud) { (void)baud; }
+    size_t print(const char* str);
+    size_t print(char c);
+    size_t print(int val);
+    size_t print(unsigned int val);
+    size_t print(long val);
+    size_t print(unsigned long val);
+    size_t print(double val);
+    size_t println();
+    template <typename T> size_t println(T val) { return print(val) + println(); }
+    size_t printf(const char* format, ...);
+
+  private:
+    int _uart_nr;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,192 @@
+/*
+  Dynamixel2Arduino.cpp - Host stand-in for the Robotis Dynamixel2Arduino
+  library. See Dynamixel2Arduino.h.
+*/
+#include "Dynamixel2Arduino.h"
+
+using namespace ControlTableItem;
+
+// X-series address and length of each control table item
+struct ItemInfo {
+  uint16_t addr;
+  uint8_t len;
+};
+
+static const ItemInfo ITEMS[LAST_DUMMY_ITEM] = {
+  {dxlSimAddr::MODEL_NUMBER, 2},
+  {dxlSimAddr::FIRMWARE_VERSION, 1},
+  {dxlSimAddr::ID, 1},
+  {dxlSimAddr::BAUD_RATE, 1},
+  {dxlSimAddr::RETURN_DELAY_TIME, 1},
+  {dxlSimAddr::DRIVE_MODE, 1},
+  {dxlSimAddr::OPERATING_MODE, 1},
+  {dxlSimAddr::HOMING_OFFSET, 4},
+  {dxlSimAddr::TORQUE_ENABLE, 1},
+  {dxlSimAddr::LED, 1},
+  {dxlSimAddr::STATUS_RETURN_LEVEL, 1},
+  {dxlSimAddr::POSITION_D_GAIN, 2},
+  {dxlSimAddr::POSITION_I_GAIN, 2},
+  {dxlSimAddr::POSITION_P_GAIN, 2},
+  {dxlSimAddr::PROFILE_ACCELERATION, 4},
+  {dxlSimAddr::PROFILE_VELOCITY, 4},
+  {dxlSimAddr::GOAL_POSITION, 4},
+  {dxlSimAddr::MOVING, 1},
+  {dxlSimAddr::PRESENT_CURRENT, 2},
+  {dxlSimAddr::PRESENT_VELOCITY, 4},
+  {dxlSimAddr::PRESENT_POSITION, 4},
+  {dxlSimAddr::PRESENT_TEMPERATURE, 1},
+};
+
+Dynamixel2Arduino::Dynamixel2Arduino(HardwareSerial& port, int dir_pin)
+: _port(port), _dir_pin(dir_pin) {
+}
+
+void Dynamixel2Arduino::begin(unsigned long baud){
+  _baud = baud;
+  _port.begin(baud);
+  simBus.setMasterBaud(baud);
+}
+
+unsigned long Dynamixel2Arduino::getPortBaud() const {
+  return _baud;
+}
+
+bool Dynamixel2Arduino::setPortProtocolVersion(float version){
+  _protocol = version;
+  return version == 2.0f;   // Only Protocol 2.0 is simulated
+}
+
+bool Dynamixel2Arduino::ping(uint8_t id){
+  dxlSimStats before = simBus.stats();
+  return _track(simBus.ping(id, 10), before);
+}
+
+bool Dynamixel2Arduino::torqueOn(uint8_t id){
+  return writeControlTableItem(TORQUE_ENABLE, id, 1);
+}
+
+bool Dynamixel2Arduino::torqueOff(uint8_t id){
+  return writeControlTableItem(TORQUE_ENABLE, id, 0);
+}
+
+bool Dynamixel2Arduino::setOperatingMode(uint8_t id, uint8_t mode){
+  // X-series register values for each library operating mode
+  static const uint8_t values[] = {3, 4, 5, 1, 16, 0};
+  if (mode >= UNKNOWN_OP) return false;
+  return writeControlTableItem(OPERATING_MODE, id, values[mode]);
+}
+
+bool Dynamixel2Arduino::setBaudrate(uint8_t id, uint32_t baudrate){
+  for (uint8_t i = 0; i < 8; i++){
+    if (dxlSimBaudFromIndex(i) == baudrate){
+      return writeControlTableItem(BAUD_RATE, id, i);
+    }
+  }
+  return false;
+}
+
+int32_t Dynamixel2Arduino::readControlTableItem(uint8_t item_idx, uint8_t id, uint32_t timeout){
+  if (item_idx >= LAST_DUMMY_ITEM) return 0;
+  uint8_t buf[4] = {0};
+  if (read(id, ITEMS[item_idx].addr, ITEMS[item_idx].len, buf, sizeof(buf), timeout) <= 0) return 0;
+
+  // Sign-extend 2-byte items such as Present Current
+  if (ITEMS[item_idx].len == 2) return static_cast<int16_t>(buf[0] | (buf[1] << 8));
+  if (ITEMS[item_idx].len == 1) return buf[0];
+  return static_cast<int32_t>(buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24));
+}
+
+bool Dynamixel2Arduino::writeControlTableItem(uint8_t item_idx, uint8_t id, int32_t data, uint32_t timeout){
+  if (item_idx >= LAST_DUMMY_ITEM) return false;
+  uint8_t buf[4];
+  for (uint8_t i = 0; i < 4; i++){
+    buf[i] = static_cast<uint8_t>(static_cast<uint32_t>(data) >> (8 * i));
+  }
+  return write(id, ITEMS[item_idx].addr, buf, ITEMS[item_idx].len, timeout);
+}
+
+int32_t Dynamixel2Arduino::read(uint8_t id, uint16_t addr, uint16_t addr_length, uint8_t *p_recv_buf,
+                                uint16_t recv_buf_capacity, uint32_t timeout_ms, uint8_t *p_err){
+  if (addr_length > recv_buf_capacity) return -1;
+  dxlSimStats before = simBus.stats();
+  bool ok = simBus.read(id, addr, addr_length, p_recv_buf, timeout_ms, p_err);
+  return _track(ok, before) ? addr_length : -1;
+}
+
+bool Dynamixel2Arduino::write(uint8_t id, uint16_t addr, const uint8_t *p_data, uint16_t data_length,
+                              uint32_t timeout_ms, uint8_t *p_err){
+  dxlSimStats before = simBus.stats();
+  return _track(simBus.write(id, addr, data_length, p_data, timeout_ms, p_err), before);
+}
+
+bool Dynamixel2Arduino::_track(bool ok, const dxlSimStats& before){
+  // Tell a timeout from a garbled status the way the library reports them. A
+  // status packet with an error number set is not a library error.
+  const dxlSimStats& now = simBus.stats();
+  if (now.collisions != before.collisions){
+    _last_lib_err = DXL_LIB_ERROR_CHECK_SUM;
+  } else if (now.timeouts != before.timeouts){
+    _last_lib_err = DXL_LIB_ERROR_TIMEOUT;
+  } else {
+    _last_lib_err = DXL_LIB_OK;
+  }
+  return ok;
+}
+
+bool Dynamixel2Arduino::syncWrite(DYNAMIXEL::InfoSyncWriteInst_t* p_info){
+  if (p_info == nullptr || p_info->xel_count == 0) return false;
+  uint8_t ids[DXL_SIM_MAX_SERVOS];
+  uint8_t* data[DXL_SIM_MAX_SERVOS];
+  uint8_t count = p_info->xel_count < DXL_SIM_MAX_SERVOS ? p_info->xel_count : DXL_SIM_MAX_SERVOS;
+  for (uint8_t i = 0; i < count; i++){
+    ids[i] = p_info->p_xels[i].id;
+    data[i] = p_info->p_xels[i].p_data;
+  }
+  simBus.syncWrite(p_info->addr, p_info->addr_length, count, ids, data);
+  p_info->is_info_changed = false;
+  return true;
+}
+
+bool Dynamixel2Arduino::bulkWrite(DYNAMIXEL::InfoBulkWriteInst_t* p_info){
+  if (p_info == nullptr || p_info->xel_count == 0) return false;
+  uint8_t ids[DXL_SIM_MAX_SERVOS];
+  uint16_t addrs[DXL_SIM_MAX_SERVOS];
+  uint16_t lens[DXL_SIM_MAX_SERVOS];
+  uint8_t* data[DXL_SIM_MAX_SERVOS];
+  uint8_t count = p_info->xel_count < DXL_SIM_MAX_SERVOS ? p_info->xel_count : DXL_SIM_MAX_SERVOS;
+  for (uint8_t i = 0; i < count; i++){
+    ids[i] = p_info->p_xels[i].id;
+    addrs[i] = p_info->p_xels[i].addr;
+    lens[i] = p_info->p_xels[i].addr_length;
+    data[i] = p_info->p_xels[i].p_data;
+  }
+  simBus.bulkWrite(count, ids, addrs, lens, data);
+  p_info->is_info_changed = false;
+  return true;
+}
+
+uint8_t Dynamixel2Arduino::syncRead(DYNAMIXEL::InfoSyncReadInst_t* p_info, uint32_t timeout_ms){
+  return _syncRead(p_info, false, timeout_ms);
+}
+
+uint8_t Dynamixel2Arduino::fastSyncRead(DYNAMIXEL::InfoSyncReadInst_t* p_info, uint32_t timeout_ms){
+  return _syncRead(p_info, true, timeout_ms);
+}
+
+uint8_t Dynamixel2Arduino::_syncRead(DYNAMIXEL::InfoSyncReadInst_t* p_info, bool fast, uint32_t timeout_ms){
+  if (p_info == nullptr || p_info->xel_count == 0) return 0;
+  uint8_t ids[DXL_SIM_MAX_SERVOS];
+  uint8_t* data[DXL_SIM_MAX_SERVOS];
+  uint8_t errs[DXL_SIM_MAX_SERVOS];
+  uint8_t count = p_info->xel_count < DXL_SIM_MAX_SERVOS ? p_info->xel_count : DXL_SIM_MAX_SERVOS;
+  for (uint8_t i = 0; i < count; i++){
+    ids[i] = p_info->p_xels[i].id;
+    data[i] = p_info->p_xels[i].p_recv_buf;
+  }
+  uint8_t received = simBus.syncRead(p_info->addr, p_info->addr_length, count, ids, data, errs, fast, timeout_ms);
+  for (uint8_t i = 0; i < count; i++){
+    p_info->p_xels[i].error = errs[i];
+  }
+  p_info->is_info_changed = false;
+  return received;
+}
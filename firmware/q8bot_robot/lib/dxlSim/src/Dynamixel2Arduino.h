@@ -0,0 +1,167 @@
+/*
+  Dynamixel2Arduino.h - Host stand-in for the Robotis Dynamixel2Arduino
+  library. Implements the subset of the API used by q8Dynamixel on top of
+  the simulated bus in dxlSimBus.h. Type and item names follow the library.
+*/
+#ifndef DYNAMIXEL2ARDUINO_H_
+#define DYNAMIXEL2ARDUINO_H_
+
+#include <Arduino.h>
+#include "dxlSimBus.h"
+
+#define DXL_BROADCAST_ID 0xFE
+
+namespace DYNAMIXEL {
+  typedef struct InfoSyncBulkBuffer{
+    uint8_t* p_buf;
+    uint16_t buf_capacity;
+    uint16_t gen_length;
+    bool is_completed;
+  } __attribute__((packed)) InfoSyncBulkBuffer_t;
+
+  typedef struct XELInfoSyncRead{
+    uint8_t *p_recv_buf;
+    uint8_t id;
+    uint8_t error;
+  } __attribute__((packed)) XELInfoSyncRead_t;
+
+  typedef struct InfoSyncReadInst{
+    uint16_t addr;
+    uint16_t addr_length;
+    XELInfoSyncRead_t* p_xels;
+    uint8_t xel_count;
+    bool is_info_changed;
+    InfoSyncBulkBuffer_t packet;
+  } __attribute__((packed)) InfoSyncReadInst_t;
+
+  typedef struct XELInfoSyncWrite{
+    uint8_t* p_data;
+    uint8_t id;
+  } __attribute__((packed)) XELInfoSyncWrite_t;
+
+  typedef struct InfoSyncWriteInst{
+    uint16_t addr;
+    uint16_t addr_length;
+    XELInfoSyncWrite_t* p_xels;
+    uint8_t xel_count;
+    bool is_info_changed;
+    InfoSyncBulkBuffer_t packet;
+  } __attribute__((packed)) InfoSyncWriteInst_t;
+
+  typedef struct XELInfoBulkRead{
+    uint16_t addr;
+    uint16_t addr_length;
+    uint8_t *p_recv_buf;
+    uint8_t id;
+    uint8_t error;
+  } __attribute__((packed)) XELInfoBulkRead_t;
+
+  typedef struct InfoBulkReadInst{
+    XELInfoBulkRead_t* p_xels;
+    uint8_t xel_count;
+    bool is_info_changed;
+    InfoSyncBulkBuffer_t packet;
+  } __attribute__((packed)) InfoBulkReadInst_t;
+
+  typedef struct XELInfoBulkWrite{
+    uint16_t addr;
+    uint16_t addr_length;
+    uint8_t* p_data;
+    uint8_t id;
+  } __attribute__((packed)) XELInfoBulkWrite_t;
+
+  typedef struct InfoBulkWriteInst{
+    XELInfoBulkWrite_t* p_xels;
+    uint8_t xel_count;
+    bool is_info_changed;
+    InfoSyncBulkBuffer_t packet;
+  } __attribute__((packed)) InfoBulkWriteInst_t;
+}
+
+namespace ControlTableItem {
+  enum ControlTableItemIndex {
+    MODEL_NUMBER = 0,
+    FIRMWARE_VERSION,
+    ID,
+    BAUD_RATE,
+    RETURN_DELAY_TIME,
+    DRIVE_MODE,
+    OPERATING_MODE,
+    HOMING_OFFSET,
+    TORQUE_ENABLE,
+    LED,
+    STATUS_RETURN_LEVEL,
+    POSITION_D_GAIN,
+    POSITION_I_GAIN,
+    POSITION_P_GAIN,
+    PROFILE_ACCELERATION,
+    PROFILE_VELOCITY,
+    GOAL_POSITION,
+    MOVING,
+    PRESENT_CURRENT,
+    PRESENT_VELOCITY,
+    PRESENT_POSITION,
+    PRESENT_TEMPERATURE,
+    LAST_DUMMY_ITEM
+  };
+}
+
+// Subset of the library error codes, see getLastLibErrCode()
+typedef enum DXLLibErrorCode{
+  DXL_LIB_OK = 0,
+  DXL_LIB_ERROR_TIMEOUT,
+  DXL_LIB_ERROR_CHECK_SUM,    // Garbled status, e.g. several servos answered
+} DXLLibErrorCode_t;
+
+enum OperatingMode{
+  OP_POSITION = 0,
+  OP_EXTENDED_POSITION,
+  OP_CURRENT_BASED_POSITION,
+  OP_VELOCITY,
+  OP_PWM,
+  OP_CURRENT,
+  UNKNOWN_OP
+};
+
+class Dynamixel2Arduino
+{
+  public:
+    Dynamixel2Arduino(HardwareSerial& port, int dir_pin = -1);
+
+    void begin(unsigned long baud = 57600);
+    unsigned long getPortBaud() const;
+    bool setPortProtocolVersion(float version);
+
+    bool ping(uint8_t id = DXL_BROADCAST_ID);
+    bool torqueOn(uint8_t id);
+    bool torqueOff(uint8_t id);
+    bool setOperatingMode(uint8_t id, uint8_t mode);
+    bool setBaudrate(uint8_t id, uint32_t baudrate);
+
+    int32_t readControlTableItem(uint8_t item_idx, uint8_t id, uint32_t timeout = 100);
+    bool writeControlTableItem(uint8_t item_idx, uint8_t id, int32_t data, uint32_t timeout = 100);
+
+    // DYNAMIXEL::Master API
+    int32_t read(uint8_t id, uint16_t addr, uint16_t addr_length, uint8_t *p_recv_buf,
+                 uint16_t recv_buf_capacity, uint32_t timeout_ms = 10, uint8_t *p_err = nullptr);
+    bool write(uint8_t id, uint16_t addr, const uint8_t *p_data, uint16_t data_length,
+               uint32_t timeout_ms = 10, uint8_t *p_err = nullptr);
+    bool syncWrite(DYNAMIXEL::InfoSyncWriteInst_t* p_info);
+    bool bulkWrite(DYNAMIXEL::InfoBulkWriteInst_t* p_info);
+    uint8_t syncRead(DYNAMIXEL::InfoSyncReadInst_t* p_info, uint32_t timeout_ms = 10);
+    uint8_t fastSyncRead(DYNAMIXEL::InfoSyncReadInst_t* p_info, uint32_t timeout_ms = 10);
+    DXLLibErrorCode_t getLastLibErrCode() const { return _last_lib_err; }
+
+  private:
+    HardwareSerial& _port;
+    int _dir_pin;
+    unsigned long _baud = 57600;
+    float _protocol = 2.0;
+    DXLLibErrorCode_t _last_lib_err = DXL_LIB_OK;
+
+    bool _track(bool ok, const dxlSimStats& before);
+
+    uint8_t _syncRead(DYNAMIXEL::InfoSyncReadInst_t* p_info, bool fast, uint32_t timeout_ms);
+};
+
+#endif
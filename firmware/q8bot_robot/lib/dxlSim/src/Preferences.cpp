@@ -0,0 +1,76 @@
+/*
+  Preferences.cpp - In-memory NVS stand-in. See Preferences.h.
+*/
+#include "Preferences.h"
+#include <map>
+#include <vector>
+
+static std::map<std::string, std::vector<uint8_t>> flash;
+static PreferencesSimStats stats = {};
+
+bool Preferences::begin(const char* name, bool readOnly){
+  _ns = name;
+  _open = true;
+  _readOnly = readOnly;
+  stats.opens++;
+  return true;
+}
+
+void Preferences::end(){
+  _open = false;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len){
+  if (!_open || _readOnly) return 0;
+  const uint8_t* p = static_cast<const uint8_t*>(value);
+  flash[_key(key)] = std::vector<uint8_t>(p, p + len);
+  stats.writes++;
+  return len;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen){
+  if (!_open) return 0;
+  auto it = flash.find(_key(key));
+  if (it == flash.end() || it->second.size() > maxLen) return 0;
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* key){
+  if (!_open) return 0;
+  auto it = flash.find(_key(key));
+  return it == flash.end() ? 0 : it->second.size();
+}
+
+bool Preferences::remove(const char* key){
+  if (!_open || _readOnly) return false;
+  if (flash.erase(_key(key)) == 0) return false;
+  stats.erases++;
+  return true;
+}
+
+bool Preferences::clear(){
+  if (!_open || _readOnly) return false;
+  std::string prefix = _ns + "/";
+  for (auto it = flash.begin(); it != flash.end();){
+    if (it->first.compare(0, prefix.size(), prefix) == 0){
+      it = flash.erase(it);
+      stats.erases++;
+    } else {
+      ++it;
+    }
+  }
+  return true;
+}
+
+const PreferencesSimStats& prefsSimStats(){
+  return stats;
+}
+
+void prefsSimResetStats(){
+  stats = PreferencesSimStats();
+}
+
+void prefsSimErase(){
+  flash.clear();
+}
@@ -0,0 +1,43 @@
+/*
+  Preferences.h - In-memory host stand-in for the ESP32 Preferences (NVS)
+  library. Contents survive end()/begin() and new instances like flash does,
+  and every write and erase is counted, so the native build can check how
+  often settings would hit flash.
+*/
+#ifndef Preferences_h
+#define Preferences_h
+
+#include <Arduino.h>
+#include <string>
+
+struct PreferencesSimStats{
+  uint32_t opens;       // begin() calls
+  uint32_t writes;      // put calls that reached flash
+  uint32_t erases;      // remove()/clear() of existing keys
+};
+
+class Preferences
+{
+  public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+    size_t putBytes(const char* key, const void* value, size_t len);
+    size_t getBytes(const char* key, void* buf, size_t maxLen);
+    size_t getBytesLength(const char* key);
+    bool remove(const char* key);
+    bool clear();
+
+  private:
+    std::string _ns;
+    bool _open = false;
+    bool _readOnly = false;
+
+    std::string _key(const char* key) const { return _ns + "/" + key; }
+};
+
+// Simulated flash shared by every Preferences instance
+const PreferencesSimStats& prefsSimStats();
+void prefsSimResetStats();
+void prefsSimErase();   // Blank flash, as after a full chip erase
+
+#endif
@@ -0,0 +1,321 @@
+/*
+  dxlSimBus.cpp - Simulated half-duplex Dynamixel TTL bus. See dxlSimBus.h.
+*/
+#include "dxlSimBus.h"
+
+using namespace dxlSimAddr;
+
+dxlSimBus simBus;
+
+// Protocol 2.0 packet sizes: header(4) + ID(1) + length(2) + instruction(1)
+// + CRC(2) for instructions, plus error(1) for status packets.
+static const uint32_t INST_OVERHEAD = 10;
+static const uint32_t STATUS_OVERHEAD = 11;
+static const float MAX_SPEED = 103.0f / 60.0f * 4096.0f / 1e6f;   // No-load speed, ticks/us
+static const float RPM_PER_UNIT = 0.229f;
+
+uint32_t dxlSimBaudFromIndex(uint8_t index){
+  static const uint32_t table[] = {9600, 57600, 115200, 1000000, 2000000, 3000000, 4000000, 4500000};
+  return index < 8 ? table[index] : 0;
+}
+
+uint32_t dxlSimServo::get(uint16_t addr, uint16_t len) const {
+  uint32_t value = 0;
+  for (uint16_t i = 0; i < len; i++){
+    value |= static_cast<uint32_t>(table[addr + i]) << (8 * i);
+  }
+  return value;
+}
+
+void dxlSimServo::set(uint16_t addr, uint16_t len, uint32_t value){
+  for (uint16_t i = 0; i < len; i++){
+    table[addr + i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+dxlSimBus::dxlSimBus(){
+  resetStats();
+}
+
+dxlSimServo* dxlSimBus::addServo(uint8_t id, uint8_t baudIndex){
+  if (_servoCount >= DXL_SIM_MAX_SERVOS) return nullptr;
+  dxlSimServo* s = &_servos[_servoCount++];
+  memset(s, 0, sizeof(*s));
+  s->set(MODEL_NUMBER, 2, 1200);         // XL330-M288
+  s->set(FIRMWARE_VERSION, 1, 46);
+  s->set(ID, 1, id);
+  s->set(BAUD_RATE, 1, baudIndex);
+  s->set(RETURN_DELAY_TIME, 1, 250);     // 500 us factory default
+  s->set(OPERATING_MODE, 1, 3);          // Position control
+  s->set(STATUS_RETURN_LEVEL, 1, 2);
+  s->set(POSITION_P_GAIN, 2, 400);
+  s->set(PRESENT_TEMPERATURE, 1, 30);
+  s->position = 2048;
+  s->moveFrom = s->position;
+  s->set(GOAL_POSITION, 4, 2048);
+  s->set(PRESENT_POSITION, 4, 2048);
+  return s;
+}
+
+void dxlSimBus::clear(){
+  _servoCount = 0;
+  _masterBaud = 57600;
+  _nowUs = 0;
+  resetStats();
+}
+
+void dxlSimBus::resetStats(){
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+void dxlSimBus::advance(uint64_t us){
+  _nowUs += us;
+  for (uint8_t i = 0; i < _servoCount; i++){
+    _step(&_servos[i], us);
+  }
+}
+
+bool dxlSimBus::ping(uint8_t id, uint32_t timeoutMs){
+  dxlSimServo* hits[DXL_SIM_MAX_SERVOS];
+  uint8_t n = _listeners(id, hits);
+  _stats.transactions++;
+  _wire(INST_OVERHEAD);
+
+  if (n == 0){
+    _timeout(timeoutMs);
+    return false;
+  }
+  if (id == DXL_SIM_BROADCAST_ID){
+    // Every servo answers in turn
+    for (uint8_t i = 0; i < n; i++){
+      _returnDelay(hits[i]);
+      _status(STATUS_OVERHEAD + 3);
+    }
+    return true;
+  }
+  _returnDelay(hits[0]);
+  _status(STATUS_OVERHEAD + 3);
+  if (n > 1){
+    _stats.collisions++;
+    return false;
+  }
+  return true;
+}
+
+bool dxlSimBus::read(uint8_t id, uint16_t addr, uint16_t len, uint8_t* data, uint32_t timeoutMs, uint8_t* err){
+  dxlSimServo* hits[DXL_SIM_MAX_SERVOS];
+  uint8_t n = _listeners(id, hits);
+  _stats.transactions++;
+  _wire(INST_OVERHEAD + 4);
+  if (err != nullptr) *err = DXL_SIM_ERR_NONE;
+
+  if (n == 0 || id == DXL_SIM_BROADCAST_ID || !_replies(hits[0], true) || addr + len > DXL_SIM_TABLE_SIZE){
+    _timeout(timeoutMs);
+    return false;
+  }
+  _returnDelay(hits[0]);
+  _status(STATUS_OVERHEAD + len);
+  if (n > 1){
+    _stats.collisions++;
+    return false;
+  }
+  memcpy(data, &hits[0]->table[addr], len);
+  return true;
+}
+
+bool dxlSimBus::write(uint8_t id, uint16_t addr, uint16_t len, const uint8_t* data, uint32_t timeoutMs, uint8_t* err){
+  dxlSimServo* hits[DXL_SIM_MAX_SERVOS];
+  uint8_t n = _listeners(id, hits);
+  _stats.transactions++;
+  _wire(INST_OVERHEAD + 2 + len);
+
+  uint8_t error = DXL_SIM_ERR_NONE;
+  for (uint8_t i = 0; i < n; i++){
+    error = _apply(hits[i], addr, len, data);
+  }
+  if (err != nullptr) *err = error;
+  if (id == DXL_SIM_BROADCAST_ID) return true;   // No status for broadcast
+
+  if (n == 0 || !_replies(hits[0], false)){
+    _timeout(timeoutMs);
+    return false;
+  }
+  _returnDelay(hits[0]);
+  _status(STATUS_OVERHEAD);
+  if (n > 1){
+    _stats.collisions++;
+    return false;
+  }
+  return error == DXL_SIM_ERR_NONE;
+}
+
+void dxlSimBus::syncWrite(uint16_t addr, uint16_t len, uint8_t count, const uint8_t* ids, uint8_t* const* data){
+  _stats.transactions++;
+  _wire(INST_OVERHEAD + 4 + count * (1 + len));
+  for (uint8_t i = 0; i < count; i++){
+    dxlSimServo* hits[DXL_SIM_MAX_SERVOS];
+    uint8_t n = _listeners(ids[i], hits);
+    for (uint8_t j = 0; j < n; j++){
+      _apply(hits[j], addr, len, data[i]);
+    }
+  }
+}
+
+void dxlSimBus::bulkWrite(uint8_t count, const uint8_t* ids, const uint16_t* addrs, const uint16_t* lens, uint8_t* const* data){
+  uint32_t bytes = INST_OVERHEAD;
+  for (uint8_t i = 0; i < count; i++){
+    bytes += 5 + lens[i];
+  }
+  _stats.transactions++;
+  _wire(bytes);
+  for (uint8_t i = 0; i < count; i++){
+    dxlSimServo* hits[DXL_SIM_MAX_SERVOS];
+    uint8_t n = _listeners(ids[i], hits);
+    for (uint8_t j = 0; j < n; j++){
+      _apply(hits[j], addrs[i], lens[i], data[i]);
+    }
+  }
+}
+
+uint8_t dxlSimBus::syncRead(uint16_t addr, uint16_t len, uint8_t count, const uint8_t* ids, uint8_t* const* data,
+                            uint8_t* errs, bool fast, uint32_t timeoutMs){
+  _stats.transactions++;
+  _wire(INST_OVERHEAD + 4 + count);
+
+  uint8_t received = 0;
+  bool missing = false;
+  for (uint8_t i = 0; i < count; i++){
+    dxlSimServo* hits[DXL_SIM_MAX_SERVOS];
+    uint8_t n = _listeners(ids[i], hits);
+    if (n != 1 || !_replies(hits[0], true)){
+      if (n > 1) _stats.collisions++;
+      errs[i] = 0xFF;
+      missing = true;
+      continue;
+    }
+    if (fast){
+      // One combined status packet: only the first servo waits its return delay
+      if (received == 0){
+        _returnDelay(hits[0]);
+        _status(8);
+      }
+      _status(4 + len, false);
+    } else {
+      _returnDelay(hits[0]);
+      _status(STATUS_OVERHEAD + len);
+    }
+    memcpy(data[i], &hits[0]->table[addr], len);
+    errs[i] = DXL_SIM_ERR_NONE;
+    received++;
+  }
+  if (missing) _timeout(timeoutMs);
+  return received;
+}
+
+uint8_t dxlSimBus::_listeners(uint8_t id, dxlSimServo** out){
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < _servoCount; i++){
+    dxlSimServo* s = &_servos[i];
+    if (s->baud() != _masterBaud) continue;
+    if (id == DXL_SIM_BROADCAST_ID || s->id() == id){
+      out[n++] = s;
+    }
+  }
+  return n;
+}
+
+void dxlSimBus::_wire(uint32_t bytes){
+  // 8N1 framing: 10 bits per byte
+  uint64_t us = (static_cast<uint64_t>(bytes) * 10 * 1000000 + _masterBaud - 1) / _masterBaud;
+  _stats.txBytes += bytes;
+  _stats.busTimeUs += us;
+  advance(us);
+}
+
+void dxlSimBus::_status(uint32_t bytes, bool newPacket){
+  uint64_t us = (static_cast<uint64_t>(bytes) * 10 * 1000000 + _masterBaud - 1) / _masterBaud;
+  _stats.rxBytes += bytes;
+  if (newPacket) _stats.statusPackets++;
+  _stats.busTimeUs += us;
+  advance(us);
+}
+
+void dxlSimBus::_returnDelay(const dxlSimServo* s){
+  uint64_t us = static_cast<uint64_t>(s->table[RETURN_DELAY_TIME]) * 2;
+  _stats.busTimeUs += us;
+  advance(us);
+}
+
+void dxlSimBus::_timeout(uint32_t timeoutMs){
+  _stats.timeouts++;
+  _stats.busTimeUs += static_cast<uint64_t>(timeoutMs) * 1000;
+  advance(static_cast<uint64_t>(timeoutMs) * 1000);
+}
+
+bool dxlSimBus::_replies(const dxlSimServo* s, bool isRead) const {
+  // Status return level: 0 = ping only, 1 = ping and read, 2 = all
+  uint8_t level = s->table[STATUS_RETURN_LEVEL];
+  return level >= 2 || (level == 1 && isRead);
+}
+
+uint8_t dxlSimBus::_apply(dxlSimServo* s, uint16_t addr, uint16_t len, const uint8_t* data){
+  if (addr + len > DXL_SIM_TABLE_SIZE) return DXL_SIM_ERR_DATA_RANGE;
+  // Present values and model information are read-only
+  if (addr + len > MOVING || addr < ID) return DXL_SIM_ERR_ACCESS;
+  if (addr < DXL_SIM_EEPROM_END){
+    if (s->torque()) return DXL_SIM_ERR_ACCESS;
+    s->eepromWrites++;
+  }
+
+  int32_t oldOffset = static_cast<int32_t>(s->get(HOMING_OFFSET, 4));
+  memcpy(&s->table[addr], data, len);
+
+  if (addr <= HOMING_OFFSET && addr + len > HOMING_OFFSET){
+    s->position += static_cast<int32_t>(s->get(HOMING_OFFSET, 4)) - oldOffset;
+    s->moveFrom = s->position;
+  }
+  if (addr <= GOAL_POSITION && addr + len > GOAL_POSITION){
+    // Start a new move from wherever the horn is now
+    s->moveFrom = s->position;
+    s->moveStartUs = _nowUs;
+    uint32_t profile = s->get(PROFILE_VELOCITY, 4);
+    bool timeBased = (s->table[DRIVE_MODE] & 0x04) != 0;
+    s->moveDurUs = (timeBased && profile > 0) ? static_cast<uint64_t>(profile) * 1000 : 0;
+  }
+  if (addr <= TORQUE_ENABLE && addr + len > TORQUE_ENABLE && s->torque()){
+    // Torque on holds the current position
+    s->set(GOAL_POSITION, 4, static_cast<uint32_t>(lroundf(s->position)));
+    s->moveFrom = s->position;
+    s->moveDurUs = 0;
+  }
+  return DXL_SIM_ERR_NONE;
+}
+
+void dxlSimBus::_step(dxlSimServo* s, uint64_t dtUs){
+  float prev = s->position;
+  if (s->torque() && dtUs > 0){
+    float goal = static_cast<float>(static_cast<int32_t>(s->get(GOAL_POSITION, 4)));
+    if (s->moveDurUs > 0){
+      // Time-based profile: reach the goal after Profile Velocity ms
+      uint64_t elapsed = _nowUs - s->moveStartUs;
+      float t = elapsed >= s->moveDurUs ? 1.0f : static_cast<float>(elapsed) / s->moveDurUs;
+      s->position = s->moveFrom + (goal - s->moveFrom) * t;
+    } else {
+      // Velocity-limited move at the profile velocity (or no-load speed)
+      uint32_t profile = s->get(PROFILE_VELOCITY, 4);
+      float speed = profile > 0 ? profile * RPM_PER_UNIT / 60.0f * 4096.0f / 1e6f : MAX_SPEED;
+      if (speed > MAX_SPEED) speed = MAX_SPEED;
+      float step = speed * dtUs;
+      float err = goal - s->position;
+      s->position += fabsf(err) <= step ? err : (err > 0 ? step : -step);
+    }
+  }
+  s->velocity = dtUs > 0 ? (s->position - prev) / dtUs : 0;
+
+  float goal = static_cast<float>(static_cast<int32_t>(s->get(GOAL_POSITION, 4)));
+  float current = s->torque() ? (goal - s->position) * s->get(POSITION_P_GAIN, 2) / 128.0f : 0;
+  s->set(PRESENT_POSITION, 4, static_cast<uint32_t>(lroundf(s->position)));
+  s->set(PRESENT_VELOCITY, 4, static_cast<uint32_t>(lroundf(s->velocity * 1e6f * 60.0f / 4096.0f / RPM_PER_UNIT)));
+  s->set(PRESENT_CURRENT, 2, static_cast<uint16_t>(static_cast<int16_t>(constrain(current, -1750.0f, 1750.0f))));
+  s->table[MOVING] = fabsf(goal - s->position) > 0.5f ? 1 : 0;
+}
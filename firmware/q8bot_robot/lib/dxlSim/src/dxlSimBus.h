@@ -0,0 +1,130 @@
+/*
+  dxlSimBus.h - Simulated half-duplex Dynamixel TTL bus with X-series servos.
+  Models the control table, packet sizes of Protocol 2.0 instructions, status
+  return level / return delay time and a virtual clock, so bus time per
+  control cycle can be measured on the host.
+*/
+#ifndef dxlSimBus_h
+#define dxlSimBus_h
+
+#include <Arduino.h>
+
+// X-series (XL330/XC330) control table addresses modelled by the simulator
+namespace dxlSimAddr {
+  enum : uint16_t {
+    MODEL_NUMBER = 0,         // 2 bytes
+    FIRMWARE_VERSION = 6,     // 1
+    ID = 7,                   // 1
+    BAUD_RATE = 8,            // 1
+    RETURN_DELAY_TIME = 9,    // 1, unit 2 us
+    DRIVE_MODE = 10,          // 1
+    OPERATING_MODE = 11,      // 1
+    HOMING_OFFSET = 20,       // 4
+    TORQUE_ENABLE = 64,       // 1
+    LED = 65,                 // 1
+    STATUS_RETURN_LEVEL = 68, // 1
+    POSITION_D_GAIN = 80,     // 2
+    POSITION_I_GAIN = 82,     // 2
+    POSITION_P_GAIN = 84,     // 2
+    PROFILE_ACCELERATION = 108, // 4
+    PROFILE_VELOCITY = 112,   // 4
+    GOAL_POSITION = 116,      // 4
+    MOVING = 122,             // 1
+    PRESENT_CURRENT = 126,    // 2
+    PRESENT_VELOCITY = 128,   // 4
+    PRESENT_POSITION = 132,   // 4
+    PRESENT_TEMPERATURE = 146 // 1
+  };
+}
+
+// Protocol 2.0 error numbers reported in status packets
+enum dxlSimError : uint8_t {
+  DXL_SIM_ERR_NONE = 0,
+  DXL_SIM_ERR_DATA_RANGE = 4,
+  DXL_SIM_ERR_ACCESS = 7,
+};
+
+const uint16_t DXL_SIM_TABLE_SIZE = 147;
+const uint16_t DXL_SIM_EEPROM_END = 64;   // EEPROM area is locked while torque is on
+const uint8_t DXL_SIM_MAX_SERVOS = 16;
+const uint8_t DXL_SIM_BROADCAST_ID = 254;
+
+// Baud rate register value to bits per second (0 = 9600 ... 7 = 4.5M)
+uint32_t dxlSimBaudFromIndex(uint8_t index);
+
+struct dxlSimServo {
+  uint8_t table[DXL_SIM_TABLE_SIZE];
+  float position;           // Present position in ticks (includes homing offset)
+  float velocity;           // ticks per us
+  float moveFrom;
+  uint64_t moveStartUs;
+  uint64_t moveDurUs;       // 0 means velocity-limited move
+  uint32_t eepromWrites;    // Writes that reached the EEPROM area
+
+  uint32_t get(uint16_t addr, uint16_t len) const;
+  void set(uint16_t addr, uint16_t len, uint32_t value);
+  uint8_t id() const { return table[dxlSimAddr::ID]; }
+  uint32_t baud() const { return dxlSimBaudFromIndex(table[dxlSimAddr::BAUD_RATE]); }
+  bool torque() const { return table[dxlSimAddr::TORQUE_ENABLE] != 0; }
+};
+
+// Bus occupancy counters, cleared with dxlSimBus::resetStats()
+struct dxlSimStats {
+  uint32_t transactions;
+  uint32_t txBytes;         // Instruction packets, master to servos
+  uint32_t rxBytes;         // Status packets, servos to master
+  uint32_t statusPackets;
+  uint32_t timeouts;        // Expected status packets that never arrived
+  uint32_t collisions;      // Several servos answered the same ID
+  uint64_t busTimeUs;       // Wire time incl. return delays and timeouts
+};
+
+class dxlSimBus
+{
+  public:
+    dxlSimBus();
+
+    // Servos are added in factory state (ID 1, 57600 bps) unless told otherwise
+    dxlSimServo* addServo(uint8_t id = 1, uint8_t baudIndex = 1);
+    void clear();
+    uint8_t servoCount() const { return _servoCount; }
+    dxlSimServo* servo(uint8_t index) { return &_servos[index]; }
+
+    // Virtual clock in microseconds. Advancing it also moves the servos.
+    uint64_t now() const { return _nowUs; }
+    void advance(uint64_t us);
+
+    void setMasterBaud(uint32_t baud) { _masterBaud = baud; }
+    uint32_t masterBaud() const { return _masterBaud; }
+    const dxlSimStats& stats() const { return _stats; }
+    void resetStats();
+
+    // Protocol 2.0 instructions. Return values follow Dynamixel2Arduino.
+    bool ping(uint8_t id, uint32_t timeoutMs);
+    bool read(uint8_t id, uint16_t addr, uint16_t len, uint8_t* data, uint32_t timeoutMs, uint8_t* err);
+    bool write(uint8_t id, uint16_t addr, uint16_t len, const uint8_t* data, uint32_t timeoutMs, uint8_t* err);
+    void syncWrite(uint16_t addr, uint16_t len, uint8_t count, const uint8_t* ids, uint8_t* const* data);
+    void bulkWrite(uint8_t count, const uint8_t* ids, const uint16_t* addrs, const uint16_t* lens, uint8_t* const* data);
+    uint8_t syncRead(uint16_t addr, uint16_t len, uint8_t count, const uint8_t* ids, uint8_t* const* data,
+                     uint8_t* errs, bool fast, uint32_t timeoutMs);
+
+  private:
+    dxlSimServo _servos[DXL_SIM_MAX_SERVOS];
+    uint8_t _servoCount = 0;
+    uint64_t _nowUs = 0;
+    uint32_t _masterBaud = 57600;
+    dxlSimStats _stats;
+
+    uint8_t _listeners(uint8_t id, dxlSimServo** out);
+    void _wire(uint32_t bytes);
+    void _returnDelay(const dxlSimServo* s);
+    void _timeout(uint32_t timeoutMs);
+    void _status(uint32_t bytes, bool newPacket = true);
+    bool _replies(const dxlSimServo* s, bool isRead) const;
+    uint8_t _apply(dxlSimServo* s, uint16_t addr, uint16_t len, const uint8_t* data);
+    void _step(dxlSimServo* s, uint64_t dtUs);
+};
+
+extern dxlSimBus simBus;
+
+#endif
@@ -8,23 +8,57 @@
 
 // Q8bot-specific Modules
 #include "q8Dynamixel.h"
+#include "q8Control.h"
+#include "q8Telemetry.h"
+#include "q8Bulk.h"
 #include "userParams.h"
 #include "systemParams.h"
 #include "pinMapping.h"
-#include "macStorage.h"
+#include "q8Config.h"
 
 // Initialize global objects
 esp_now_peer_info_t peerInfo;
 HardwareSerial          ser(0);
 Dynamixel2Arduino       q8dxl(ser, DXL_DIR_PIN);
 q8Dynamixel             q8(q8dxl);
+q8Control               control(q8, CONTROL_PERIOD_MS);
+q8Telemetry             telemetry;
+q8BulkSender            bulkTx;
 bool started = false;  // Track robot start state
-macStorage storage;
+bool commandSeen = false;  // First command since reset reported
+int16_t lastSyncId = -1;   // Group start already taken, its later copies are ignored
+q8Config storage;
+q8LinkProbe linkProbe;
+q8LinkStats linkStats;  // Heartbeats from the controller, espnowRxTask only
 
 // FreeRTOS Handles
 QueueHandle_t rxQueue = NULL;
+q8PacketPool<RX_POOL_SIZE> rxPool;
+q8LogRing<LOG_RING_SIZE> controlLog;
+q8LogRing<LOG_RING_SIZE> rxLog;
 QueueHandle_t debugQueue = NULL;
 EventGroupHandle_t eventGroup = NULL;
+SemaphoreHandle_t recordMutex = NULL;
+SemaphoreHandle_t sendMutex = NULL;     // Held around esp_now_send(), see espnowSend()
+QueueHandle_t telemetryQueue = NULL;
+QueueHandle_t traceQueue = NULL;
+QueueSetHandle_t telemetrySet = NULL;   // telemetryQueue and traceQueue
+QueueHandle_t bulkQueue = NULL;
+TaskHandle_t bulkTaskHandle = NULL;
+TaskHandle_t serialOutputHandle = NULL;
+volatile uint32_t outputDropped = 0;  // queuePrint() messages lost, debugQueue full
+
+// Send callbacks come in the order of the sends. Each send notes what it
+// was, so OnDataSent() releases the next bulk chunk on the chunk's own
+// callback and not on that of a telemetry frame or heartbeat sent meanwhile.
+enum SendKind : uint8_t {
+  SEND_OTHER,
+  SEND_BULK,        // Bulk chunk, bulkTask waits for its callback
+};
+const uint8_t SEND_KINDS = 16;        // Sends waiting for their callback
+SendKind sendKinds[SEND_KINDS];
+volatile uint8_t sendHead = 0;        // Next callback, advanced by OnDataSent() only
+volatile uint8_t sendTail = 0;        // Next send, under sendMutex
 
 // Robot State
 volatile RobotState robotState = STATE_UNPAIRED;
@@ -40,8 +74,28 @@ void queuePrint(SerialMsgType type, const char* format, ...) {
   va_start(args, format);
   vsnprintf(msg.text, sizeof(msg.text), format, args);
   va_end(args);
-  xQueueSend(debugQueue, &msg, 0);  // Non-blocking
+  if (xQueueSend(debugQueue, &msg, 0) != pdTRUE) {  // Non-blocking
+    outputDropped++;
+  } else if (serialOutputHandle != NULL) {
+    xTaskNotifyGive(serialOutputHandle);
+  }
+}
+
+// Log from a hot task: no formatting, debug events are dropped right here
+// unless debugMode is on
+template <typename... Args>
+void logEvent(q8LogRing<LOG_RING_SIZE>& ring, LogEvent event, Args... args) {
+  if (LOG_FORMATS[event].type == MSG_DEBUG && !debugMode) return;
+  if (ring.push(event, args...) && serialOutputHandle != NULL) {
+    xTaskNotifyGive(serialOutputHandle);
+  }
+}
+
+// Text of one serialOutputTask wake, collected for a single Serial.write
+void serialWrite(const uint8_t* data, size_t len) {
+  Serial.write(data, len);
 }
+q8LogOutput<SERIAL_OUTPUT_BATCH> output(serialWrite);
 
 bool addPeer(const uint8_t* mac) {
   esp_now_peer_info_t peer = {};
@@ -51,20 +105,51 @@ bool addPeer(const uint8_t* mac) {
   return esp_now_add_peer(&peer) == ESP_OK;
 }
 
-void unpair() {
+// esp_now_send() for every task, noting the kind of send for OnDataSent().
+// Not sent if too many callbacks are still outstanding.
+bool espnowSend(const uint8_t* mac, const void* data, size_t len, SendKind kind = SEND_OTHER) {
+  xSemaphoreTake(sendMutex, portMAX_DELAY);
+  uint8_t tail = sendTail;
+  bool sent = (uint8_t)(tail - sendHead) < SEND_KINDS;
+  if (sent) {
+    sendKinds[tail % SEND_KINDS] = kind;
+    sendTail = tail + 1;
+    sent = esp_now_send(mac, (const uint8_t*)data, len) == ESP_OK;
+    if (!sent) sendTail = tail;  // No callback will come for it
+  }
+  xSemaphoreGive(sendMutex);
+  return sent;
+}
+
+// Pairing reply, also the probe to a saved controller
+void sendPairing(const uint8_t* mac) {
+  PairingMessage reply;
+  memcpy(reply.macAddr, serverMac, 6);
+  reply.channel = chan;
+  reply.id = 0;  // Server is ID 0
+  espnowSend(mac, &reply, sizeof(reply));
+}
+
+// A lost link keeps the controller to probe it; forget (forced pairing) drops it
+void unpair(bool forget) {
   queuePrint(MSG_INFO, "[HEARTBEAT] Connection lost - returning to pairing mode\n");
 
-  esp_now_del_peer(clientMac);
-  storage.clearPeerMAC();
-  queuePrint(MSG_DEBUG, "[STORAGE] Cleared controller MAC from EEPROM\n");
-  memset(clientMac, 0, sizeof(clientMac));
   paired = false;
   started = false;
+  if (forget) {
+    linkProbe.stop();
+    esp_now_del_peer(clientMac);
+    storage.clearPeerMAC();
+    queuePrint(MSG_DEBUG, "[STORAGE] Cleared controller MAC\n");
+    memset(clientMac, 0, sizeof(clientMac));
+  } else {
+    linkProbe.start(millis());
+  }
 
   // Update robot state and event group
   robotState = STATE_UNPAIRED;
   xEventGroupClearBits(eventGroup, EVENT_PAIRED | EVENT_STARTED);
-  xEventGroupSetBits(eventGroup, EVENT_UNPAIRED);
+  xEventGroupSetBits(eventGroup, forget ? EVENT_UNPAIRED : EVENT_UNPAIRED | EVENT_PROBE);
 }
 
 void displayReading()
@@ -83,16 +168,29 @@ void displayReading()
   Serial.println();
 }
 
-void addElementToArray(uint16_t*& array, size_t& currentSize, uint16_t newElement) {
-    // Allocate a new array with one extra element
-    uint16_t* newArray = new uint16_t[currentSize + 1];
-    newArray[0] = newElement;
-    memcpy(newArray + 1, array, currentSize * sizeof(uint16_t));
-    // Delete the old array (free the memory)
-    delete[] array;
-    // Update the original pointer and size
-    array = newArray;
-    currentSize++;
+void recordSample() {
+  // Sync read straight into a stack buffer and append one sample to the ring
+  uint16_t values[16];
+  q8.syncRead(values);
+  RecordSample sample;
+  memcpy(sample.data, values, sizeof(sample.data));
+  xSemaphoreTake(recordMutex, portMAX_DELAY);
+  recordBuf.push(sample);
+  xSemaphoreGive(recordMutex);
+}
+
+void telemetrySample(bool flush) {
+  // Add a full joint state sample and queue the frame once it is full.
+  // On flush, queue whatever is left of the current frame.
+  if (!flush) {
+    q8JointState state;
+    q8.syncRead(state);
+    if (!telemetry.add(state)) return;
+  } else if (!telemetry.pending()) {
+    return;
+  }
+  // Non-blocking: a full queue drops the frame, reported in the next one
+  telemetry.sent(xQueueSend(telemetryQueue, &telemetry.frame(), 0) == pdTRUE);
 }
 
 
@@ -103,165 +201,346 @@ void onRecv(const uint8_t* mac, const uint8_t* data, int len) {
   // Validate length to prevent buffer overrun
   if (len < 1 || len > 250) return;
 
-  // Copy message to queue for processing in espnowRxTask
-  ESPNowMessage msg;
-  memcpy(msg.mac, mac, 6);
-  memcpy(msg.data, data, len);
-  msg.len = len;
-  msg.timestamp = millis();
+  // Copy into a pool slot, only the pointer goes through the queue
+  q8Packet* packet = rxPool.acquire();
+  if (packet == NULL) return;
+  memcpy(packet->mac, mac, 6);
+  memcpy(packet->data, data, len);
+  packet->data[len] = '\0';
+  packet->len = len;
+  packet->timestamp = micros();
 
   // Non-blocking send - drop message if queue is full
-  (void)xQueueSend(rxQueue, &msg, 0);
+  if (xQueueSend(rxQueue, &packet, 0) != pdTRUE) rxPool.drop(packet);
 }
 
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
+  // Paces the bulk transfer: the chunk is out, bulkTask sends the next one
+  uint8_t head = sendHead;
+  if (head == sendTail) return;
+  SendKind kind = sendKinds[head % SEND_KINDS];
+  sendHead = head + 1;
+
+  if (kind == SEND_BULK) {
+    xTaskNotify(bulkTaskHandle, status == ESP_NOW_SEND_SUCCESS ? 1 : 2, eSetValueWithOverwrite);
+  }
 }
 
 
 // ============================================================================
 // FreeRTOS Tasks (Ranked by Priority)
 // ============================================================================
-// FreeRTOS Task: ESP-NOW RX Handler (Priority 3 - HIGHEST)
-void espnowRxTask(void* parameter) {
-  ESPNowMessage msg;
+// FreeRTOS Task: Control Loop (Priority 4 - HIGHEST)
+void controlTask(void* parameter) {
+  TickType_t lastWake = xTaskGetTickCount();
+  unsigned long lastReport = millis();
 
   while (true) {
-    // Wait for messages from onRecv() callback (blocking)
-    if (xQueueReceive(rxQueue, &msg, portMAX_DELAY) == pdTRUE) {
-      uint8_t msgType = msg.data[0];
-
-      // Handle PAIRING message
-      if (msgType == PAIRING && !paired) {
-        // Validate PAIRING message length
-        if (msg.len < sizeof(PairingMessage)) continue;
-
-        memcpy(&pairingData, msg.data, sizeof(pairingData));
-        queuePrint(MSG_DEBUG, "[PAIRING] Pairing request from: %02X:%02X:%02X:%02X:%02X:%02X\n",
-                   msg.mac[0], msg.mac[1], msg.mac[2], msg.mac[3], msg.mac[4], msg.mac[5]);
-
-        memcpy(clientMac, msg.mac, 6);
-        WiFi.softAPmacAddress(pairingData.macAddr);  // Overwrite with our own MAC
-        pairingData.channel = chan;
-        pairingData.id = 0;  // Server is ID 0
-        addPeer(clientMac);
-        esp_now_send(clientMac, (uint8_t*)&pairingData, sizeof(pairingData));
-        paired = true;
-        lastHeartbeatReceived = millis();
-
-        // Update robot state and event group
-        robotState = STATE_PAIRED;
-        xEventGroupClearBits(eventGroup, EVENT_UNPAIRED);
-        xEventGroupSetBits(eventGroup, EVENT_PAIRED);
-
-        // Save the controller MAC address to EEPROM
-        storage.savePeerMAC(clientMac);
-        queuePrint(MSG_DEBUG, "[STORAGE] Saved controller MAC to EEPROM\n");
-        queuePrint(MSG_INFO, "[PAIRING] Paired successfully\n");
+    // Latch the newest setpoint and issue at most one bulkWrite
+    uint8_t events = control.cycle(micros());
+    if (events & CYCLE_RECORD) {
+      recordSample();
+    }
+    if (events & (CYCLE_TELEMETRY | CYCLE_TELEMETRY_END)) {
+      telemetrySample(events & CYCLE_TELEMETRY_END);
+    }
+    if (events & CYCLE_TRACE) {
+      xQueueSend(traceQueue, &control.trace(), 0);  // Dropped if the sender is behind
+    }
+    if (events & CYCLE_GAIT_REJECTED) {
+      logEvent(controlLog, LOG_GAIT_REJECTED);
+    }
+    if (events & CYCLE_STREAM_STALE) {
+      logEvent(controlLog, SETPOINT_SMOOTHING.stale == STALE_LIMP ? LOG_STREAM_LIMP : LOG_STREAM_HOLD,
+               SETPOINT_SMOOTHING.staleMs);
+    }
+
+    // Loop timing report every 10 seconds
+    if (debugMode && millis() - lastReport >= 10000) {
+      lastReport = millis();
+      const q8ControlStats& st = control.stats();
+      logEvent(controlLog, LOG_CONTROL_STATS, st.cycles, st.writes, st.overruns, st.maxJitterUs, st.maxExecUs);
+      const q8SmoothStats& sm = control.smoother().stats();
+      if (sm.frames > 0) {
+        logEvent(controlLog, LOG_STREAM_STATS, sm.frames, sm.lost, sm.extrapolated, control.smoother().intervalUs());
       }
-      // Handle HEARTBEAT message
-      else if (msgType == HEARTBEAT && paired) {
-        // Validate HEARTBEAT message length
-        if (msg.len < sizeof(HeartbeatMessage)) continue;
+      control.resetStats();
+      const q8PacketPoolStats& rx = rxPool.stats();
+      logEvent(controlLog, LOG_RX_STATS, rx.received, rx.exhausted, rx.dropped, rx.peak, RX_POOL_SIZE);
+    }
 
-        lastHeartbeatReceived = millis();
-        queuePrint(MSG_DEBUG, "[HEARTBEAT] Received, echoing back\n");
+    // A group start before the next regular cycle moves the loop onto it, so
+    // every robot of the group writes in the same tick. The last part of the
+    // wait is below the FreeRTOS tick and spun.
+    int32_t startIn = control.startIn(micros());
+    if (startIn >= 0) {
+      uint32_t startUs = micros() + startIn;
+      if (startIn >= 1000) vTaskDelay(startIn / 1000 / portTICK_PERIOD_MS);
+      int32_t left = startUs - micros();
+      if (left > 0) delayMicroseconds(left);
+      lastWake = xTaskGetTickCount();
+      continue;
+    }
 
-        // Echo heartbeat back to controller
-        esp_now_send(msg.mac, msg.data, msg.len);
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(CONTROL_PERIOD_MS));
+  }
+}
+
+// Handle one packet in place, the slot goes back to the pool afterwards
+void handlePacket(const q8Packet& msg, uint32_t taskUs) {
+  uint8_t msgType = msg.data[0];
+
+  // Anything from the saved controller ends the probe and resumes the link
+  if (linkProbe.active() && memcmp(msg.mac, clientMac, 6) == 0 && linkProbe.stop()) {
+    logEvent(rxLog, LOG_LINK_UP, linkProbe.elapsed(millis()), linkProbe.sent());
+    if (!paired) {
+      paired = true;
+      lastHeartbeatReceived = millis();
+      robotState = STATE_PAIRED;
+      xEventGroupClearBits(eventGroup, EVENT_UNPAIRED);
+      xEventGroupSetBits(eventGroup, EVENT_PAIRED);
+    }
+  }
+
+  // Handle PAIRING message
+  if (msgType == PAIRING && paired && memcmp(msg.mac, clientMac, 6) == 0) {
+    // Our controller pairing again, e.g. after its reset: answer, keep the state
+    if (msg.len < sizeof(PairingMessage)) return;
+    linkStats.reset();  // Its heartbeat seq starts over
+    sendPairing(clientMac);
+    lastHeartbeatReceived = millis();
+  }
+  else if (msgType == PAIRING && !paired) {
+    // Validate PAIRING message length
+    if (msg.len < sizeof(PairingMessage)) return;
+
+    logEvent(rxLog, LOG_PAIR_REQUEST, msg.mac[0], msg.mac[1], msg.mac[2], msg.mac[3], msg.mac[4], msg.mac[5]);
+
+    if (memcmp(clientMac, msg.mac, 6) != 0) {
+      esp_now_del_peer(clientMac);   // Saved controller replaced by another one
+      memcpy(clientMac, msg.mac, 6);
+    }
+    linkProbe.stop();
+    linkStats.reset();
+    addPeer(clientMac);
+    sendPairing(clientMac);
+    paired = true;
+    lastHeartbeatReceived = millis();
+
+    // Update robot state and event group
+    robotState = STATE_PAIRED;
+    xEventGroupClearBits(eventGroup, EVENT_UNPAIRED);
+    xEventGroupSetBits(eventGroup, EVENT_PAIRED);
+
+    // Save the controller MAC address, written to flash by robotStateTask
+    storage.savePeerMAC(clientMac, chan);
+    logEvent(rxLog, LOG_MAC_SAVED);
+    logEvent(rxLog, LOG_PAIRED);
+  }
+  // Handle HEARTBEAT message
+  else if (msgType == HEARTBEAT && paired) {
+    // Validate HEARTBEAT message length
+    if (msg.len < sizeof(HeartbeatMessage)) return;
+
+    lastHeartbeatReceived = millis();
+    HeartbeatMessage hb;
+    memcpy(&hb, msg.data, sizeof(hb));
+    linkStats.received(hb.seq);
+    if (hb.rttUs != 0) linkStats.rtt(hb.rttUs);  // Measured by the controller
+    q8LinkQuality q = linkStats.summary();
+    logEvent(rxLog, LOG_HEARTBEAT_ECHO, hb.seq, q.rttMeanUs, q.rttP99Us, q.lossPermille);
+
+    // Echo heartbeat back to controller, with the heartbeats we missed
+    hb.lossPermille = q.lossPermille;
+    espnowSend(msg.mac, &hb, sizeof(hb));
+  }
+  // Handle SYNC_START, broadcast by our controller to start a group at once
+  else if (msgType == SYNC_START && paired && memcmp(msg.mac, clientMac, 6) == 0) {
+    if (msg.len < sizeof(SyncStartMessage)) return;
+
+    SyncStartMessage sync;
+    memcpy(&sync, msg.data, sizeof(sync));
+    if (sync.id == lastSyncId) return;
+    lastSyncId = sync.id;
+    // Timed from onRecv(), so every robot that heard a copy names the same moment
+    if (control.startHeld(msg.timestamp + sync.delayUs)) {
+      logEvent(rxLog, LOG_SYNC_START, sync.id, sync.delayUs);
+    }
+  }
+  // Handle BULK_ACK message, passed on to the bulk transfer task
+  else if (msgType == BULK_ACK && paired) {
+    if (msg.len < sizeof(BulkAck)) return;
+
+    BulkEvent ev;
+    ev.start = false;
+    memcpy(&ev.ack, msg.data, sizeof(BulkAck));
+    xQueueSend(bulkQueue, &ev, 0);
+  }
+  // Handle COMMAND (binary) and DATA (legacy CSV) messages
+  else if ((msgType == COMMAND || msgType == DATA) && paired) {
+    uint8_t result;
+    if (msgType == COMMAND) {
+      // Validate COMMAND message length and frame version
+      if (msg.len < sizeof(CommandMessage)) return;
+      const CommandMessage& cmdMsg = *reinterpret_cast<const CommandMessage*>(msg.data);
+      if (cmdMsg.version != CMD_FRAME_VERSION) return;
+
+      lastHeartbeatReceived = millis();  // Any DATA also counts as "alive"
+      if (!commandSeen) {
+        commandSeen = true;
+        logEvent(rxLog, LOG_FIRST_COMMAND, millis());
       }
-      // Handle DATA message
-      else if (msgType == DATA && paired) {
-        // Validate DATA message length
-        if (msg.len < sizeof(CharMessage)) continue;
-
-        lastHeartbeatReceived = millis();  // Any DATA also counts as "alive"
-        memcpy(&theirMsg, msg.data, sizeof(theirMsg));
-        uint8_t result = q8.parseData(theirMsg.data);
-
-        // myMsg params
-        myMsg.id = 0;  // Server ID
-
-        if (result == 0) {
-          // No special instruction
-          continue;
-        } else {
-          // Controller requests battery level or data
-          switch (result) {
-            case 1: {
-              // Send battery level
-              queuePrint(MSG_DEBUG, "[DATA] Send battery level\n");
-              myMsg.data[0] = (uint16_t)FuelGauge.percent();
-              esp_now_send(clientMac, (uint8_t*)&myMsg, sizeof(myMsg));
-              break;
-            }
-
-            case 2: {
-              // Sync read position data
-              uint16_t* posArray = q8.syncRead();
-              if (rData != nullptr) {
-                // If rData is not nullptr, resize posArray to append new data
-                uint16_t* newData = new uint16_t[masterSize + smallerSize];
-                if (newData == nullptr) {
-                  queuePrint(MSG_DEBUG, "[ERROR] Memory allocation failed, dropping data\n");
-                  delete[] posArray;
-                  break;
-                }
-                memcpy(newData, rData, masterSize * sizeof(uint16_t));
-                for (size_t j = 0; j < smallerSize; ++j) {
-                  newData[masterSize + j] = posArray[j];
-                }
-                delete[] rData;
-                rData = newData;
-                masterSize += smallerSize;
-              } else {
-                // If rData is nullptr, initialize it for the first time
-                rData = new uint16_t[smallerSize];
-                if (rData == nullptr) {
-                  queuePrint(MSG_DEBUG, "[ERROR] Memory allocation failed\n");
-                  delete[] posArray;
-                  break;
-                }
-                for (size_t j = 0; j < smallerSize; ++j) {
-                  rData[j] = posArray[j];
-                }
-                masterSize = smallerSize;
-              }
-              delete[] posArray;
-              break;
-            }
-
-            case 3: {
-              // Send all recorded data in chunks
-              if (rData != nullptr) {
-                queuePrint(MSG_DEBUG, "[DATA] Sending %d recorded data points\n", masterSize);
-
-                size_t totalSize = masterSize;  // total data in rData
-                size_t chunkSize = 100;         // Chunk size for each ESPNow send
-                size_t offset = 0;              // To track the position in rData
-
-                // Loop to send the data in chunks
-                while (offset < totalSize) {
-                  // If rData is less than chunk size then use its size instead.
-                  size_t currentChunkSize = (totalSize - offset < chunkSize) ? (totalSize - offset) : chunkSize;
-                  memcpy(myMsg.data, &rData[offset], currentChunkSize * sizeof(uint16_t));
-                  // If the chunk is smaller than 100, fill the remaining spaces with zeros
-                  if (currentChunkSize < chunkSize) {
-                    memset(&myMsg.data[currentChunkSize], 0, (chunkSize - currentChunkSize));
-                  }
-                  // Send the chunk via ESP-NOW
-                  esp_now_send(clientMac, (uint8_t*)&myMsg, sizeof(myMsg));
-                  // Update offset and Reset myData
-                  offset += currentChunkSize;
-                  memset(myMsg.data, 0, sizeof(myMsg.data));
-                }
-                delete[] rData;
-                rData = nullptr;
-                masterSize = 0;
-              }
-              break;
-            }
-          }
+      if ((cmdMsg.flags & CMD_FLAG_TRACE) && msg.len >= sizeof(CommandMessage) + sizeof(CommandTrace)) {
+        // Latency trace, the record comes back once the servos are written
+        CommandTrace ct;
+        memcpy(&ct, msg.data + sizeof(CommandMessage), sizeof(ct));
+        q8TraceStamp stamp;
+        stamp.active = true;
+        stamp.id = ct.id;
+        stamp.ingestUs = ct.ingestUs;
+        stamp.rxUs = msg.timestamp;
+        stamp.taskUs = taskUs;
+        result = control.command(cmdMsg, &stamp);
+      } else {
+        result = control.command(cmdMsg);  // Only updates the control mailbox
+      }
+    } else {
+      // Validate DATA message length
+      if (msg.len < sizeof(CharMessage)) return;
+
+      lastHeartbeatReceived = millis();  // Any DATA also counts as "alive"
+      result = control.commandCsv(reinterpret_cast<const CharMessage*>(msg.data)->data);
+    }
+
+    // myMsg params
+    myMsg.id = 0;  // Server ID
+
+    if (result == 0) {
+      // No special instruction
+      return;
+    } else {
+      // Controller requests battery level or data
+      switch (result) {
+        case 1: {
+          // Send battery level
+          logEvent(rxLog, LOG_BATTERY);
+          myMsg.data[0] = (uint16_t)FuelGauge.percent();
+          espnowSend(clientMac, &myMsg, sizeof(myMsg));
+          break;
         }
+
+        case 3: {
+          // Hand the dump to the bulk transfer task, acks arrive later
+          BulkEvent ev;
+          ev.start = true;
+          xQueueSend(bulkQueue, &ev, 0);
+          break;
+        }
+      }
+    }
+  }
+}
+
+// FreeRTOS Task: ESP-NOW RX Handler (Priority 3)
+void espnowRxTask(void* parameter) {
+  q8Packet* packet;
+
+  while (true) {
+    // Wait for packets from onRecv() callback (blocking)
+    if (xQueueReceive(rxQueue, &packet, portMAX_DELAY) == pdTRUE) {
+      handlePacket(*packet, micros());
+      rxPool.release(packet);
+    }
+  }
+}
+
+void startDump() {
+  // Move all recorded samples into the transfer buffer
+  static uint8_t dumpBuf[TELEMETRY_CAPACITY * sizeof(RecordSample)];
+  static_assert(sizeof(dumpBuf) <= BULK_MAX_BYTES, "recording does not fit one bulk transfer");
+  if (bulkTx.active()) {
+    queuePrint(MSG_DEBUG, "[DATA] Transfer already running\n");
+    return;
+  }
+
+  size_t count = 0;
+  RecordSample sample;
+  xSemaphoreTake(recordMutex, portMAX_DELAY);
+  while (recordBuf.pop(sample)) {
+    memcpy(&dumpBuf[count * sizeof(sample)], &sample, sizeof(sample));
+    count++;
+  }
+  uint32_t dropped = recordBuf.dropped();
+  recordBuf.resetDropped();
+  xSemaphoreGive(recordMutex);
+  if (count == 0) return;
+
+  queuePrint(MSG_DEBUG, "[DATA] Sending %u recorded data points, %lu samples dropped\n",
+             (unsigned)(count * RECORD_SAMPLE_LEN), (unsigned long)dropped);
+  bulkTx.start(dumpBuf, count * sizeof(RecordSample), millis());
+}
+
+// FreeRTOS Task: Bulk Transfer (Priority 2)
+void bulkTxTask(void* parameter) {
+  BulkEvent ev;
+  BulkChunk chunk;
+  size_t len;
+
+  while (true) {
+    // Sleep until a dump is requested, then check for acks every few ms
+    TickType_t wait = bulkTx.active() ? pdMS_TO_TICKS(5) : portMAX_DELAY;
+    if (xQueueReceive(bulkQueue, &ev, wait) == pdTRUE) {
+      if (ev.start) {
+        startDump();
+      } else {
+        bulkTx.onAck(ev.ack, millis());
+      }
+    }
+
+    // One chunk in flight, its send callback releases the next one. A late
+    // callback of a chunk given up on is cleared first.
+    while (paired && bulkTx.next(millis(), chunk, len)) {
+      uint32_t status = 0;
+      xTaskNotifyWait(0, UINT32_MAX, NULL, 0);
+      if (espnowSend(clientMac, &chunk, len, SEND_BULK)) {
+        xTaskNotifyWait(0, UINT32_MAX, &status, pdMS_TO_TICKS(BULK_SEND_TIMEOUT_MS));
+      }
+      bulkTx.sent(status == 1, millis());
+    }
+
+    if (bulkTx.state() == q8BulkSender::DONE) {
+      queuePrint(MSG_DEBUG, "[DATA] Sent %lu B in %u chunks, %u retransmitted, %lu ms\n",
+                 (unsigned long)bulkTx.length(), bulkTx.chunks(), bulkTx.retransmits(),
+                 (unsigned long)bulkTx.elapsedMs());
+      bulkTx.reset();
+    } else if (bulkTx.state() == q8BulkSender::FAILED) {
+      queuePrint(MSG_INFO, "[DATA] Transfer failed, controller stopped answering\n");
+      bulkTx.reset();
+    }
+  }
+}
+
+// FreeRTOS Task: Telemetry Sender (Priority 2)
+void telemetryTxTask(void* parameter) {
+  TelemetryMessage frame;
+  TraceMessage traces;
+
+  while (true) {
+    // Wait for full frames or trace records from the control task (blocking)
+    QueueSetMemberHandle_t ready = xQueueSelectFromSet(telemetrySet, portMAX_DELAY);
+    if (ready == telemetryQueue) {
+      if (xQueueReceive(telemetryQueue, &frame, 0) == pdTRUE && paired) {
+        espnowSend(clientMac, &frame, TELEMETRY_HEADER_LEN + frame.count * sizeof(TelemetrySample));
+      }
+    } else if (ready == traceQueue) {
+      // Everything waiting goes out in one frame, later selects find the queue empty
+      traces.count = 0;
+      while (traces.count < TRACE_PER_FRAME &&
+             xQueueReceive(traceQueue, &traces.records[traces.count], 0) == pdTRUE) {
+        traces.count++;
+      }
+      if (traces.count > 0 && paired) {
+        espnowSend(clientMac, &traces, 2 + traces.count * sizeof(TraceRecord));
       }
     }
   }
@@ -269,9 +548,19 @@ void espnowRxTask(void* parameter) {
 
 // FreeRTOS Task: Heartbeat Monitor (Priority 2)
 void heartbeatMonitorTask(void* parameter) {
-  TickType_t lastWake = xTaskGetTickCount();
-
   while (true) {
+    // Probe the saved controller until it answers, see handlePacket()
+    switch (linkProbe.poll(millis())) {
+      case PROBE_SEND:
+        sendPairing(clientMac);
+        break;
+      case PROBE_EXPIRED:
+        queuePrint(MSG_DEBUG, "[PAIRING] Saved controller not answering - waiting for pairing request\n");
+        break;
+      default:
+        break;
+    }
+
     // Only monitor heartbeat when paired
     if (paired) {
       unsigned long now = millis();
@@ -284,16 +573,16 @@ void heartbeatMonitorTask(void* parameter) {
 #ifndef PERMANENT_PAIRING_MODE
         if (timeSinceLastMsg > HEARTBEAT_TIMEOUT_ROBOT) {
           queuePrint(MSG_DEBUG, "[HEARTBEAT] Timeout detected (%lums since last message)\n", timeSinceLastMsg);
-          q8.toggleTorque(0);        // Disable torque hardware
-          q8.resetTorqueState();     // Sync internal flag to match disabled state
-          unpair();
+          control.requestStop();     // Torque off from the control task
+          unpair(false);
         }
 #endif
       }
     }
 
-    // Check every 1 second
-    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(1000));
+    // Check every 1 second, or at the next probe
+    uint32_t wait = linkProbe.active() ? linkProbe.wait(millis()) : 1000;
+    xEventGroupWaitBits(eventGroup, EVENT_PROBE, pdTRUE, pdFALSE, pdMS_TO_TICKS(wait));
   }
 }
 
@@ -301,30 +590,11 @@ void heartbeatMonitorTask(void* parameter) {
 void robotStateTask(void* parameter) {
   TickType_t lastStateChange = xTaskGetTickCount();
   unsigned long lastActivity = 0;
-  bool firstRun = true;  // Check saved MAC on first iteration
 
   // Give other tasks time to start (especially serialOutputTask)
   vTaskDelay(pdMS_TO_TICKS(100));
 
   while (true) {
-    // On first run, check for saved MAC address
-    if (firstRun) {
-      firstRun = false;
-      if (storage.loadPeerMAC(clientMac)) {
-        queuePrint(MSG_DEBUG, "[PAIRING] Found saved controller MAC: %02X:%02X:%02X:%02X:%02X:%02X\n",
-                   clientMac[0], clientMac[1], clientMac[2], clientMac[3], clientMac[4], clientMac[5]);
-        addPeer(clientMac);
-        paired = true;
-        robotState = STATE_PAIRED;
-        lastHeartbeatReceived = millis();
-        xEventGroupClearBits(eventGroup, EVENT_UNPAIRED);
-        xEventGroupSetBits(eventGroup, EVENT_PAIRED);
-        queuePrint(MSG_INFO, "[PAIRING] Attempting to reconnect to saved controller\n");
-      } else {
-        queuePrint(MSG_INFO, "[PAIRING] No saved MAC found - waiting for pairing request\n");
-      }
-    }
-
     unsigned long now = millis();
     RobotState currentState = robotState;
 
@@ -384,6 +654,11 @@ void robotStateTask(void* parameter) {
       }
     }
 
+    // Flash writes only happen here, never in the RX task
+    if (storage.commit(millis())) {
+      queuePrint(MSG_DEBUG, "[STORAGE] Config written to flash\n");
+    }
+
     vTaskDelay(pdMS_TO_TICKS(100));  // Check state every 100ms
   }
 }
@@ -393,36 +668,35 @@ void serialOutputTask(void* parameter) {
   SerialMessage msg;
 
   while (true) {
-    // Check for serial output messages (blocking with timeout)
-    if (xQueueReceive(debugQueue, &msg, pdMS_TO_TICKS(10)) == pdTRUE) {
-      // Print based on message type
-      if (msg.type == MSG_INFO) {
-        // INFO messages always printed
-        Serial.print(msg.text);
-      } else if (msg.type == MSG_DEBUG && debugMode) {
-        // DEBUG messages only when debugMode is ON
-        Serial.print(msg.text);
-      }
+    // Sleep until queuePrint() or logEvent() has something
+    ulTaskNotifyTake(pdTRUE, SERIAL_OUTPUT_WAIT);
+
+    // Drain everything waiting, INFO always, DEBUG only when debugMode is ON
+    SerialMsgType shown = debugMode ? MSG_DEBUG : MSG_INFO;
+    while (xQueueReceive(debugQueue, &msg, 0) == pdTRUE) {
+      if (msg.type <= shown) output.append(msg.text);
     }
 
+    // Binary log of the hot tasks
+    output.print(controlLog, LOG_FORMATS, shown);
+    output.print(rxLog, LOG_FORMATS, shown);
+    output.reportDropped(outputDropped + controlLog.dropped() + rxLog.dropped());
+    output.flush();
+
     // Check for incoming serial commands
 #ifdef PERMANENT_PAIRING_MODE
     if (Serial.available()) {
       char c = Serial.read();
       if (c == 'p') {
         queuePrint(MSG_INFO, "[PAIRING] Force pairing mode requested\n");
-        q8.toggleTorque(0);        // Disable torque hardware
-        q8.resetTorqueState();     // Sync internal flag to match disabled state
-        unpair();
+        control.requestStop();     // Torque off from the control task
+        unpair(true);
       } else if (c == 'd') {
         debugMode = !debugMode;
         queuePrint(MSG_INFO, "Debug mode: %s\n", debugMode ? "ON" : "OFF");
       }
     }
 #endif
-
-    // Low priority - yield to other tasks
-    vTaskDelay(pdMS_TO_TICKS(10));
   }
 }
 
@@ -437,9 +711,26 @@ void setup() {
 
   bool initSuccess = true;
 
+  // Open the config store before any task can pair
+  if (!storage.begin()) {
+    Serial.println("[STORAGE] Failed to open config namespace");
+  }
+  control.setDefaultProfile(storage.profile());
+  control.setSmoothing(SETPOINT_SMOOTHING);
+
+  // Initialize Dynamixel object, then the stored profile and gains. This is
+  // done before the control and RX tasks exist: from then on the control task
+  // is the only one on the bus, and a saved controller may send commands at once.
+  q8.begin();
+  const q8BusStatus& bus = q8.busStatus();
+  uint16_t gain[CONFIG_JOINTS];
+  storage.getGain(gain);
+  q8.updateProfile(storage.profile());   // Resets the gains to 400
+  q8.setGain(gain);
+
   // FreeRTOS Initialization
   // Create queues
-  rxQueue = xQueueCreate(10, sizeof(ESPNowMessage));
+  rxQueue = xQueueCreate(RX_POOL_SIZE, sizeof(q8Packet*));
   if (rxQueue == NULL) {
     Serial.println("[RTOS] Failed to create RX queue");
     initSuccess = false;
@@ -451,6 +742,27 @@ void setup() {
     initSuccess = false;
   }
 
+  telemetryQueue = xQueueCreate(TELEMETRY_QUEUE_FRAMES, sizeof(TelemetryMessage));
+  if (telemetryQueue == NULL) {
+    Serial.println("[RTOS] Failed to create telemetry queue");
+    initSuccess = false;
+  }
+
+  traceQueue = xQueueCreate(TRACE_QUEUE_LEN, sizeof(TraceRecord));
+  telemetrySet = xQueueCreateSet(TELEMETRY_QUEUE_FRAMES + TRACE_QUEUE_LEN);
+  if (telemetryQueue == NULL || traceQueue == NULL || telemetrySet == NULL ||
+      xQueueAddToSet(telemetryQueue, telemetrySet) != pdPASS ||
+      xQueueAddToSet(traceQueue, telemetrySet) != pdPASS) {
+    Serial.println("[RTOS] Failed to create trace queue");
+    initSuccess = false;
+  }
+
+  bulkQueue = xQueueCreate(4, sizeof(BulkEvent));
+  if (bulkQueue == NULL) {
+    Serial.println("[RTOS] Failed to create bulk queue");
+    initSuccess = false;
+  }
+
   // Create event group for task synchronization
   eventGroup = xEventGroupCreate();
   if (eventGroup == NULL) {
@@ -458,21 +770,54 @@ void setup() {
     initSuccess = false;
   }
 
+  // Create mutex for recorded data shared by the control and RX tasks
+  recordMutex = xSemaphoreCreateMutex();
+  if (recordMutex == NULL) {
+    Serial.println("[RTOS] Failed to create record mutex");
+    initSuccess = false;
+  }
+
+  // Serialises esp_now_send() with the note of what was sent
+  sendMutex = xSemaphoreCreateMutex();
+  if (sendMutex == NULL) {
+    Serial.println("[RTOS] Failed to create ESP-NOW send mutex");
+    initSuccess = false;
+  }
+
+  // Bus set up by q8.begin() above, printed once the output task runs
+  queuePrint(MSG_INFO, "[ROBOT] DXL bus %lu bps, status level %u, return delay %u us, joints 0x%02X%s\n",
+             (unsigned long)bus.baudrate, bus.statusReturnLevel, bus.returnDelayUs, bus.joints,
+             bus.applied ? "" : " (fallback)");
+
   // Create FreeRTOS tasks
   // Create serial output task (Priority 1)
   BaseType_t taskCreated = xTaskCreate(
     serialOutputTask,   // Task function
     "SerialOutput",     // Task name
-    2048,               // Stack size (bytes)
+    3072,               // Stack size (bytes)
     NULL,               // Parameters
     1,                  // Priority (low)
-    NULL                // Task handle
+    &serialOutputHandle // Task handle
   );
   if (taskCreated != pdPASS) {
     Serial.println("[RTOS] Failed to create serial output task");
     initSuccess = false;
   }
 
+  // Create control loop task (Priority 4)
+  taskCreated = xTaskCreate(
+    controlTask,        // Task function
+    "Control",          // Task name
+    4096,               // Stack size (bytes) - IK and gait math
+    NULL,               // Parameters
+    4,                  // Priority (highest - fixed-rate actuation)
+    NULL                // Task handle
+  );
+  if (taskCreated != pdPASS) {
+    Serial.println("[RTOS] Failed to create control task");
+    initSuccess = false;
+  }
+
   // Create ESP-NOW RX handler task (Priority 3)
   taskCreated = xTaskCreate(
     espnowRxTask,       // Task function
@@ -501,6 +846,34 @@ void setup() {
     initSuccess = false;
   }
 
+  // Create telemetry sender task (Priority 2)
+  taskCreated = xTaskCreate(
+    telemetryTxTask,    // Task function
+    "TelemetryTX",      // Task name
+    2048,               // Stack size (bytes)
+    NULL,               // Parameters
+    2,                  // Priority (medium - sends telemetry frames)
+    NULL                // Task handle
+  );
+  if (taskCreated != pdPASS) {
+    Serial.println("[RTOS] Failed to create telemetry task");
+    initSuccess = false;
+  }
+
+  // Create bulk transfer task (Priority 2)
+  taskCreated = xTaskCreate(
+    bulkTxTask,         // Task function
+    "BulkTX",           // Task name
+    3072,               // Stack size (bytes) - holds one chunk
+    NULL,               // Parameters
+    2,                  // Priority (medium - recorded data dump)
+    &bulkTaskHandle     // Task handle
+  );
+  if (taskCreated != pdPASS) {
+    Serial.println("[RTOS] Failed to create bulk transfer task");
+    initSuccess = false;
+  }
+
   // Create robot state manager task (Priority 1)
   taskCreated = xTaskCreate(
     robotStateTask,     // Task function
@@ -521,7 +894,11 @@ void setup() {
     while(1) { delay(1000); }  // Halt system indefinitely
   }
 
-  // Init Wi-Fi
+  // Init Wi-Fi, on the channel of the saved controller if there is one
+  bool savedPeer = storage.loadPeerMAC(clientMac);
+  if (savedPeer) {
+    chan = storage.channel();
+  }
   WiFi.mode(WIFI_AP_STA);
   WiFi.softAP("esp-server", nullptr, chan); // Optional, just to enable softAP mode
   chan = WiFi.channel();
@@ -533,6 +910,24 @@ void setup() {
     return;
   }
   esp_now_register_recv_cb(onRecv);  // Set up callback when data is received.
+  esp_now_register_send_cb(OnDataSent);  // Paces the bulk transfer
+
+  // Saved controller: take its commands at once and probe it until it
+  // answers, instead of waiting for its next pairing broadcast
+  if (savedPeer) {
+    queuePrint(MSG_DEBUG, "[PAIRING] Found saved controller MAC: %02X:%02X:%02X:%02X:%02X:%02X\n",
+               clientMac[0], clientMac[1], clientMac[2], clientMac[3], clientMac[4], clientMac[5]);
+    addPeer(clientMac);
+    paired = true;
+    robotState = STATE_PAIRED;
+    lastHeartbeatReceived = millis();
+    linkProbe.start(millis());
+    xEventGroupClearBits(eventGroup, EVENT_UNPAIRED);
+    xEventGroupSetBits(eventGroup, EVENT_PAIRED | EVENT_PROBE);
+    queuePrint(MSG_INFO, "[PAIRING] Attempting to reconnect to saved controller\n");
+  } else {
+    queuePrint(MSG_INFO, "[PAIRING] No saved MAC found - waiting for pairing request\n");
+  }
 
   // MAX17043 Init
   if (FuelGauge.begin()){
@@ -544,9 +939,6 @@ void setup() {
   } else{
     Serial.println("[ROBOT] MAX17043 NOT found. Continuing\n");
   }
-
-  // Initialize Dynamixel object
-  q8.begin();
 }
 
 // Loop does nothing - all work done in FreeRTOS tasks
@@ -0,0 +1,1493 @@
+/*
+  simMain.cpp - Host entry point for the native environment. Runs q8Dynamixel
+  against the simulated Dynamixel bus (lib/dxlSim) and reports bus time per
+  operation, so control-cycle regressions show up before flashing. Also checks
+  the onboard leg kinematics and gait engine against the Python tools, and
+  that CSV and binary commands decode to the same joint goals.
+
+  Run with: pio run -e native -t exec
+  Gait check: python gait_reference.py > gait_reference.csv (in python-tools/q8bot),
+              then run .pio/build/native/program gait_reference.csv
+  Decoder check: reads src/native/command_fixture.txt, or the file given after
+              the gait reference; python command_fixture.py writes it. The
+              program exits with 1 if a check fails (decoder or serial output).
+*/
+#include <Arduino.h>
+#include <Dynamixel2Arduino.h>
+#include <dxlSimBus.h>
+#include "q8Dynamixel.h"
+#include "q8Kinematics.h"
+#include "q8Gait.h"
+#include "q8Control.h"
+#include "q8Ring.h"
+#include "q8Telemetry.h"
+#include "q8Bulk.h"
+#include "q8PacketPool.h"
+#include "q8Log.h"
+#include "q8Config.h"
+#include "q8Link.h"
+#include "q8Smoother.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <string>
+#include <vector>
+
+const uint32_t CONTROL_PERIOD_US = 4000;  // 250 Hz command rate
+const uint32_t CYCLES = 250;
+
+HardwareSerial ser(0);
+Dynamixel2Arduino q8dxl(ser, 8);
+q8Dynamixel q8(q8dxl);
+
+// Count heap allocations so hot paths can be checked for zero heap traffic.
+// Only new is replaced, the library's delete frees with free() as well. Not
+// inlined, or the compiler pairs malloc() with delete and warns.
+static uint64_t allocCount = 0;
+__attribute__((noinline)) void* operator new(size_t n){
+  allocCount++;
+  void* p = malloc(n);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t n){ return operator new(n); }
+
+void report(const char* name, uint32_t calls){
+  const dxlSimStats& s = simBus.stats();
+  double busUs = static_cast<double>(s.busTimeUs) / calls;
+  printf("%-22s %6u %8.1f %8.1f %8.1f %9.1f %7.1f%%  %u\n", name, calls,
+         static_cast<double>(s.transactions) / calls,
+         static_cast<double>(s.txBytes) / calls,
+         static_cast<double>(s.rxBytes) / calls,
+         busUs, 100.0 * busUs / CONTROL_PERIOD_US, s.timeouts);
+  simBus.resetStats();
+}
+
+// ik_solve results of python-tools/q8bot/kinematics_solver.py
+struct IkReference { float x, y, q1, q2; };
+const IkReference IK_REF[] = {
+  {9.75f, 43.36f, 39.422f, 140.578f},  {-10.25f, 43.36f, 77.366f, 166.336f},
+  {29.75f, 43.36f, 13.664f, 102.634f}, {9.75f, 23.36f, 7.342f, 172.658f},
+  {9.75f, 60.0f, 72.732f, 107.268f},   {-15.0f, 50.0f, 97.979f, 154.595f},
+  {35.0f, 40.0f, 2.609f, 94.696f},     {9.75f, 25.0f, 10.352f, 169.648f},
+};
+
+// The robot must end up with the same goals whether a command comes in as
+// legacy CSV text (parseData) or as the PC's binary frame (executeCommand).
+// Both encodings of each command are written by espnow.py, see
+// python-tools/q8bot/command_fixture.py. False on any difference.
+bool checkDecoder(const char* path){
+  FILE* f = fopen(path, "r");
+  if (f == nullptr){
+    printf("decoder: cannot open %s\n", path);
+    return false;
+  }
+  std::vector<std::string> csvs;
+  std::vector<CommandMessage> frames;
+  uint32_t bad = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), f)){
+    if (line[0] == '#') continue;
+    char* hex = strchr(line, ' ');
+    if (hex == nullptr) continue;
+    *hex++ = '\0';
+    uint8_t frame[SERIAL_FRAME_MAX + SERIAL_FRAME_OVERHEAD];
+    size_t n = 0;
+    unsigned byte;
+    while (n < sizeof(frame) && sscanf(hex + 2 * n, "%2x", &byte) == 1) frame[n++] = byte;
+    // Sync, length, CommandMessage, CRC-16 of length and payload
+    if (n != sizeof(CommandMessage) + SERIAL_FRAME_OVERHEAD || frame[2] != sizeof(CommandMessage) ||
+        q8Crc16(&frame[2], frame[2] + 1) != (frame[n - 2] | frame[n - 1] << 8)){
+      bad++;
+      continue;
+    }
+    CommandMessage cmd;
+    memcpy(&cmd, &frame[3], sizeof(cmd));
+    csvs.push_back(line);
+    frames.push_back(cmd);
+  }
+  fclose(f);
+
+  std::vector<int32_t> csvPos, binPos;
+  for (const std::string& csv : csvs){
+    q8.parseData(csv.c_str());
+    csvPos.insert(csvPos.end(), q8.posArray(), q8.posArray() + 8);
+  }
+  for (const CommandMessage& cmd : frames){
+    q8.executeCommand(cmd);
+    binPos.insert(binPos.end(), q8.posArray(), q8.posArray() + 8);
+  }
+  simBus.resetStats();
+
+  uint32_t mismatched = 0;
+  for (size_t i = 0; i < csvPos.size(); i += 8){
+    if (memcmp(&csvPos[i], &binPos[i], 8 * sizeof(int32_t)) != 0){
+      if (mismatched++ < 3){
+        printf("  command %u: %s CSV", (unsigned)(i / 8), csvs[i / 8].c_str());
+        for (uint8_t j = 0; j < 8; j++) printf(" %d", csvPos[i + j]);
+        printf(", binary");
+        for (uint8_t j = 0; j < 8; j++) printf(" %d", binPos[i + j]);
+        printf("\n");
+      }
+    }
+  }
+  printf("decoder: %u commands from espnow.py, %u bad frames, CSV and binary _posArray %s (%u differ)\n",
+         (unsigned)csvs.size(), bad, mismatched ? "DIFFER" : "identical", mismatched);
+  return !csvs.empty() && bad == 0 && mismatched == 0;
+}
+
+void benchKinematics(){
+  q8Kinematics leg;
+  float q1, q2, x, y;
+
+  float refErr = 0;
+  for (const IkReference& r : IK_REF){
+    leg.ikSolve(r.x, r.y, q1, q2);
+    refErr = fmaxf(refErr, fmaxf(fabsf(q1 - r.q1), fabsf(q2 - r.q2)));
+  }
+  printf("IK max error vs Python: %.4f deg\n", refErr);
+
+  // IK -> FK round trip over the gait workspace, 0.5 mm grid
+  float fkErr = 0;
+  uint32_t points = 0;
+  for (float gy = 25.0f; gy <= 60.0f; gy += 0.5f){
+    for (float gx = -15.0f; gx <= 35.0f; gx += 0.5f){
+      if (!leg.ikSolve(gx, gy, q1, q2)) continue;
+      leg.fkSolve(q1, q2, x, y);
+      fkErr = fmaxf(fkErr, hypotf(x - gx, y - gy));
+      points++;
+    }
+  }
+  printf("IK/FK round trip max error over %u points: %.4f mm\n", points, fkErr);
+
+  // Host CPU time only; scale by the ESP32-C3 float speed for the real number
+  const uint32_t n = 200000;
+  volatile float sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++){
+    leg.ikSolve(9.75f + (i % 40) * 0.5f, 30.0f + (i % 50) * 0.5f, q1, q2);
+    sink = sink + q1;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++){
+    leg.fkSolve(40.0f + (i % 40) * 0.5f, 140.0f - (i % 30) * 0.5f, x, y);
+    sink = sink + x;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  printf("ikSolve %.1f ns/call, fkSolve %.1f ns/call (host)\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / n,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / n);
+}
+
+void benchGait(const char* refPath){
+  q8Gait gait;
+  float feet[8];
+
+  // Compare every point against gait_reference.py output, joint angles in deg
+  if (refPath != nullptr){
+    FILE* f = fopen(refPath, "r");
+    if (f == nullptr){
+      printf("Cannot open %s\n", refPath);
+      return;
+    }
+    q8Kinematics leg[4];
+    int gaitId, dirId, idx, curGait = -1, curDir = -1;
+    float q[8], gaitErr[Q8_GAIT_COUNT] = {0}, maxErr = 0;
+    uint32_t rows = 0, failed = 0;
+    while (fscanf(f, "%d,%d,%d,%f,%f,%f,%f,%f,%f,%f,%f", &gaitId, &dirId, &idx,
+                  &q[0], &q[1], &q[2], &q[3], &q[4], &q[5], &q[6], &q[7]) == 11){
+      if (gaitId < 0 || gaitId >= Q8_GAIT_COUNT) continue;
+      if (gaitId != curGait || dirId != curDir){
+        gait.stop();
+        if (!gait.start(gaitId, dirId)) failed++;
+        curGait = gaitId;
+        curDir = dirId;
+      }
+      gait.sample(idx, feet);
+      for (uint8_t i = 0; i < 4; i++){
+        float q1, q2;
+        leg[i].ikSolve(feet[i*2], feet[i*2+1], q1, q2);
+        float err = fmaxf(fabsf(q1 - q[i*2]), fabsf(q2 - q[i*2+1]));
+        gaitErr[gaitId] = fmaxf(gaitErr[gaitId], err);
+        maxErr = fmaxf(maxErr, err);
+      }
+      rows++;
+    }
+    fclose(f);
+    for (uint8_t i = 0; i < Q8_GAIT_COUNT; i++){
+      printf("  gait %u max error %.3f deg\n", i, gaitErr[i]);
+    }
+    printf("Gait vs Python: %u points, %u gait/directions rejected, max error %.3f deg\n",
+           rows, failed, maxErr);
+  }
+
+  // CPU time of one gait tick (trajectory + IK of 4 legs) on the host
+  const uint32_t n = 100000;
+  q8Kinematics leg[4];
+  volatile float sink = 0;
+  gait.start(0, GAIT_FL_075);
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++){
+    gait.tick(GAIT_SAMPLE_MS, feet);
+    for (uint8_t j = 0; j < 4; j++){
+      float q1, q2;
+      leg[j].ikSolve(feet[j*2], feet[j*2+1], q1, q2);
+      sink = sink + q1;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  printf("gait tick + IK %.1f ns/tick (host)\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / n);
+
+  // Bus time of one onboard gait setpoint
+  gait.start(0, GAIT_F);
+  for (uint32_t i = 0; i < CYCLES; i++){
+    gait.tick(GAIT_SAMPLE_MS, feet);
+    q8.moveFeet(feet);
+  }
+  report("gait moveFeet", CYCLES);
+  printf("link: one %u B CMD_GAIT frame per direction change instead of %u B every %u ms\n",
+         static_cast<unsigned>(sizeof(CommandMessage)), static_cast<unsigned>(sizeof(CommandMessage)),
+         GAIT_SAMPLE_MS);
+}
+
+// Run the control loop the way controlTask does, with packets arriving in
+// bursts (0-3 per cycle) to mimic radio and queue jitter.
+void benchControl(){
+  q8Control control(q8, 4);
+  const uint32_t periodUs = control.periodMs() * 1000;
+  uint32_t packets = 0, seed = 1;
+  CommandMessage cmd;
+
+  // Torque on first, then stream joint targets
+  q8CsvToCommand("0,0,0,0,0,0,0,0,0,0,1", cmd);
+  control.command(cmd);
+  control.cycle(micros());
+  control.resetStats();
+  simBus.resetStats();
+
+  uint64_t wake = simBus.now();
+  for (uint32_t i = 0; i < CYCLES * 4; i++){
+    seed = seed * 1103515245 + 12345;
+    uint8_t burst = (seed >> 16) % 4;
+    for (uint8_t j = 0; j < burst; j++){
+      char csv[64];
+      float q = 30 + (packets % 20);
+      snprintf(csv, sizeof(csv), "%.1f,150,%.1f,150,%.1f,150,%.1f,150,0,0,1", q, q, q, q);
+      q8CsvToCommand(csv, cmd);
+      control.command(cmd);
+      packets++;
+    }
+    control.cycle(micros());
+
+    // vTaskDelayUntil: sleep to the next period boundary unless late
+    wake += periodUs;
+    if (simBus.now() < wake) simBus.advance(wake - simBus.now());
+  }
+  const q8ControlStats& st = control.stats();
+  printf("control: %u packets, %u cycles, %u setpoints latched, %u writes, %u overruns, "
+         "max exec %u us, max jitter %u us\n", packets, st.cycles, st.setpoints, st.writes,
+         st.overruns, st.maxExecUs, st.maxJitterUs);
+  report("control joint stream", st.cycles);
+
+  // Variable speed moves, a new duration with every target. Separate profile
+  // and goal writes versus one timed sync write (13th CSV value).
+  for (int timed = 0; timed < 2; timed++){
+    control.resetStats();
+    simBus.resetStats();
+    for (uint32_t i = 0; i < CYCLES; i++){
+      char csv[80];
+      float q = 30 + (i % 20);
+      snprintf(csv, sizeof(csv), "%.1f,150,%.1f,150,%.1f,150,%.1f,150,0,%u,1,0,%d",
+               q, q, q, q, (unsigned)(100 + (i % 8) * 40), timed);
+      q8CsvToCommand(csv, cmd);
+      control.command(cmd);
+      control.cycle(micros());
+      wake += periodUs;
+      if (simBus.now() < wake) simBus.advance(wake - simBus.now());
+    }
+    printf("control variable speed%s: %u cycles, %u writes, %u overruns, max exec %u us\n",
+           timed ? " (timed)" : "", st.cycles, st.writes, st.overruns, st.maxExecUs);
+    report(timed ? "control var speed timed" : "control var speed", st.cycles);
+  }
+
+  // Onboard gait, one write every cycle
+  cmd = CommandMessage();
+  cmd.special = CMD_GAIT;
+  cmd.pos[0] = 0;
+  cmd.pos[1] = GAIT_F;
+  cmd.pos[2] = 100;
+  control.command(cmd);
+  control.resetStats();
+  for (uint32_t i = 0; i < CYCLES; i++){
+    control.cycle(micros());
+    wake += periodUs;
+    if (simBus.now() < wake) simBus.advance(wake - simBus.now());
+  }
+  printf("control gait: %u cycles, %u writes, %u overruns, max exec %u us\n",
+         st.cycles, st.writes, st.overruns, st.maxExecUs);
+  report("control gait", st.cycles);
+}
+
+void benchBus(){
+  // Bus time of one control cycle (bulkWrite + syncRead) per bus setup. Each
+  // begin() starts from the rate the previous setup left in the servos.
+  struct { const char* name; q8BusConfig bus; } setups[] = {
+    {"factory timing 1M", {1000000, 2, 250}},
+    {"tuned 1M", {1000000, 1, 0}},
+    {"tuned 2M", {2000000, 1, 0}},
+    {"tuned 3M", {3000000, 1, 0}},
+    {"tuned 4M", {4000000, 1, 0}},
+    {"tuned 1M", {1000000, 1, 0}},
+  };
+  int32_t idle[8];
+  for (uint8_t i = 0; i < 8; i++){
+    idle[i] = q8Deg2Dxl(i % 2 ? 150 : 30);
+  }
+  uint16_t values[16];
+  for (auto& setup : setups){
+    simBus.resetStats();
+    uint64_t start = simBus.now();
+    q8.begin(setup.bus);
+    double beginMs = (simBus.now() - start) / 1000.0;
+    const q8BusStatus& bus = q8.busStatus();
+    printf("bus %-18s %lu bps, status level %u, return delay %u us, joints 0x%02X%s\n", setup.name,
+           (unsigned long)bus.baudrate, bus.statusReturnLevel, bus.returnDelayUs, bus.joints,
+           bus.applied ? "" : " (fallback)");
+    simBus.resetStats();
+    bool ok = true;
+    for (uint32_t i = 0; i < CYCLES; i++){
+      q8.bulkWrite(idle);
+      ok &= q8.syncRead(values);
+    }
+    const dxlSimStats& st = simBus.stats();
+    double cycleUs = static_cast<double>(st.busTimeUs) / CYCLES;
+    printf("bus %-18s begin %6.1f ms, cycle %6.1f us (%4.1f%% of 4 ms), reads %s, %u timeouts\n",
+           setup.name, beginMs, cycleUs, 100.0 * cycleUs / CONTROL_PERIOD_US, ok ? "ok" : "FAILED",
+           st.timeouts);
+  }
+
+  // Joint 3 keeps torque on, so its EEPROM is locked and it stays at 1 Mbps
+  simBus.servo(2)->set(dxlSimAddr::TORQUE_ENABLE, 1, 1);
+  q8BusConfig fast = {4000000, 1, 0};
+  bool applied = q8.configureBus(fast);
+  printf("bus 4M with joint 3 locked: applied %d, back at %lu bps, joints 0x%02X\n",
+         applied, (unsigned long)q8.busBaud(), q8.pingSweep());
+  simBus.servo(2)->set(dxlSimAddr::TORQUE_ENABLE, 1, 0);
+  simBus.resetStats();
+}
+
+void benchBulk(){
+  // Recorded data dump over a lossy link. A chunk is lost on air with
+  // probability p (failed send callback), or lost after the MAC ack with p/4
+  // (controller queue full). Acks are lost with p as well.
+  static q8BulkReceiver rx;   // 16 kB, keep off the stack
+  static uint8_t data[8192];
+  const float losses[] = {0.0f, 0.05f, 0.2f, 0.5f};
+  const uint32_t airMs = 2;   // ~250 B at 1 Mbps plus MAC ack
+  uint32_t seed = 7;
+  auto chance = [&seed](float p){
+    seed = seed * 1103515245 + 12345;
+    return ((seed >> 8) & 0xFFFF) < p * 65536;
+  };
+  for (uint32_t i = 0; i < sizeof(data); i++) data[i] = i * 31 + 7;
+
+  q8BulkSender tx;
+  uint32_t now = 1;
+  for (float p : losses){
+    tx.start(data, sizeof(data), now);
+    uint32_t frames = 0;
+    BulkChunk chunk;
+    BulkAck ack;
+    size_t len;
+    while (tx.active()){
+      if (!tx.next(now, chunk, len)){
+        now++;
+        continue;
+      }
+      frames++;
+      now += airMs;
+      bool onAir = !chance(p);
+      bool delivered = onAir && !chance(p / 4);
+      tx.sent(onAir, now);
+      if (delivered && rx.onChunk(reinterpret_cast<uint8_t*>(&chunk), len, now, ack) && !chance(p)){
+        tx.onAck(ack, now + 1);
+      }
+    }
+    bool ok = tx.state() == q8BulkSender::DONE && rx.complete() &&
+              memcmp(rx.data(), data, sizeof(data)) == 0;
+    printf("bulk loss %2.0f%%: %u B, %u chunks, %u frames, %u retransmitted, %u ms, %.1f kB/s, %s\n",
+           p * 100, (unsigned)sizeof(data), tx.chunks(), frames, tx.retransmits(), tx.elapsedMs(),
+           sizeof(data) / (float)tx.elapsedMs(), ok ? "data verified" : "FAILED");
+    tx.reset();
+    now += 1000;
+  }
+}
+
+void benchTelemetry(){
+  // Onboard gait with the telemetry stream on, as the control task runs it
+  const uint16_t rates[] = {50, 100, 250};
+  q8Control control(q8, 4);
+  const uint32_t periodUs = control.periodMs() * 1000;
+  CommandMessage cmd;
+  cmd.special = CMD_GAIT;
+  cmd.pos[1] = GAIT_F;
+  cmd.pos[2] = 100;
+  control.command(cmd);
+
+  printf("telemetry: %u samples of %u B per %u B frame\n", TELEMETRY_PER_FRAME,
+         (unsigned)sizeof(TelemetrySample), (unsigned)sizeof(TelemetryMessage));
+  for (uint16_t rate : rates){
+    q8Telemetry telemetry;
+    uint32_t samples = 0, frames = 0, bytes = 0, worstUs = 0, lastSeq = 0;
+    cmd = CommandMessage();
+    cmd.special = CMD_TELEMETRY;
+    cmd.pos[0] = rate;
+    control.command(cmd);
+    simBus.resetStats();
+
+    uint64_t wake = simBus.now();
+    const uint32_t cycles = 1000;
+    for (uint32_t i = 0; i <= cycles; i++){
+      if (i == cycles){
+        cmd.pos[0] = 0;               // Stop, flushing the partial frame
+        control.command(cmd);
+      }
+      uint64_t start = simBus.now();
+      uint8_t events = control.cycle(micros());
+      bool full = false;
+      if (events & CYCLE_TELEMETRY){
+        q8JointState state;
+        q8.syncRead(state);
+        full = telemetry.add(state);
+        samples++;
+      }
+      if (full || ((events & CYCLE_TELEMETRY_END) && telemetry.pending())){
+        frames++;
+        bytes += telemetry.frameLen();
+        lastSeq = telemetry.frame().seq;
+        telemetry.sent(true);
+      }
+      uint32_t busUs = simBus.now() - start;
+      if (busUs > worstUs) worstUs = busUs;
+      wake += periodUs;
+      if (simBus.now() < wake) simBus.advance(wake - simBus.now());
+    }
+    printf("telemetry %3u Hz: %u samples in %u frames (last seq %u), %.1f kB/s on air, "
+           "worst cycle %u us of %u\n", rate, samples, frames, lastSeq,
+           bytes / (cycles * periodUs / 1e6) / 1000.0, worstUs, periodUs);
+  }
+  report("telemetry 250 Hz", 1000);
+
+  cmd = CommandMessage();
+  cmd.special = CMD_GAIT;
+  control.command(cmd);
+  control.cycle(micros());
+  simBus.resetStats();
+}
+
+void benchTrace(){
+  // Traced joint commands (CMD_FLAG_TRACE) arriving at any point of the
+  // control period. The RX task only runs once the control cycle is done.
+  q8Control control(q8, 4);
+  const uint32_t periodUs = control.periodMs() * 1000;
+  CommandMessage cmd;
+  q8CsvToCommand("0,0,0,0,0,0,0,0,0,0,1", cmd);
+  control.command(cmd);
+  control.cycle(micros());
+  simBus.resetStats();
+
+  std::vector<uint32_t> stage[4];
+  uint32_t seed = 7, lost = 0;
+  uint64_t wake = simBus.now();
+  for (uint16_t id = 1; id <= CYCLES * 2; id++){
+    seed = seed * 1103515245 + 12345;
+    uint64_t arrival = wake + (seed >> 8) % periodUs;
+    if (simBus.now() < arrival) simBus.advance(arrival - simBus.now());
+
+    char csv[64];
+    float q = 30 + (id % 20);
+    snprintf(csv, sizeof(csv), "%.1f,150,%.1f,150,%.1f,150,%.1f,150,0,0,1", q, q, q, q);
+    q8CsvToCommand(csv, cmd);
+    cmd.flags |= CMD_FLAG_TRACE;
+    q8TraceStamp stamp;
+    stamp.active = true;
+    stamp.id = id;
+    stamp.rxUs = arrival;
+    stamp.taskUs = micros();
+    control.command(cmd, &stamp);
+
+    wake += periodUs;
+    if (simBus.now() < wake) simBus.advance(wake - simBus.now());
+    if (control.cycle(micros()) & CYCLE_TRACE){
+      const TraceRecord& r = control.trace();
+      stage[0].push_back(r.queueUs);
+      stage[1].push_back(r.parseUs);
+      stage[2].push_back(r.latchUs);
+      stage[3].push_back(r.writeUs);
+      if (r.id != id) lost++;
+    } else {
+      lost++;
+    }
+  }
+
+  const char* names[] = {"queue", "parse", "latch", "write"};
+  printf("trace: %u of %u commands reported, %u TraceRecord per %u B frame\n",
+         (unsigned)stage[0].size() - lost, CYCLES * 2, TRACE_PER_FRAME,
+         (unsigned)sizeof(TraceMessage));
+  for (int i = 0; i < 4; i++){
+    std::sort(stage[i].begin(), stage[i].end());
+    size_t n = stage[i].size();
+    printf("  %-6s p50 %5u us  p99 %5u us  max %5u us\n", names[i], stage[i][n / 2],
+           stage[i][n * 99 / 100], stage[i][n - 1]);
+  }
+}
+
+void benchRxPool(){
+  // ESP-NOW receive path. Before: onRecv() filled a 264 B ESPNowMessage on
+  // its stack, xQueueSend and xQueueReceive copied it in and out of rxQueue
+  // and the RX task copied it once more into cmdMsg. Now the packet is copied
+  // once into a pool slot and the queue carries the pointer.
+  struct OldMessage{ uint8_t mac[6]; uint8_t data[250]; int len; uint32_t timestamp; };
+  const uint8_t POOL = 8;
+  const uint32_t n = 200000;
+  static OldMessage queueSlot, taskMsg;
+  static CommandMessage cmdMsg;
+  static q8PacketPool<POOL> pool;
+  uint8_t air[sizeof(CommandMessage) + sizeof(CommandTrace)] = {COMMAND, 0, CMD_FRAME_VERSION};
+  uint8_t mac[6] = {1, 2, 3, 4, 5, 6};
+  volatile uint32_t sink = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++){
+    OldMessage msg;
+    memcpy(msg.mac, mac, 6);
+    memcpy(msg.data, air, sizeof(air));
+    msg.len = sizeof(air);
+    msg.timestamp = i;
+    memcpy(&queueSlot, &msg, sizeof(msg));       // xQueueSend
+    asm volatile("" ::: "memory");
+    memcpy(&taskMsg, &queueSlot, sizeof(msg));   // xQueueReceive
+    memcpy(&cmdMsg, taskMsg.data, sizeof(cmdMsg));
+    asm volatile("" ::: "memory");
+    sink = sink + cmdMsg.version;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < n; i++){
+    q8Packet* packet = pool.acquire();
+    memcpy(packet->mac, mac, 6);
+    memcpy(packet->data, air, sizeof(air));
+    packet->data[sizeof(air)] = '\0';
+    packet->len = sizeof(air);
+    packet->timestamp = i;
+    q8Packet* queued;
+    memcpy(&queueSlot, &packet, sizeof(packet));  // xQueueSend
+    asm volatile("" ::: "memory");
+    memcpy(&queued, &queueSlot, sizeof(queued));  // xQueueReceive
+    const CommandMessage& cmd = *reinterpret_cast<const CommandMessage*>(queued->data);
+    sink = sink + cmd.version;
+    pool.release(queued);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  // Host memcpy hides most of the difference, the bytes moved are what the C3 pays for
+  printf("rx path: %u B traced command, copies %u B moved %.1f ns, pool %u B moved %.1f ns per packet; "
+         "RAM %u B before (queue of 10, 2 stack copies, cmdMsg), %u B pool + queue\n",
+         (unsigned)sizeof(air), (unsigned)(6 + sizeof(air) + 2 * sizeof(OldMessage) + sizeof(CommandMessage)),
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / n,
+         (unsigned)(6 + sizeof(air) + 2 * sizeof(q8Packet*)),
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / n,
+         (unsigned)(12 * sizeof(OldMessage) + sizeof(CommandMessage)),
+         (unsigned)(POOL * sizeof(q8Packet) + POOL * sizeof(q8Packet*)));
+
+  // Bursts arriving 150 us apart while the RX task is held off for a control
+  // cycle's servo write, then handles one packet per 40 us
+  const uint32_t bursts[] = {4, 8, 12, 16};
+  const uint32_t gapUs = 150, heldUs = 1200, handleUs = 40;
+  for (uint32_t burst : bursts){
+    q8PacketPool<POOL> burstPool;
+    std::deque<q8Packet*> rxQueue;
+    uint32_t handled = 0;
+    uint64_t taskFree = heldUs;
+    for (uint32_t k = 0; k < burst; k++){
+      uint64_t t = k * gapUs;
+      while (!rxQueue.empty() && taskFree + handleUs <= t){
+        taskFree += handleUs;
+        burstPool.release(rxQueue.front());
+        rxQueue.pop_front();
+        handled++;
+      }
+      q8Packet* packet = burstPool.acquire();
+      if (packet == nullptr) continue;
+      if (rxQueue.size() >= POOL){
+        burstPool.drop(packet);
+        continue;
+      }
+      rxQueue.push_back(packet);
+    }
+    while (!rxQueue.empty()){
+      burstPool.release(rxQueue.front());
+      rxQueue.pop_front();
+      handled++;
+    }
+    const q8PacketPoolStats& st = burstPool.stats();
+    printf("rx burst %2u: %u handled, %lu exhausted, %lu queue full, peak %u of %u slots, %u free after\n",
+           burst, handled, (unsigned long)st.exhausted, (unsigned long)st.dropped, st.peak, POOL,
+           burstPool.available());
+  }
+  (void)sink;
+}
+
+// queuePrint() as the tasks used it, the queue copy stands in for xQueueSend
+struct TextMessage{ uint8_t type; char text[128]; };
+static TextMessage textSlot;
+void textPrint(uint8_t type, const char* format, ...){
+  TextMessage msg;
+  msg.type = type;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(msg.text, sizeof(msg.text), format, args);
+  va_end(args);
+  memcpy(&textSlot, &msg, sizeof(msg));
+  asm volatile("" ::: "memory");
+}
+
+void benchLog(){
+  // The control task's 10 s report and the heartbeat echo, before and after
+  const uint32_t n = 200000;
+  const char* report = "[CONTROL] %u cycles, %u writes, %u overruns, jitter %uus, exec %uus\n";
+  static q8LogRing<16> ring;
+  q8LogRecord r;
+  bool debugMode = false;
+
+  for (int debug = 0; debug < 2; debug++){
+    debugMode = debug;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n; i++){
+      textPrint(1, report, i, i - 3, 0u, 412u, 1873u);
+      textPrint(1, "[HEARTBEAT] Received, echoing back\n");
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n; i++){
+      if (debugMode){
+        ring.push(1, i, i - 3, 0, 412, 1873);
+        ring.push(6);
+      }
+      while (ring.pop(r)) {}    // Output task keeps up
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    printf("log debug %s: queuePrint %.1f ns, q8LogRing %.1f ns per report + heartbeat, "
+           "%u B vs %u B per message\n", debugMode ? "on " : "off",
+           std::chrono::duration<double, std::nano>(t1 - t0).count() / n,
+           std::chrono::duration<double, std::nano>(t2 - t1).count() / n,
+           (unsigned)sizeof(TextMessage), (unsigned)sizeof(q8LogRecord));
+  }
+
+  // Order and overflow: the output task falls behind by 40 records, then
+  // keeps pace. Records must come out in order, none twice, none made up.
+  q8LogRing<16> slow;
+  uint32_t pushed = 0, popped = 0, bad = 0;
+  int64_t last = -1;
+  for (uint32_t i = 0; i < 40; i++) slow.push(0, pushed++);
+  for (uint32_t round = 0; round < 1000; round++){
+    for (uint32_t k = 0; k < 5; k++) slow.push(0, pushed++);
+    for (uint32_t k = 0; k < 5 && slow.pop(r); k++){
+      if ((int64_t)r.args[0] <= last) bad++;
+      last = r.args[0];
+      popped++;
+    }
+  }
+  while (slow.pop(r)) popped++;
+  printf("log ring: %u pushed, %u popped, %lu dropped while full, %u out of order\n",
+         pushed, popped, (unsigned long)slow.dropped(), bad);
+}
+
+enum OutputType : uint8_t { OUT_INFO, OUT_DEBUG };
+struct OutputFormat{
+  OutputType type;
+  const char* text;
+};
+const OutputFormat OUTPUT_FORMATS[] = {
+  {OUT_INFO,  "[CONTROL] %u info\n"},
+  {OUT_DEBUG, "[CONTROL] %u debug, %u cycles, %u writes, %u overruns\n"},
+};
+std::vector<std::string> outputWrites;
+
+void outputCapture(const uint8_t* data, size_t len){
+  outputWrites.push_back(std::string((const char*)data, len));
+}
+
+bool checkOutput(){
+  // The serialOutputTask wake of both boards on q8LogOutput, capturing what
+  // it hands to Serial.write:
+  //   burst   40 records into a 16 deep ring, every 4th INFO, debug mode off
+  //   long    30 queued messages of 40 bytes, more than one 512 byte write
+  //   quiet   a wake with nothing new, no drop line again
+  q8LogRing<16> ring;
+  q8LogOutput<512> output(outputCapture);
+  bool ok = true;
+
+  for (uint32_t i = 0; i < 40; i++){
+    if (i % 4 == 0) ring.push(0, i);
+    else ring.push(1, i, 1000 + i, 8 * i, 0);
+  }
+  output.append("[PAIRING] Paired successfully\n");
+  output.print(ring, OUTPUT_FORMATS, OUT_INFO);
+  output.reportDropped(ring.dropped());
+  output.flush();
+  const std::string burst = "[PAIRING] Paired successfully\n[CONTROL] 0 info\n[CONTROL] 4 info\n"
+                            "[CONTROL] 8 info\n[CONTROL] 12 info\n[LOG] 24 messages dropped\n";
+  ok &= outputWrites.size() == 1 && outputWrites[0] == burst;
+  printf("output burst: %u writes, %u bytes, %u of 40 records dropped: %s\n",
+         (unsigned)outputWrites.size(), (unsigned)outputWrites[0].size(), ring.dropped(),
+         ok ? "ok" : "FAILED");
+
+  outputWrites.clear();
+  std::string sent;
+  char text[48];
+  for (uint32_t i = 0; i < 30; i++){
+    snprintf(text, sizeof(text), "[SYNC] queued message %2u, padded to 40.\n", i);
+    sent += text;
+    output.append(text);
+  }
+  output.reportDropped(ring.dropped());
+  output.flush();
+  std::string received;
+  size_t largest = 0;
+  for (const std::string& w : outputWrites){
+    received += w;
+    largest = std::max(largest, w.size());
+  }
+  bool longOk = outputWrites.size() == 3 && largest <= 512 && received == sent;
+  printf("output long : %u bytes in %u writes of at most %u: %s\n",
+         (unsigned)sent.size(), (unsigned)outputWrites.size(), (unsigned)largest, longOk ? "ok" : "FAILED");
+
+  outputWrites.clear();
+  ring.push(1, 1, 2, 3, 4);
+  output.print(ring, OUTPUT_FORMATS, OUT_DEBUG);
+  output.reportDropped(ring.dropped());
+  output.flush();
+  bool quietOk = outputWrites.size() == 1 &&
+                 outputWrites[0] == "[CONTROL] 1 debug, 2 cycles, 3 writes, 4 overruns\n";
+  printf("output quiet: %u writes, drop line repeated: %s\n", (unsigned)outputWrites.size(),
+         quietOk ? "no" : "FAILED");
+  return ok && longOk && quietOk;
+}
+
+void benchConfig(){
+  // A flaky link: 50 times the heartbeat times out, unpair() clears the MAC
+  // and the same controller pairs again 300 ms later. Flash starts out with
+  // that controller saved.
+  //   per-key  macStorage, begin/put or remove/end on every call, RX task
+  //   record   q8Config, RAM only in the RX task, commit() every 100 ms
+  const uint8_t mac[6] = {0x34, 0x85, 0x18, 0x01, 0x02, 0x03};
+  const uint32_t cycles = 50;
+  for (int model = 0; model < 2; model++){
+    prefsSimErase();
+    q8Config config;
+    Preferences prefs;
+    if (model == 0){
+      prefs.begin("q8bot", false);
+      prefs.putBytes("peerMAC", mac, 6);
+      prefs.end();
+    } else{
+      config.begin();
+      config.savePeerMAC(mac, 1);
+      config.commit(millis(), true);
+    }
+    prefsSimResetStats();
+    for (uint32_t i = 0; i < cycles; i++){
+      for (uint32_t t = 0; t < 1000; t += 100){
+        if (t == 0 || t == 300){
+          if (model == 0){
+            prefs.begin("q8bot", false);
+            if (t == 0) prefs.remove("peerMAC");
+            else prefs.putBytes("peerMAC", mac, 6);
+            prefs.end();
+          } else if (t == 0){
+            config.clearPeerMAC();
+          } else{
+            config.savePeerMAC(mac, 1);
+          }
+        }
+        if (model == 1) config.commit(millis());
+        simBus.advance(100000);
+      }
+    }
+    for (uint32_t t = 0; model == 1 && t < 3000; t += 100){    // Link stays up
+      config.commit(millis());
+      simBus.advance(100000);
+    }
+    const PreferencesSimStats& st = prefsSimStats();
+    printf("config %-7s: %u unpair/pair cycles, %u flash writes, %u erases, %u opens, %u commits skipped\n",
+           model ? "record" : "per-key", cycles, st.writes, st.erases, st.opens,
+           model ? config.stats().skipped : 0u);
+  }
+
+  // Settings survive a reboot, i.e. a new instance on the same flash
+  uint16_t gain[CONFIG_JOINTS] = {400, 400, 800, 800, 400, 400, 800, 800};
+  uint8_t mac2[6] = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+  uint8_t out[6] = {0};
+  prefsSimErase();
+  prefsSimResetStats();
+  {
+    q8Config config;
+    config.begin();
+    config.savePeerMAC(mac2, 6);
+    config.setGain(gain);
+    config.setProfile(600);
+    config.commit(millis());                  // Too soon, nothing written
+    config.commit(millis(), true);
+  }
+  q8Config reboot;
+  reboot.begin();
+  uint16_t gainOut[CONFIG_JOINTS];
+  reboot.getGain(gainOut);
+  bool kept = reboot.loadPeerMAC(out) && memcmp(out, mac2, 6) == 0 && reboot.channel() == 6 &&
+              memcmp(gainOut, gain, sizeof(gain)) == 0 && reboot.profile() == 600;
+  printf("config reboot: %s in %u write\n", kept ? "settings kept" : "settings LOST",
+         prefsSimStats().writes);
+
+  // A record of another version is ignored rather than misread
+  q8ConfigRecord old;
+  old.version = CONFIG_VERSION + 1;
+  old.profile = 123;
+  Preferences prefs;
+  prefs.begin("q8bot", false);
+  prefs.putBytes("config", &old, sizeof(old));
+  prefs.end();
+  q8Config other;
+  other.begin();
+  bool defaults = !other.loadPeerMAC(out) && other.profile() == 1000;
+
+  // The MAC of the old per-key storage is taken over, and its key removed
+  prefsSimErase();
+  prefs.begin("q8bot", false);
+  prefs.putBytes("peerMAC", mac, 6);
+  prefs.end();
+  q8Config legacy;
+  legacy.begin();
+  bool migrated = legacy.loadPeerMAC(out) && memcmp(out, mac, 6) == 0;
+  legacy.commit(millis(), true);
+  prefs.begin("q8bot", true);
+  migrated &= prefs.getBytesLength("peerMAC") == 0 && prefs.getBytesLength("config") == sizeof(q8ConfigRecord);
+  prefs.end();
+  printf("config other version: %s, legacy MAC: %s\n",
+         defaults ? "defaults" : "MISREAD", migrated ? "migrated" : "NOT migrated");
+}
+
+// Both ends of the ESP-NOW link as main.cpp runs them, in 1 ms steps with 2 ms
+// air time. Before: the saved peer is used at boot only and dropped by
+// unpair(), the robot ignores pairing while paired. Now: unpair() keeps it and
+// both ends probe it with q8LinkProbe after a boot or a lost link.
+struct LinkSimMsg { uint32_t at; uint8_t type; };
+const uint32_t NEVER = 0xFFFFFFFF;
+
+struct LinkSimSide{
+  bool on = true, paired = true, saved = true;
+  uint32_t lastRx = 0, nextTask = 0, nextBroadcast = 0;
+  uint32_t probes = 0;
+  q8LinkProbe probe;
+  std::deque<LinkSimMsg> inbox;
+};
+
+uint32_t linkSim(bool fast, bool autoMode, uint32_t robotOff, uint32_t robotOn,
+                 uint32_t ctlOff, uint32_t ctlOn, uint32_t& probes){
+  const uint32_t air = 2, end = 30000, HEARTBEAT_MS = 2000;
+  LinkSimSide ctl, robot;
+  uint32_t firstCmd = NEVER, up = std::max(robotOn, ctlOn);
+  auto send = [&](LinkSimSide& to, uint8_t type, uint32_t t){
+    if (to.on) to.inbox.push_back({t + air, type});   // Lost if the receiver is off
+  };
+
+  for (uint32_t t = 0; t < end && firstCmd == NEVER; t++){
+    // Power: off drops everything in flight, on boots with what flash holds
+    if (t == robotOff) { robot.on = false; robot.inbox.clear(); }
+    if (t == ctlOff) { ctl.on = false; ctl.inbox.clear(); }
+    if (t == robotOn){
+      robot.on = true;
+      robot.paired = robot.saved;
+      robot.lastRx = t;
+      robot.nextTask = t + 1000;
+      if (fast && robot.saved) robot.probe.start(t);
+    }
+    if (t == ctlOn){
+      ctl.on = true;
+      ctl.paired = ctl.saved;
+      ctl.lastRx = t;
+      ctl.nextTask = t + HEARTBEAT_MS;
+      ctl.nextBroadcast = t;
+      if (fast && ctl.saved) ctl.probe.start(t);
+    }
+
+    // Controller: handlePacket(), pairingTask, heartbeatTask, commands at 50 Hz
+    while (ctl.on && !ctl.inbox.empty() && ctl.inbox.front().at <= t){
+      uint8_t type = ctl.inbox.front().type;
+      ctl.inbox.pop_front();
+      ctl.lastRx = t;
+      if (type == PAIRING){
+        if (fast){
+          ctl.probe.stop();
+          send(robot, HEARTBEAT, t);
+        }
+        ctl.paired = ctl.saved = true;
+      }
+    }
+    if (ctl.on && ctl.probe.active()){
+      if (ctl.probe.poll(t) == PROBE_SEND){
+        send(robot, PAIRING, t);
+        ctl.probes++;
+      }
+      ctl.nextBroadcast = t;
+    } else if (ctl.on && !ctl.paired && t >= ctl.nextBroadcast){
+      send(robot, PAIRING, t);
+      ctl.nextBroadcast = t + 2000;
+    }
+    if (ctl.on && t >= ctl.nextTask){
+      ctl.nextTask += HEARTBEAT_MS;
+      if (ctl.paired){
+        send(robot, HEARTBEAT, t);
+        if (autoMode && t - ctl.lastRx > 5000){
+          ctl.paired = false;
+          if (fast) ctl.probe.start(t);
+          else ctl.saved = false;
+        }
+      }
+    }
+    if (ctl.on && ctl.paired && t % 20 == 0){    // The PC sends at 50 Hz regardless
+      send(robot, COMMAND, t);
+    }
+
+    // Robot: handlePacket(), heartbeatMonitorTask
+    while (robot.on && !robot.inbox.empty() && robot.inbox.front().at <= t){
+      uint8_t type = robot.inbox.front().type;
+      robot.inbox.pop_front();
+      if (fast && robot.probe.stop() && !robot.paired){
+        robot.paired = true;
+        robot.lastRx = t;
+      }
+      if (type == PAIRING && (!robot.paired || fast)){
+        robot.paired = robot.saved = true;
+        robot.lastRx = t;
+        send(ctl, PAIRING, t);
+      } else if (robot.paired && type == HEARTBEAT){
+        robot.lastRx = t;
+        send(ctl, HEARTBEAT, t);
+      } else if (robot.paired && type == COMMAND){
+        robot.lastRx = t;
+        if (t >= up) firstCmd = t;
+      }
+    }
+    if (robot.on && fast && robot.probe.poll(t) == PROBE_SEND){
+      send(ctl, PAIRING, t);
+      robot.probes++;
+    }
+    if (robot.on && t >= robot.nextTask){
+      robot.nextTask += 1000;
+      if (autoMode && robot.paired && t - robot.lastRx > 5000){
+        robot.paired = false;
+        if (fast) robot.probe.start(t);
+        else robot.saved = false;
+      }
+    }
+  }
+  probes = ctl.probes + robot.probes;
+  return firstCmd == NEVER ? NEVER : firstCmd - up;
+}
+
+void benchLink(){
+  // The controller streams commands at 50 Hz whenever paired. Time from the
+  // later of the two boots to the first command the robot takes.
+  struct Outage { const char* name; uint32_t robotOff, robotOn, ctlOff, ctlOn; };
+  const Outage outages[] = {
+    {"robot brownout 0.3 s",        1000, 1300, NEVER, 0},
+    {"controller reset 0.3 s",      NEVER, 0, 1000, 1300},
+    {"both, robot back first",      1000, 1300, 1000, 1800},
+    {"both, controller back first", 1000, 1800, 1000, 1300},
+    {"robot off 8 s",               1000, 9000, NEVER, 0},
+    {"controller off 8 s",          NEVER, 0, 1000, 9000},
+  };
+  for (int autoMode = 1; autoMode >= 0; autoMode--){
+    for (const Outage& o : outages){
+      uint32_t oldProbes, newProbes;
+      uint32_t before = linkSim(false, autoMode, o.robotOff, o.robotOn, o.ctlOff, o.ctlOn, oldProbes);
+      uint32_t after = linkSim(true, autoMode, o.robotOff, o.robotOn, o.ctlOff, o.ctlOn, newProbes);
+      char was[16], now[16];
+      snprintf(was, sizeof(was), before == NEVER ? "never" : "%u ms", before);
+      snprintf(now, sizeof(now), after == NEVER ? "never" : "%u ms", after);
+      printf("link %-9s %-28s first command: %8s before, %8s now, %u probes\n",
+             autoMode ? "auto" : "permanent", o.name, was, now, newProbes);
+    }
+  }
+}
+
+void benchLinkStats(){
+  // 10 min of heartbeats as heartbeatTask sends them, each way lost with
+  // probability p. RTT is 2-5 ms with a 20 ms retry now and then. In teleop
+  // the controller streams commands and the robot telemetry every 10 ms.
+  const float losses[] = {0.0f, 0.05f, 0.2f};
+  uint32_t seed = 11;
+  auto next = [&seed](){ seed = seed * 1103515245 + 12345; return (seed >> 8) & 0xFFFF; };
+  for (int teleop = 0; teleop < 2; teleop++){
+    for (float p : losses){
+      q8LinkStats ctl, robot;
+      uint16_t seq = 0, lastSeq = 0, echoSeq = 0;
+      uint32_t sent = 0, skipped = 0, rttUs = 0, lastData = 0;
+      for (uint32_t t = 0; t < 600000;){
+        uint32_t interval = 2000;
+        for (uint32_t k = lastData; teleop && k < t; k += 10){
+          if (next() >= p * 65536) lastData = k;         // Telemetry frame arrived
+        }
+        if (teleop && t - lastData < 2000){
+          skipped++;
+          lastSeq = 0;
+        } else{
+          if (lastSeq != 0 && echoSeq != lastSeq) interval = 250;
+          lastSeq = ++seq;
+          sent++;
+          if (next() >= p * 65536){                       // Reached the robot
+            robot.received(seq);
+            if (rttUs) robot.rtt(rttUs);
+            if (next() >= p * 65536){                     // Echo came back
+              rttUs = 2000 + next() % 3000 + (next() < 1311 ? 20000 : 0);
+              ctl.received(seq);
+              ctl.rtt(rttUs);
+              echoSeq = seq;
+            }
+          }
+        }
+        t += interval;
+      }
+      q8LinkQuality c = ctl.summary(), r = robot.summary();
+      printf("heartbeat loss %2.0f%%%s: %u sent, %u skipped", p * 100, teleop ? " teleop" : "", sent, skipped);
+      if (!teleop){
+        printf("; loss %u/1000 (%u of %u, true %.0f), at the robot %u/1000 (true %.0f); RTT min %u, mean %u, p99 %u us",
+               c.lossPermille, c.lost, c.lost + c.received, 1000 * (1 - (1 - p) * (1 - p)),
+               r.lossPermille, 1000 * p, c.rttMinUs, c.rttMeanUs, c.rttP99Us);
+      }
+      printf("\n");
+    }
+  }
+
+  // The link dies right after an echo: how long past HEARTBEAT_TIMEOUT (5 s)
+  // does heartbeatTask notice, with and without the retry interval?
+  for (int retry = 0; retry < 2; retry++){
+    uint32_t t = 2000;                    // First heartbeat without an echo
+    while (t <= 5000) t += retry ? 250 : 2000;
+    printf("timeout noticed %u ms after the last echo %s\n", t, retry ? "with 250 ms retry" : "at 2 s heartbeats");
+  }
+}
+
+void benchSyncStart(){
+  // Eight robots hold a move and wait for one group start. Their 4 ms loops
+  // run at random phases, and each hears the first SYNC_START copy that gets
+  // through, 0-50 us apart. The controller sends three copies 400 us apart
+  // for a start 20 ms after the first.
+  const uint8_t ROBOTS = 8, COPIES = 3;
+  const uint32_t AIR_US = 400, SEND_US = 10000, DELAY_US = 20000, TRIALS = 200;
+  const float losses[] = {0.0f, 0.2f};
+  uint32_t seed = 7;
+  auto next = [&seed](){ seed = seed * 1103515245 + 12345; return (seed >> 8) & 0xFFFF; };
+  CommandMessage cmd;
+  cmd.flags = CMD_FLAG_HOLD;
+  for (uint8_t i = 0; i < 8; i++) cmd.pos[i] = 2048 + 100 * (i & 1);
+
+  for (int rephase = 0; rephase < 2; rephase++){
+    for (float p : losses){
+      uint32_t worst = 0, missed = 0;
+      uint64_t spreadSum = 0;
+      for (uint32_t trial = 0; trial < TRIALS; trial++){
+        uint32_t first = UINT32_MAX, last = 0;
+        for (uint8_t r = 0; r < ROBOTS; r++){
+          q8Control control(q8, CONTROL_PERIOD_US / 1000);
+          control.command(cmd);
+
+          // First copy this robot hears, in µs from the start of its run
+          uint32_t rxUs = 0, delayUs = 0, skew = next() % 50;
+          for (uint8_t k = 0; k < COPIES && rxUs == 0; k++){
+            if (next() >= p * 65536){
+              rxUs = SEND_US + k * AIR_US + skew;
+              delayUs = DELAY_US - k * AIR_US;
+            }
+          }
+          if (rxUs == 0){
+            missed++;
+            continue;
+          }
+
+          uint64_t base = simBus.now();
+          uint32_t wake = next() % CONTROL_PERIOD_US, writes = 0;
+          bool heard = false;
+          while (wake < SEND_US + 2 * DELAY_US){
+            if (simBus.now() < base + wake) simBus.advance(base + wake - simBus.now());
+            if (!heard && rxUs <= wake){
+              heard = true;
+              control.startHeld(base + rxUs + delayUs);
+            }
+            control.cycle(micros());
+            if (control.stats().writes != writes){
+              first = std::min(first, wake);
+              last = std::max(last, wake);
+              break;
+            }
+            writes = control.stats().writes;
+            int32_t in = rephase ? control.startIn(micros()) : -1;
+            wake = in >= 0 ? micros() - base + in : wake + CONTROL_PERIOD_US;
+          }
+        }
+        if (last >= first){
+          spreadSum += last - first;
+          worst = std::max(worst, last - first);
+        }
+      }
+      printf("group start%s, %2.0f%% copy loss: spread over %u robots mean %u us, worst %u us; "
+             "%u of %u robots missed all copies\n", rephase ? " on its own tick" : " at the next tick",
+             p * 100, ROBOTS, (uint32_t)(spreadSum / TRIALS), worst, missed, ROBOTS * TRIALS);
+    }
+  }
+}
+
+void benchMotion(){
+  // Motions run from the control cycle; runCycles returns when the motion ends
+  q8Control control(q8, 4);
+  const uint32_t periodUs = control.periodMs() * 1000;
+  uint64_t wake = simBus.now();
+  auto runCycles = [&](uint32_t maxCycles, uint32_t stopAt){
+    uint32_t n = 0;
+    do {
+      if (n == stopAt) control.requestStop();
+      control.cycle(micros());
+      wake += periodUs;
+      if (simBus.now() < wake) simBus.advance(wake - simBus.now());
+      n++;
+    } while (control.motionActive() && n < maxCycles);
+    return n;
+  };
+
+  CommandMessage cmd;
+  q8CsvToCommand("0,0,0,0,0,0,0,0,0,0,1", cmd);
+  control.command(cmd);
+  control.cycle(micros());
+  const char* names[] = {"jump", "greet", "show_range"};
+  for (uint8_t id = MOTION_JUMP; id <= MOTION_SHOW_RANGE; id++){
+    cmd = CommandMessage();
+    cmd.special = CMD_MOTION;
+    cmd.pos[0] = id;
+    control.command(cmd);
+    control.resetStats();
+    simBus.resetStats();
+    uint32_t cycles = runCycles(10000, UINT32_MAX);
+    const q8ControlStats& st = control.stats();
+    printf("motion %-10s %5u ms (%u ms of keyframes), %u writes, max cycle %u us, %u overruns\n",
+           names[id], cycles * control.periodMs(), q8Motion::durationMs(id), st.writes,
+           st.maxExecUs, st.overruns);
+  }
+
+  // Torque off 500 ms into a jump
+  cmd = CommandMessage();
+  cmd.special = CMD_JUMP;
+  control.command(cmd);
+  uint32_t cycles = runCycles(10000, 500 / control.periodMs());
+  printf("motion jump stopped after %u ms by torque off\n", cycles * control.periodMs());
+  simBus.resetStats();
+}
+
+void benchRecord(){
+  // 10 s of recording at 250 Hz into the robot's 1024 sample buffer
+  struct Sample{ uint16_t data[4]; };
+  const uint32_t samples = 2500;
+  for (int overwrite = 0; overwrite < 2; overwrite++){
+    static q8Ring<Sample, 1024> ring;
+    ring = q8Ring<Sample, 1024>(overwrite);
+    Sample s;
+    for (uint32_t i = 0; i < samples; i++){
+      s.data[0] = i;
+      ring.push(s);
+    }
+    uint32_t count = ring.size();
+    uint16_t first = 0, last = 0;
+    for (uint32_t i = 0; ring.pop(s); i++){
+      if (i == 0) first = s.data[0];
+      last = s.data[0];
+    }
+    printf("record %s: %u samples kept (%u..%u), %lu dropped\n", overwrite ? "overwrite" : "stop",
+           (unsigned)count, first, last, (unsigned long)ring.dropped());
+  }
+}
+
+// Replay an onboard gait (TROT forward) as a stream of joint frames from the
+// PC, profile 0, with 1-2.5 ms of air and queue latency and random frame
+// loss. Tracking error is that of the goal positions written to the servos
+// against the gait, after taking out the latency each playback adds. (The
+// trot is faster than the simulated XL330 can follow, so the servo positions
+// would mostly measure the servo.)
+void benchSmoothing(){
+  const uint32_t RUN_MS = 4000, SKIP_MS = 200, MAX_LAG_MS = 60;
+  const float DEG_PER_TICK = 360.0f / 4096;
+  std::vector<float> ref((RUN_MS + 1) * 8);
+  {
+    q8Gait gait;
+    q8Kinematics leg[4];
+    float feet[8];
+    gait.start(0, GAIT_F);
+    for (uint32_t ms = 0; ms <= RUN_MS; ms++){
+      gait.tick(1, feet);
+      for (uint8_t j = 0; j < 4; j++){
+        float q1, q2;
+        leg[j].ikSolve(feet[j*2], feet[j*2+1], q1, q2);
+        ref[ms*8 + j*2] = q8Deg2Dxl(q1);
+        ref[ms*8 + j*2 + 1] = q8Deg2Dxl(q2);
+      }
+    }
+  }
+  auto refAt = [&ref, RUN_MS](float ms, uint8_t j){
+    ms = ms < 0 ? 0 : (ms > RUN_MS - 1 ? RUN_MS - 1 : ms);
+    uint32_t i = ms;
+    return ref[i*8 + j] + (ref[(i+1)*8 + j] - ref[i*8 + j]) * (ms - i);
+  };
+
+  const uint32_t intervals[] = {GAIT_SAMPLE_MS * 1000, 20000};
+  const float losses[] = {0.0f, 0.1f, 0.2f, 0.3f};
+  const SmoothMode modes[] = {SMOOTH_OFF, SMOOTH_LINEAR, SMOOTH_CUBIC};
+  const char* names[] = {"hold", "linear", "cubic"};
+  for (uint32_t interval : intervals){
+    for (float p : losses){
+      for (uint8_t m = 0; m < 3; m++){
+        q8Control control(q8, CONTROL_PERIOD_US / 1000);
+        control.setSmoothing(modes[m] == SMOOTH_OFF ? SMOOTH_DISABLED
+                                                    : q8SmoothConfig{modes[m], STALE_HOLD, 2, 1, 250, 100});
+        CommandMessage cmd;
+        cmd.flags = CMD_FLAG_TORQUE | CMD_FLAG_TORQUE_ON | CMD_FLAG_PROFILE;
+        cmd.profile = 0;
+        control.command(cmd);
+        control.cycle(micros());
+        cmd.flags = 0;
+        for (uint8_t j = 0; j < 8; j++) cmd.pos[j] = refAt(0, j);
+        control.command(cmd);
+        control.cycle(micros());
+        simBus.advance(300000);
+
+        uint32_t seed = 5, frames = 0, lost = 0;
+        uint64_t base = simBus.now(), send = base, wake = base + 1700;
+        std::deque<std::pair<uint64_t, uint32_t>> air;   // Arrival, frame number
+        std::vector<float> samples;                      // Time (ms), then 8 goals
+        float prevGoal[8] = {0}, maxStep = 0;
+        control.resetStats();
+        while (wake < base + RUN_MS * 1000){
+          while (send <= wake){
+            seed = seed * 1103515245 + 12345;
+            if (((seed >> 8) & 0xFFFF) >= p * 65536){
+              seed = seed * 1103515245 + 12345;
+              air.push_back({send + 1000 + (seed >> 8) % 1500, frames});
+            } else {
+              lost++;
+            }
+            frames++;
+            send += interval;
+          }
+          while (!air.empty() && air.front().first <= wake){
+            simBus.advance(air.front().first - simBus.now());
+            uint32_t k = air.front().second;
+            for (uint8_t j = 0; j < 8; j++) cmd.pos[j] = lroundf(refAt(k * interval / 1000.0f, j));
+            cmd.seq = 1 + k;
+            control.command(cmd);
+            air.pop_front();
+          }
+          if (simBus.now() < wake) simBus.advance(wake - simBus.now());
+          control.cycle(micros());
+
+          samples.push_back((simBus.now() - base) / 1000.0f);
+          for (uint8_t j = 0; j < 8; j++){
+            float goal = static_cast<int32_t>(simBus.servo(j)->get(dxlSimAddr::GOAL_POSITION, 4));
+            if (samples.size() > 9) maxStep = std::max(maxStep, fabsf(goal - prevGoal[j]));
+            prevGoal[j] = goal;
+            samples.push_back(goal);
+          }
+          wake += CONTROL_PERIOD_US;
+        }
+
+        // Error against the gait as the PC computed it, latency included,
+        // then the latency that fits best
+        double rms0 = 0, max0 = 0, bestRms = 1e9;
+        uint32_t bestLag = 0;
+        for (uint32_t lag = 0; lag <= MAX_LAG_MS; lag++){
+          double sum = 0, worst = 0;
+          uint32_t n = 0;
+          for (size_t i = 0; i < samples.size(); i += 9){
+            if (samples[i] < SKIP_MS) continue;
+            for (uint8_t j = 0; j < 8; j++){
+              double e = samples[i + 1 + j] - refAt(samples[i] - lag, j);
+              sum += e * e;
+              worst = std::max(worst, fabs(e));
+              n++;
+            }
+          }
+          double rms = sqrt(sum / n);
+          if (lag == 0){
+            rms0 = rms;
+            max0 = worst;
+          }
+          if (rms < bestRms){
+            bestRms = rms;
+            bestLag = lag;
+          }
+        }
+        const q8SmoothStats& sm = control.smoother().stats();
+        printf("smoothing %2u ms stream, %2.0f%% loss (%3u lost), %-6s: error RMS %.2f deg, max %.2f deg, "
+               "lag %2u ms; largest goal step %.2f deg, %u writes, %u cycles extrapolated\n",
+               interval / 1000, p * 100, lost, names[m], rms0 * DEG_PER_TICK, max0 * DEG_PER_TICK,
+               bestLag, maxStep * DEG_PER_TICK, control.stats().writes, sm.extrapolated);
+      }
+    }
+  }
+
+  // Stream stops: hold, or go limp, once the staleness timeout has passed
+  const SmoothStale stales[] = {STALE_HOLD, STALE_LIMP};
+  for (SmoothStale stale : stales){
+    q8Control control(q8, CONTROL_PERIOD_US / 1000);
+    control.setSmoothing({SMOOTH_LINEAR, stale, 2, 1, 250, 100});
+    CommandMessage cmd;
+    cmd.flags = CMD_FLAG_TORQUE | CMD_FLAG_TORQUE_ON | CMD_FLAG_PROFILE;
+    control.command(cmd);
+    control.cycle(micros());
+    cmd.flags = 0;
+    uint64_t base = simBus.now(), lastFrame = 0, staleAt = 0;
+    for (uint32_t i = 0; i < 500 && staleAt == 0; i++){
+      if (i < 100 && i % 2 == 0){
+        for (uint8_t j = 0; j < 8; j++) cmd.pos[j] = lroundf(refAt(i * 4, j));
+        cmd.seq = 1 + i / 2;
+        control.command(cmd);
+        lastFrame = simBus.now();
+      }
+      if (control.cycle(micros()) & CYCLE_STREAM_STALE) staleAt = simBus.now();
+      simBus.advance(base + (i + 1) * CONTROL_PERIOD_US - simBus.now());
+    }
+    printf("smoothing stream stopped, %s: stale after %u ms, torque %s\n",
+           stale == STALE_HOLD ? "hold" : "limp", (uint32_t)((staleAt - lastFrame) / 1000),
+           simBus.servo(0)->torque() ? "on" : "off");
+  }
+}
+
+int main(int argc, char** argv){
+  // Eight servos as left by q8bot_motor_config: IDs 11-18 at 1 Mbps
+  const uint8_t driveMode[8] = {4, 4, 5, 5, 4, 4, 5, 5};
+  for (uint8_t i = 0; i < 8; i++){
+    dxlSimServo* s = simBus.addServo(11 + i, 3);
+    s->set(dxlSimAddr::DRIVE_MODE, 1, driveMode[i]);
+  }
+
+  int32_t idle[8];
+  for (uint8_t i = 0; i < 8; i++){
+    idle[i] = q8Deg2Dxl(i % 2 ? 150 : 30);
+  }
+
+  printf("%-22s %6s %8s %8s %8s %9s %8s  %s\n", "operation", "calls", "txn/call",
+         "tx B", "rx B", "bus us", "of 4ms", "timeouts");
+
+  q8.begin();
+  report("begin", 1);
+
+  q8.enableTorque();
+  report("enableTorque", 1);
+
+  for (uint32_t i = 0; i < CYCLES; i++){
+    q8.bulkWrite(idle);
+  }
+  report("bulkWrite", CYCLES);
+
+  uint64_t allocs = allocCount;
+  for (uint32_t i = 0; i < CYCLES; i++){
+    uint16_t* data = q8.syncRead();
+    delete[] data;
+  }
+  double legacyAllocs = static_cast<double>(allocCount - allocs) / CYCLES;
+  report("syncRead", CYCLES);
+
+  q8JointState state;
+  uint32_t complete = 0;
+  allocs = allocCount;
+  for (uint32_t i = 0; i < CYCLES; i++){
+    complete += q8.syncRead(state);
+  }
+  double stateAllocs = static_cast<double>(allocCount - allocs) / CYCLES;
+  report("syncRead (state)", CYCLES);
+  simBus.servo(2)->set(dxlSimAddr::ID, 1, 99);    // Unplug joint 3
+  bool all = q8.syncRead(state);
+  simBus.servo(2)->set(dxlSimAddr::ID, 1, 13);
+  simBus.resetStats();
+  printf("syncRead allocations/call: %.1f legacy, %.1f into q8JointState (%u/%u complete)\n",
+         legacyAllocs, stateAllocs, (unsigned)complete, (unsigned)CYCLES);
+  printf("syncRead with joint 3 unplugged: complete %d, mask 0x%02X\n", all, state.okMask);
+
+  uint16_t values[16];
+  for (uint32_t i = 0; i < CYCLES; i++){
+    q8.bulkWrite(idle);
+    q8.syncRead(values);
+  }
+  report("bulkWrite + syncRead", CYCLES);
+
+  q8.setProfile(500);
+  report("setProfile", 1);
+
+  const uint16_t durs[8] = {300, 330, 360, 390, 420, 450, 480, 510};
+  q8.setProfile(durs);
+  report("setProfile (per joint)", 1);
+
+  const uint16_t gains[8] = {400, 410, 420, 430, 440, 450, 460, 470};
+  q8.setGain(gains);
+  report("setGain (per joint)", 1);
+
+  bool applied = true;
+  for (uint8_t i = 0; i < 8; i++){
+    dxlSimServo* s = simBus.servo(i);
+    applied &= s->get(dxlSimAddr::PROFILE_VELOCITY, 4) == durs[i];
+    applied &= s->get(dxlSimAddr::PROFILE_ACCELERATION, 4) == durs[i] / 3u;
+    applied &= s->get(dxlSimAddr::POSITION_P_GAIN, 2) == gains[i];
+  }
+  simBus.resetStats();
+  printf("per joint profile/gain registers applied: %s\n", applied ? "yes" : "NO");
+
+  for (uint32_t i = 0; i < CYCLES; i++){
+    q8.setProfile(200 + (i % 2) * 100);
+    q8.bulkWrite(idle);
+  }
+  report("setProfile + bulkWrite", CYCLES);
+
+  for (uint32_t i = 0; i < CYCLES; i++){
+    q8.moveTimed(idle, durs);
+  }
+  report("moveTimed (per joint)", CYCLES);
+
+  applied = true;
+  for (uint8_t i = 0; i < 8; i++){
+    dxlSimServo* s = simBus.servo(i);
+    applied &= s->get(dxlSimAddr::PROFILE_VELOCITY, 4) == durs[i];
+    applied &= s->get(dxlSimAddr::PROFILE_ACCELERATION, 4) == durs[i] / 3u;
+    applied &= static_cast<int32_t>(s->get(dxlSimAddr::GOAL_POSITION, 4)) == idle[i];
+  }
+  simBus.resetStats();
+  printf("timed move profile/goal registers applied: %s\n", applied ? "yes" : "NO");
+
+  bool ok = checkDecoder(argc > 2 ? argv[2] : "src/native/command_fixture.txt");
+  benchKinematics();
+  benchGait(argc > 1 ? argv[1] : nullptr);
+  benchControl();
+  benchMotion();
+  benchRecord();
+  benchTelemetry();
+  benchTrace();
+  benchRxPool();
+  benchLog();
+  ok &= checkOutput();
+  benchConfig();
+  benchLink();
+  benchLinkStats();
+  benchSyncStart();
+  benchSmoothing();
+  benchBulk();
+  benchBus();
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+/*
+  q8Config.cpp - NVS settings record. See q8Config.h.
+*/
+
+#include <q8Config.h>
+
+const char* CONFIG_KEY = "config";
+const char* LEGACY_MAC_KEY = "peerMAC";   // macStorage, before the record
+
+bool q8Config::begin(const char* name){
+  if (!_prefs.begin(name, false)) return false;
+  if (_prefs.getBytesLength(CONFIG_KEY) == sizeof(q8ConfigRecord)){
+    q8ConfigRecord stored;
+    _prefs.getBytes(CONFIG_KEY, &stored, sizeof(stored));
+    if (stored.version == CONFIG_VERSION){
+      _ram = stored;
+      _flash = stored;
+    }
+  }
+  if (_prefs.getBytesLength(LEGACY_MAC_KEY) == 6){
+    _legacyKey = true;
+    if (!(_ram.flags & CONFIG_HAS_PEER)){
+      _prefs.getBytes(LEGACY_MAC_KEY, _ram.peerMac, 6);
+      _ram.flags |= CONFIG_HAS_PEER;
+      _touch();
+    }
+  }
+  return true;
+}
+
+bool q8Config::loadPeerMAC(uint8_t* mac){
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!(_ram.flags & CONFIG_HAS_PEER)) return false;
+  memcpy(mac, _ram.peerMac, 6);
+  return true;
+}
+
+void q8Config::savePeerMAC(const uint8_t* mac, uint8_t channel){
+  std::lock_guard<std::mutex> guard(_lock);
+  if ((_ram.flags & CONFIG_HAS_PEER) && memcmp(_ram.peerMac, mac, 6) == 0 && _ram.channel == channel) return;
+  memcpy(_ram.peerMac, mac, 6);
+  _ram.channel = channel;
+  _ram.flags |= CONFIG_HAS_PEER;
+  _touch();
+}
+
+void q8Config::clearPeerMAC(){
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!(_ram.flags & CONFIG_HAS_PEER)) return;
+  _ram.flags &= ~CONFIG_HAS_PEER;
+  memset(_ram.peerMac, 0, 6);
+  _touch();
+}
+
+uint8_t q8Config::channel(){
+  std::lock_guard<std::mutex> guard(_lock);
+  return _ram.channel;
+}
+
+void q8Config::getGain(uint16_t gain[CONFIG_JOINTS]){
+  std::lock_guard<std::mutex> guard(_lock);
+  memcpy(gain, _ram.gain, sizeof(_ram.gain));
+}
+
+void q8Config::setGain(const uint16_t gain[CONFIG_JOINTS]){
+  std::lock_guard<std::mutex> guard(_lock);
+  if (memcmp(_ram.gain, gain, sizeof(_ram.gain)) == 0) return;
+  memcpy(_ram.gain, gain, sizeof(_ram.gain));
+  _touch();
+}
+
+uint16_t q8Config::profile(){
+  std::lock_guard<std::mutex> guard(_lock);
+  return _ram.profile;
+}
+
+void q8Config::setProfile(uint16_t profile){
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_ram.profile == profile) return;
+  _ram.profile = profile;
+  _touch();
+}
+
+bool q8Config::commit(uint32_t now, bool force){
+  q8ConfigRecord record;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (!_changed || (!force && now - _changedAt < CONFIG_COMMIT_DELAY_MS)) return false;
+    record = _ram;
+    _changed = false;
+  }
+
+  if (_legacyKey){
+    _prefs.remove(LEGACY_MAC_KEY);
+    _legacyKey = false;
+  }
+  if (memcmp(&record, &_flash, sizeof(record)) == 0){
+    _stats.skipped++;             // Changed and changed back
+    return false;
+  }
+  if (_prefs.putBytes(CONFIG_KEY, &record, sizeof(record)) != sizeof(record)){
+    std::lock_guard<std::mutex> guard(_lock);
+    _changed = true;              // Try again on a later commit
+    return false;
+  }
+  _flash = record;
+  _stats.writes++;
+  return true;
+}
+
+bool q8Config::pending(){
+  std::lock_guard<std::mutex> guard(_lock);
+  return _changed;
+}
+
+void q8Config::_touch(){
+  _changed = true;
+  _changedAt = millis();
+}
@@ -0,0 +1,283 @@
+/*
+  q8Control.cpp - Fixed-rate control loop for the Q8bot robot. See q8Control.h.
+*/
+
+#include <Arduino.h>
+#include <q8Control.h>
+
+q8Control::q8Control(q8Dynamixel& dxl, uint32_t periodMs)
+  : _dxl(dxl), _periodMs(periodMs), _smooth(SMOOTH_DISABLED) {
+  resetStats();
+}
+
+uint8_t q8Control::command(const CommandMessage& cmd, const q8TraceStamp* trace){
+  switch (cmd.special){
+    case CMD_BATTERY:         // Answered by the caller, no motion
+    case CMD_SEND_RECORDED:
+      return cmd.special;
+
+    case CMD_GAIT:
+      _next.gait = cmd.pos[0];
+      _next.gaitDir = cmd.pos[1];
+      _next.gaitStride = cmd.pos[2];
+      _next.gaitPeriod = cmd.pos[3];
+      break;
+
+    case CMD_TELEMETRY:
+      _next.telemetryHz = cmd.pos[0] > 0 ? cmd.pos[0] : 0;
+      break;
+
+    case CMD_JUMP:
+    case CMD_MOTION:
+      _next.gaitDir = GAIT_STOP;
+      _next.motion = cmd.special == CMD_JUMP ? static_cast<uint8_t>(MOTION_JUMP) : cmd.pos[0];
+      _next.motionCount++;
+      break;
+
+    default: {
+      _next.gaitDir = GAIT_STOP;    // Joint commands take over from the gait
+      if (cmd.flags & CMD_FLAG_PROFILE){
+        _next.profile = cmd.profile;
+      }
+      // A torque change only toggles torque, same as executeCommand()
+      bool torqueChanged = false;
+      if (cmd.flags & CMD_FLAG_TORQUE){
+        bool on = (cmd.flags & CMD_FLAG_TORQUE_ON) != 0;
+        torqueChanged = (on != _next.torque);
+        _next.torque = on;
+      }
+      if (!torqueChanged){
+        memcpy(_next.pos, cmd.pos, sizeof(_next.pos));
+        _next.posSeq = cmd.seq;
+        _next.posUs = micros();
+        _next.footXY = (cmd.flags & CMD_FLAG_FOOT_XY) != 0;
+        _next.timed = (cmd.flags & CMD_FLAG_TIMED) != 0;
+        _next.posCount++;
+        if (cmd.flags & CMD_FLAG_RECORD) _next.recordCount++;
+      }
+      break;
+    }
+  }
+  _next.seq++;
+  _next.trace = trace ? *trace : q8TraceStamp();
+  _next.trace.postUs = micros();
+  if (cmd.flags & CMD_FLAG_HOLD){
+    _held = true;                 // Posted by startHeld()
+    return 0;
+  }
+  _held = false;
+  _mailbox.post(_next);
+  return 0;
+}
+
+bool q8Control::startHeld(uint32_t atUs){
+  if (!_held) return false;
+  _held = false;
+  _next.startAt = true;
+  _next.startUs = atUs;
+  _mailbox.post(_next);
+  _next.startAt = false;
+  return true;
+}
+
+uint8_t q8Control::commandCsv(const char* csv){
+  // Legacy CSV path. Joints missing from the string keep the current target.
+  CommandMessage cmd;
+  memcpy(cmd.pos, _next.pos, sizeof(cmd.pos));
+  q8CsvToCommand(csv, cmd);
+  return command(cmd);
+}
+
+void q8Control::requestStop(){
+  _stopRequest.store(true);
+}
+
+uint8_t q8Control::cycle(uint32_t startUs){
+  uint8_t events = 0;
+
+  if (_stats.cycles > 0){
+    uint32_t interval = startUs - _lastStartUs;
+    uint32_t periodUs = _periodMs * 1000;
+    uint32_t jitter = interval > periodUs ? interval - periodUs : periodUs - interval;
+    if (jitter > _stats.maxJitterUs) _stats.maxJitterUs = jitter;
+  }
+  _lastStartUs = startUs;
+  _stats.cycles++;
+
+  if (_stopRequest.exchange(false)){
+    _gait.stop();
+    _motion.stop();
+    _dxl.toggleTorque(0);        // Disable torque hardware
+    _dxl.resetTorqueState();     // Sync internal flag to match disabled state
+  }
+
+  // Latch the newest setpoint, if any, and apply state changes
+  q8Setpoint sp;
+  bool move = false;
+  bool traced = false;
+  uint32_t latchUs = 0;
+  bool latched = _mailbox.fetch(sp);
+  if (latched && sp.startAt && (int32_t)(sp.startUs - startUs) > 0){
+    _start = sp;                 // Group start still ahead
+    _starting = true;
+    latched = false;
+  } else if (latched){
+    _starting = false;           // A newer setpoint has the held state too
+  } else if (_starting && (int32_t)(startUs - _start.startUs) >= 0){
+    sp = _start;
+    _starting = false;
+    latched = true;
+  }
+  if (latched){
+    latchUs = micros();
+    traced = sp.trace.active;
+    _stats.setpoints++;
+    _dxl.updateTorque(sp.torque);
+    move = (sp.posCount != _sp.posCount);
+
+    // A motion runs until it ends, torque goes off or any other command comes in
+    if (sp.motionCount != _sp.motionCount){
+      _gait.stop();
+      if (!_motion.start(sp.motion)) events |= CYCLE_GAIT_REJECTED;
+    } else if (!sp.torque || move || sp.gaitDir != GAIT_STOP){
+      _motion.stop();
+    }
+
+    if (_motion.active()){
+      // Keyframes set their own profile
+    } else if (sp.gaitDir == GAIT_STOP){
+      _gait.stop();
+      if (!sp.timed) _dxl.updateProfile(sp.profile);   // Timed moves carry it along
+    } else if (!_gait.active() || sp.gait != _sp.gait || sp.gaitDir != _sp.gaitDir ||
+               sp.gaitStride != _sp.gaitStride || sp.gaitPeriod != _sp.gaitPeriod){
+      _dxl.updateProfile(0);     // Gait setpoints follow each other directly
+      if (!_gait.start(sp.gait, sp.gaitDir, sp.gaitStride, sp.gaitPeriod)){
+        events |= CYCLE_GAIT_REJECTED;
+      }
+    }
+
+    // Joint targets streamed without a servo profile are played back by the
+    // smoother; anything else that takes over the joints ends the stream
+    if (move && _smooth.config().mode != SMOOTH_OFF && sp.profile == 0 && !sp.timed &&
+        sp.torque && !_motion.active() && sp.gaitDir == GAIT_STOP){
+      if (sp.footXY != _sp.footXY) _smooth.reset();
+      _smooth.push(sp.pos, sp.posSeq, sp.posUs);
+    } else if (move || !sp.torque || _motion.active() || sp.gaitDir != GAIT_STOP){
+      _smooth.reset();
+    }
+
+    if (sp.recordCount != _sp.recordCount) events |= CYCLE_RECORD;
+    if (sp.telemetryHz != _sp.telemetryHz){
+      _telemetryAcc = 0;
+      if (sp.telemetryHz == 0) events |= CYCLE_TELEMETRY_END;
+    }
+    _sp = sp;
+  }
+
+  // Exactly one bulkWrite when there is a new target this cycle
+  if (_motion.active()){
+    if (_motion.tick(_periodMs, _dxl)) _stats.writes++;
+  } else if (_gait.active()){
+    float feet[8];
+    _gait.tick(_periodMs, feet);
+    _dxl.moveFeet(feet);
+    _stats.writes++;
+  } else if (_smooth.active()){
+    float target[8];
+    SmoothStep step = _smooth.target(startUs, target);
+    if (step == SMOOTH_WRITE){
+      _writeSmoothed(target);
+      _stats.writes++;
+    } else if (step == SMOOTH_STALE){
+      events |= CYCLE_STREAM_STALE;
+      if (_smooth.config().stale == STALE_LIMP){
+        _dxl.toggleTorque(0);      // The next joint command turns it back on
+        _dxl.resetTorqueState();
+      }
+    }
+  } else if (move){
+    _writeTarget();
+    _stats.writes++;
+  }
+
+  if (traced){
+    const q8TraceStamp& t = _sp.trace;
+    _trace.id = t.id;
+    _trace.ingestUs = t.ingestUs;
+    _trace.airUs = 0;
+    _trace.queueUs = q8TraceUs(t.taskUs - t.rxUs);
+    _trace.parseUs = q8TraceUs(t.postUs - t.taskUs);
+    _trace.latchUs = q8TraceUs(latchUs - t.postUs);
+    _trace.writeUs = q8TraceUs(micros() - latchUs);
+    events |= CYCLE_TRACE;
+  }
+
+  // Telemetry at telemetryHz, capped at one sample per cycle
+  if (_sp.telemetryHz > 0){
+    _telemetryAcc += _sp.telemetryHz * _periodMs;
+    if (_telemetryAcc >= 1000){
+      _telemetryAcc %= 1000;
+      events |= CYCLE_TELEMETRY;
+    }
+  }
+
+  uint32_t execUs = micros() - startUs;
+  if (execUs > _stats.maxExecUs) _stats.maxExecUs = execUs;
+  if (execUs > _periodMs * 1000) _stats.overruns++;
+  return events;
+}
+
+int32_t q8Control::startIn(uint32_t nowUs) const {
+  if (!_starting) return -1;
+  if ((int32_t)(_start.startUs - (_lastStartUs + _periodMs * 1000)) >= 0) return -1;
+  int32_t left = _start.startUs - nowUs;
+  return left > 0 ? left : 0;
+}
+
+void q8Control::setDefaultProfile(uint16_t dur){
+  _next.profile = dur;
+  _sp.profile = dur;
+}
+
+void q8Control::setSmoothing(const q8SmoothConfig& config){
+  _smooth.configure(config);
+}
+
+void q8Control::resetStats(){
+  memset(&_stats, 0, sizeof(_stats));
+  _smooth.resetStats();
+}
+
+void q8Control::_writeTarget(){
+  if (_sp.footXY){
+    float feet[8];
+    for (uint8_t i = 0; i < 8; i++){
+      feet[i] = static_cast<float>(_sp.pos[i]) / CMD_FOOT_SCALE;
+    }
+    if (_sp.timed) _dxl.moveFeet(feet, _sp.profile);
+    else _dxl.moveFeet(feet);
+  } else {
+    int32_t ticks[8];
+    for (uint8_t i = 0; i < 8; i++){
+      ticks[i] = _sp.pos[i];
+    }
+    if (_sp.timed) _dxl.moveTimed(ticks, _sp.profile);
+    else _dxl.bulkWrite(ticks);
+  }
+}
+
+void q8Control::_writeSmoothed(const float target[8]){
+  if (_sp.footXY){
+    float feet[8];
+    for (uint8_t i = 0; i < 8; i++){
+      feet[i] = target[i] / CMD_FOOT_SCALE;
+    }
+    _dxl.moveFeet(feet);
+  } else {
+    int32_t ticks[8];
+    for (uint8_t i = 0; i < 8; i++){
+      ticks[i] = lroundf(target[i]);
+    }
+    _dxl.bulkWrite(ticks);
+  }
+}
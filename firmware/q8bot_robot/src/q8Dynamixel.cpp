@@ -16,9 +16,10 @@ q8Dynamixel::q8Dynamixel(Dynamixel2Arduino& dxl) : _dxl(dxl) {
   // Initialize any other members if needed
 }
 
-void q8Dynamixel::begin(){
+bool q8Dynamixel::begin(const q8BusConfig& bus){
   _dxl.begin(_baudrate);
   _dxl.setPortProtocolVersion(_protocolVersion);
+  _findBus(bus.baudrate);    // Servos keep the rate of an earlier boot
   setOpMode();
 
   // Fill the members of structure for bulkWrite using internal packet buffer
@@ -53,8 +54,156 @@ void q8Dynamixel::begin(){
   }
   _sr_infos.is_info_changed = true;
 
+  // Fill the members of structures to syncWrite the profile and gain registers
+  // of all joints in one packet each, using internal packet buffer
+  _sw_profile_infos.packet.p_buf = nullptr;
+  _sw_profile_infos.packet.is_completed = false;
+  _sw_profile_infos.addr = SW_PROFILE_ADDR;
+  _sw_profile_infos.addr_length = sizeof(sw_profile_data_t);
+  _sw_profile_infos.p_xels = _info_xels_sw_profile;
+  _sw_profile_infos.xel_count = 0;
+
+  _sw_gain_infos.packet.p_buf = nullptr;
+  _sw_gain_infos.packet.is_completed = false;
+  _sw_gain_infos.addr = SW_GAIN_ADDR;
+  _sw_gain_infos.addr_length = sizeof(sw_gain_data_t);
+  _sw_gain_infos.p_xels = _info_xels_sw_gain;
+  _sw_gain_infos.xel_count = 0;
+
+  // Profile acceleration, velocity and goal position (108..119) in one packet
+  _sw_timed_infos.packet.p_buf = nullptr;
+  _sw_timed_infos.packet.is_completed = false;
+  _sw_timed_infos.addr = SW_PROFILE_ADDR;
+  _sw_timed_infos.addr_length = sizeof(sw_timed_data_t);
+  _sw_timed_infos.p_xels = _info_xels_sw_timed;
+  _sw_timed_infos.xel_count = 0;
+
+  for (int i = 0; i < _idCount; i++){
+    _info_xels_sw_profile[i].id = _DXL[i];
+    _info_xels_sw_profile[i].p_data = reinterpret_cast<uint8_t*>(&_sw_profile_data[i]);
+    _sw_profile_infos.xel_count++;
+    _info_xels_sw_gain[i].id = _DXL[i];
+    _info_xels_sw_gain[i].p_data = reinterpret_cast<uint8_t*>(&_sw_gain_data[i]);
+    _sw_gain_infos.xel_count++;
+    _info_xels_sw_timed[i].id = _DXL[i];
+    _info_xels_sw_timed[i].p_data = reinterpret_cast<uint8_t*>(&_sw_timed_data[i]);
+    _sw_timed_infos.xel_count++;
+  }
+  _sw_profile_infos.is_info_changed = true;
+  _sw_gain_infos.is_info_changed = true;
+  _sw_timed_infos.is_info_changed = true;
+
   setProfile(1000);
-  expandArrays();
+
+  // Last, per servo writes after this may not get a status packet
+  return configureBus(bus);
+}
+
+bool q8Dynamixel::configureBus(const q8BusConfig& bus){
+  // Status for every instruction while setting up, so each write is checked
+  _writeByte(BROADCAST_ID, STATUS_RETURN_ADDR, 2);
+  bool ok = _setReturnDelay(bus.returnDelay);
+  if (bus.baudrate != _baudrate){
+    ok &= _setBaud(bus.baudrate);
+  }
+  ok &= _setStatusLevel(bus.statusReturnLevel);
+
+  _busStatus.baudrate = _baudrate;
+  _busStatus.statusReturnLevel = _statusLevel;
+  _busStatus.returnDelayUs = bus.returnDelay * 2;
+  _busStatus.joints = pingSweep();
+  _busStatus.applied = ok;
+  return ok && _busStatus.joints == 0xFF;
+}
+
+uint8_t q8Dynamixel::pingSweep(){
+  uint8_t mask = 0;
+  for (int i = 0; i < _idCount; i++){
+    if (_dxl.ping(_DXL[i])) mask |= 1 << i;
+  }
+  return mask;
+}
+
+bool q8Dynamixel::_findBus(uint32_t preferred){
+  // Preferred rate first, then the others configureBus() can leave behind.
+  // A broadcast ping costs one timeout where nothing listens.
+  const uint32_t bauds[] = {preferred, 1000000, 2000000, 3000000, 4000000};
+  uint32_t bestBaud = _baudrate;
+  uint8_t bestCount = 0;
+  for (size_t i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++){
+    if (i > 0 && bauds[i] == preferred) continue;
+    _dxl.begin(bauds[i]);
+    if (!_dxl.ping(BROADCAST_ID)) continue;
+    _writeByte(BROADCAST_ID, STATUS_RETURN_ADDR, 2);
+    uint8_t count = __builtin_popcount(pingSweep());
+    if (count > bestCount){
+      bestCount = count;
+      bestBaud = bauds[i];
+    }
+    if (count == _idCount) break;
+  }
+  _baudrate = bestBaud;
+  _dxl.begin(_baudrate);
+  return bestCount == _idCount;
+}
+
+bool q8Dynamixel::_setReturnDelay(uint8_t delay){
+  // EEPROM, only written where it differs
+  bool ok = true;
+  for (int i = 0; i < _idCount; i++){
+    uint8_t value;
+    if (_readByte(_DXL[i], RETURN_DELAY_ADDR, value) && value == delay) continue;
+    _writeByte(_DXL[i], RETURN_DELAY_ADDR, delay);
+    ok &= _readByte(_DXL[i], RETURN_DELAY_ADDR, value) && value == delay;
+  }
+  return ok;
+}
+
+bool q8Dynamixel::_setBaud(uint32_t baud){
+  // X-series baud rate register values, 3 = 1 Mbps
+  const uint32_t table[] = {9600, 57600, 115200, 1000000, 2000000, 3000000, 4000000, 4500000};
+  uint8_t index = 0;
+  while (index < 8 && table[index] != baud) index++;
+  if (index == 8) return false;
+
+  // Broadcast, then check that every joint followed. If not, send the ones
+  // that did back to the old rate.
+  uint32_t old = _baudrate;
+  _writeByte(BROADCAST_ID, BAUD_RATE_ADDR, index);
+  _dxl.begin(baud);
+  if (pingSweep() == 0xFF){
+    _baudrate = baud;
+    return true;
+  }
+  index = 0;
+  while (table[index] != old) index++;
+  _writeByte(BROADCAST_ID, BAUD_RATE_ADDR, index);
+  _dxl.begin(old);
+  return false;
+}
+
+bool q8Dynamixel::_setStatusLevel(uint8_t level){
+  // Pings are answered at every level, reads from level 1 up
+  _writeByte(BROADCAST_ID, STATUS_RETURN_ADDR, level);
+  bool ok = pingSweep() == 0xFF;
+  for (int i = 0; i < _idCount && ok && level >= 1; i++){
+    uint8_t value;
+    ok = _readByte(_DXL[i], STATUS_RETURN_ADDR, value) && value == level;
+  }
+  if (!ok){
+    _writeByte(BROADCAST_ID, STATUS_RETURN_ADDR, 2);
+    level = 2;
+  }
+  _statusLevel = level;
+  return ok;
+}
+
+bool q8Dynamixel::_writeByte(uint8_t id, uint16_t addr, uint8_t value){
+  return _dxl.write(id, addr, &value, 1);
+}
+
+bool q8Dynamixel::_readByte(uint8_t id, uint16_t addr, uint8_t& value){
+  return _dxl.read(id, addr, 1, &value, 1) == 1;
 }
 
 bool q8Dynamixel::checkComms(uint8_t ID){
@@ -108,17 +257,46 @@ void q8Dynamixel::setOpMode(){
 }
 
 void q8Dynamixel::setProfile(uint16_t dur){
+  uint16_t durs[_idCount];
+  for (int i = 0; i < _idCount; i++){
+    durs[i] = dur;
+  }
+  setProfile(durs);
+}
+
+void q8Dynamixel::setProfile(const uint16_t dur[8]){
+  // for Time-based Extended Pos, Profile velocity is the move duration (ms).
+  // Acceleration and velocity are adjacent, so one sync write covers both.
   setGain(400);
   for (int i = 0; i < _idCount; i++){
-    _dxl.writeControlTableItem(PROFILE_VELOCITY, _DXL[i], dur);
-    _dxl.writeControlTableItem(PROFILE_ACCELERATION, _DXL[i], dur / 3);
+    _sw_profile_data[i].profile_acceleration = dur[i] / 3;
+    _sw_profile_data[i].profile_velocity = dur[i];
   }
+  _sw_profile_infos.is_info_changed = true;
+  _dxl.syncWrite(&_sw_profile_infos);
 }
 
 void q8Dynamixel::setGain(uint16_t p_gain){
-  // for Time-based Extended Pos, Profile velocity is the move duration (ms).
+  uint16_t gains[_idCount];
+  for (int i = 0; i < _idCount; i++){
+    gains[i] = p_gain;
+  }
+  setGain(gains);
+  _gain = p_gain;
+}
+
+void q8Dynamixel::setGain(const uint16_t p_gain[8]){
   for (int i = 0; i < _idCount; i++){
-    _dxl.writeControlTableItem(POSITION_P_GAIN, _DXL[i], p_gain);
+    _sw_gain_data[i].position_p_gain = p_gain[i];
+  }
+  _sw_gain_infos.is_info_changed = true;
+  _dxl.syncWrite(&_sw_gain_infos);
+  _gain = 0xFFFF;   // Mixed, the next updateGain() always writes
+}
+
+void q8Dynamixel::updateGain(uint16_t p_gain){
+  if (p_gain != _gain){
+    setGain(p_gain);
   }
 }
 
@@ -142,90 +320,138 @@ void q8Dynamixel::bulkWrite(int32_t values[8]){
   _dxl.bulkWrite(&_bw_infos);
 }
 
-uint16_t* q8Dynamixel::syncRead(){
-  // Read relevant registers from all joints into a single array
-  int recv_cnt;
-  size_t offset = 0;
-  uint16_t* byteArray = new uint16_t[_idCount * 2];
+void q8Dynamixel::moveFeet(const float feet[8]){
+  _feetToPos(feet);
+  bulkWrite(_posArray);
+}
 
-  recv_cnt = _dxl.fastSyncRead(&_sr_infos);
-  if(recv_cnt = _idCount){
-    for (size_t i = 0; i < _idCount; i++){
-      // cast to uint16_t since values never exceed 65535 in robot configuration
-      byteArray[i*2] = static_cast<uint16_t>(_sr_data[i].present_current + 10000);
-      byteArray[i*2+1] = static_cast<uint16_t>(_sr_data[i].present_position);
-    }
-  } else {
-    // Fill ByteArray with zeros
-    for (size_t i = 0; i < _idCount*2; ++i){
-      byteArray[i] = 0;
-    }
+void q8Dynamixel::moveFeet(const float feet[8], uint16_t dur){
+  _feetToPos(feet);
+  moveTimed(_posArray, dur);
+}
+
+void q8Dynamixel::moveTimed(const int32_t values[8], uint16_t dur){
+  uint16_t durs[_idCount];
+  for (int i = 0; i < _idCount; i++){
+    durs[i] = dur;
   }
+  moveTimed(values, durs);
+  _prevProfile = _profile = dur;
+}
 
-  // for (size_t i = 0; i < 4; ++i){
-  //   Serial.print(byteArray[i]); Serial.print(" ");
-  // } Serial.println();
-  return byteArray;
+void q8Dynamixel::moveTimed(const int32_t values[8], const uint16_t dur[8]){
+  // Duration and goal of every joint land together, so no joint starts its
+  // move with the previous profile. Gain is left as it is.
+  for (int i = 0; i < _idCount; i++){
+    _sw_timed_data[i].profile_acceleration = dur[i] / 3;
+    _sw_timed_data[i].profile_velocity = dur[i];
+    _sw_timed_data[i].goal_position = values[i];
+  }
+  _sw_timed_infos.is_info_changed = true;
+  _dxl.syncWrite(&_sw_timed_infos);
+  _prevProfile = _profile = PROFILE_MIXED;   // Next updateProfile() always writes
 }
 
-void q8Dynamixel::jump(){
-  // Crouching Position
-  setProfile(500);
-  delay(100);
-  bulkWrite(_lowArray);
-  delay(1000);
+void q8Dynamixel::updateProfile(uint16_t dur){
+  _profile = dur;
+  if (_profile != _prevProfile){
+    Serial.print("[ROBOT] Profile changed: "); Serial.println(_profile);
+    setProfile(_profile);
+    _prevProfile = _profile;
+  }
+}
+
+void q8Dynamixel::updateTorque(bool flag){
+  if (flag != _torqueFlag){
+    Serial.println(flag ? "[ROBOT] Torque on" : "[ROBOT] Torque off");
+    toggleTorque(flag);
+    _torqueFlag = flag;
+    _prevTorqueFlag = flag;
+  }
+}
 
-  // Jump
-  setProfile(0);
-  setGain(800);
-  delay(100);
-  bulkWrite(_highArray);
-  delay(100);
-  bulkWrite(_restArray);
-  delay(5000);
+uint16_t* q8Dynamixel::syncRead(){
+  // Legacy API, wraps the caller-buffer version
+  uint16_t* byteArray = new uint16_t[_idCount * 2];
+  syncRead(byteArray);
+  return byteArray;
+}
+
+bool q8Dynamixel::syncRead(uint16_t* out){
+  // Legacy layout: current + 10000 and position of each joint, zeros on failure
+  q8JointState state;
+  bool ok = syncRead(state);
+  for (size_t i = 0; i < _idCount; i++){
+    // cast to uint16_t since values never exceed 65535 in robot configuration
+    out[i*2] = ok ? static_cast<uint16_t>(state.current[i] + 10000) : 0;
+    out[i*2+1] = ok ? static_cast<uint16_t>(state.position[i]) : 0;
+  }
+  return ok;
+}
 
-  // Back to idle
-  setProfile(500);
-  delay(100);
-  bulkWrite(_idleArray);
-  delay(1000);
-  _prevProfile = 500;
+bool q8Dynamixel::syncRead(q8JointState& state){
+  // Read relevant registers from all joints. Joints that did not answer keep
+  // the 0xFF error marker and read as zero.
+  for (size_t i = 0; i < _idCount; i++){
+    _info_xels_sr[i].error = 0xFF;
+  }
+  int recv_cnt = _dxl.fastSyncRead(&_sr_infos);
+
+  state.timestamp = micros();
+  state.okMask = 0;
+  for (size_t i = 0; i < _idCount; i++){
+    bool ok = recv_cnt > 0 && _info_xels_sr[i].error != 0xFF;
+    state.okMask |= ok << i;
+    state.current[i] = ok ? _sr_data[i].present_current : 0;
+    state.velocity[i] = ok ? _sr_data[i].present_velocity : 0;
+    state.position[i] = ok ? _sr_data[i].present_position : 0;
+  }
+  return recv_cnt == _idCount;
 }
 
 uint8_t q8Dynamixel::parseData(const char* myData) {
-  char* token = strtok(const_cast<char*>(myData), ",");
-  int index = 0;
-  int check = 0;
-  
-  while (token != nullptr && index < 8) {  // First 8 contain joint positions
-    _posArray[index++] = _deg2Dxl(std::atof(token));
-    token = strtok(nullptr, ",");
-  }
-  if (token != nullptr) {                  // 9th value is for special token
-    _specialCmd = std::atoi(token);
-    token = strtok(nullptr, ",");
-    if (_specialCmd == 1){           // Battery
-      return 1;
-    } else if (_specialCmd == 2){    // Record
-      check = 2;
-    } else if (_specialCmd == 3){    // Send recorded
-      return 3;
-    } else if (_specialCmd == 4){    // Jump
-      jump();
-      return 0;
-    }
+  // Legacy CSV path. Decode into a binary frame so both paths share one handler.
+  CommandMessage cmd;
+  for (int i = 0; i < _idCount; i++){
+    cmd.pos[i] = static_cast<int16_t>(_posArray[i]);
   }
-  if (token != nullptr) {                   // 10th value is vel/acc profiles
-    _profile = std::atoi(token);
-    token = strtok(nullptr, ",");
-    if (_profile != _prevProfile){
-      Serial.print("[ROBOT] Profile changed: "); Serial.println(_profile);
-      setProfile(_profile);
-      _prevProfile = _profile;
+  q8CsvToCommand(myData, cmd);
+  return executeCommand(cmd);
+}
+
+uint8_t q8Dynamixel::executeCommand(const CommandMessage& cmd) {
+  uint8_t check = 0;
+
+  if (cmd.special == CMD_GAIT){             // Handled by the gait engine
+    return 0;
+  }
+  if (cmd.flags & CMD_FLAG_FOOT_XY){       // Foot x/y per leg, solve IK onboard
+    float feet[8];
+    for (int i = 0; i < _idCount; i++){
+      feet[i] = static_cast<float>(cmd.pos[i]) / CMD_FOOT_SCALE;
     }
+    _feetToPos(feet);
+  } else {
+    for (int i = 0; i < _idCount; i++){    // Joint positions, already in ticks
+      _posArray[i] = cmd.pos[i];
+    }
+  }
+  _specialCmd = cmd.special;
+  if (_specialCmd == CMD_BATTERY){         // Battery
+    return CMD_BATTERY;
+  } else if (_specialCmd == CMD_SEND_RECORDED){ // Send recorded
+    return CMD_SEND_RECORDED;
+  } else if (_specialCmd == CMD_JUMP){     // Jump, run by q8Motion in the control task
+    return CMD_JUMP;
+  }
+  if (cmd.flags & CMD_FLAG_RECORD){        // Record
+    check = CMD_RECORD;
   }
-  if (token != nullptr) {                    // 1th value is torque enable/disable
-    _torqueFlag = (std::atoi(token) == 1);
+  if ((cmd.flags & CMD_FLAG_PROFILE) && !(cmd.flags & CMD_FLAG_TIMED)){ // vel/acc profiles
+    updateProfile(cmd.profile);
+  }
+  if (cmd.flags & CMD_FLAG_TORQUE){        // Torque enable/disable
+    _torqueFlag = (cmd.flags & CMD_FLAG_TORQUE_ON) != 0;
     if (_torqueFlag != _prevTorqueFlag){
       Serial.println(_torqueFlag ? "[ROBOT] Torque on" : "[ROBOT] Torque off");
       toggleTorque(_torqueFlag);
@@ -233,8 +459,12 @@ uint8_t q8Dynamixel::parseData(const char* myData) {
       return 0;
     }
   }
-  bulkWrite(_posArray);
-  return check - 0;
+  if ((cmd.flags & CMD_FLAG_PROFILE) && (cmd.flags & CMD_FLAG_TIMED)){
+    moveTimed(_posArray, cmd.profile);     // Profile and goals in one packet
+  } else {
+    bulkWrite(_posArray);
+  }
+  return check;
 }
 
 int32_t q8Dynamixel::_deg2Dxl(float deg){
@@ -251,21 +481,11 @@ float q8Dynamixel::_dxl2Deg(int32_t dxlRaw){
   return angleFriendly;
 }
 
-void q8Dynamixel::expandArrays(){
-  for (int i = 0; i < 4; i++){
-    _idleArray[i*2] = _deg2Dxl(_idlePos[0]);
-    _idleArray[i*2+1] = _deg2Dxl(_idlePos[1]);
-  }
-  for (int i = 0; i < 4; i++){
-    _lowArray[i*2] = _deg2Dxl(_jumpLow[0]);
-    _lowArray[i*2+1] = _deg2Dxl(_jumpLow[1]);
-  }
-  for (int i = 0; i < 4; i++){
-    _highArray[i*2] = _deg2Dxl(_jumpHigh[0]);
-    _highArray[i*2+1] = _deg2Dxl(_jumpHigh[1]);
+void q8Dynamixel::_feetToPos(const float feet[8]){
+  for (int i = 0; i < _idCount / 2; i++){
+    float q1, q2;
+    _leg[i].ikSolve(feet[i*2], feet[i*2+1], q1, q2);
+    _posArray[i*2] = q8Deg2Dxl(q1);
+    _posArray[i*2+1] = q8Deg2Dxl(q2);
   }
-  for (int i = 0; i < 4; i++){
-    _restArray[i*2] = _deg2Dxl(_jumpRest[0]);
-    _restArray[i*2+1] = _deg2Dxl(_jumpRest[1]);
-  }
-}
\ No newline at end of file
+}
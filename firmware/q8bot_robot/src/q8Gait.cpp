@@ -0,0 +1,238 @@
+/*
+  q8Gait.cpp - Onboard gait trajectory generator. See q8Gait.h.
+*/
+
+#include <Arduino.h>
+#include <q8Gait.h>
+
+static const float PI_F = static_cast<float>(PI);
+
+// Signed stride scale of FL, FR, BL, BR for each direction (trot and walk).
+// Matches the append_pos_list() stacking in gait_generator.py.
+static const float DIR_SCALE[][4] = {
+  {0, 0, 0, 0},              // GAIT_STOP
+  {1, 1, 1, 1},              // f
+  {-1, -1, -1, -1},          // b
+  {-1, 1, -1, 1},            // l
+  {1, -1, 1, -1},            // r
+  {0.75f, 1, 0.75f, 1},      // fl_0.75
+  {0.5f, 1, 0.5f, 1},        // fl_0.5
+  {1, 0.75f, 1, 0.75f},      // fr_0.75
+  {1, 0.5f, 1, 0.5f},        // fr_0.5
+  {-0.75f, -1, -0.75f, -1},  // bl_0.75
+  {-0.5f, -1, -0.5f, -1},    // bl_0.5
+  {-1, -0.75f, -1, -0.75f},  // br_0.75
+  {-1, -0.5f, -1, -0.5f},    // br_0.5
+};
+
+// Crawl steps: leg moves in multiples of xrange, then which leg lifts (-1 none).
+// Same tables as generate_crawl_trajectories().
+static const int8_t CRAWL_STEPS = 7;
+static const int8_t CRAWL_FORWARD[CRAWL_STEPS][5] = {
+  {-1, -1, -1, -1, -1},
+  {0, 0, 0, 4, 3},
+  {0, 4, 0, 0, 1},
+  {-2, -2, -2, -2, -1},
+  {0, 0, 4, 0, 2},
+  {4, 0, 0, 0, 0},
+  {-1, -1, -1, -1, -1},
+};
+static const int8_t CRAWL_BACKWARD[CRAWL_STEPS][5] = {
+  {1, 1, 1, 1, -1},
+  {-4, 0, 0, 0, 0},
+  {0, 0, -4, 0, 2},
+  {2, 2, 2, 2, -1},
+  {0, -4, 0, 0, 1},
+  {0, 0, 0, -4, 3},
+  {1, 1, 1, 1, -1},
+};
+
+q8Gait::q8Gait(){
+}
+
+bool q8Gait::start(uint8_t gait, uint8_t dir, uint16_t stridePct, uint16_t periodMs){
+  if (gait >= Q8_GAIT_COUNT || dir == GAIT_STOP || dir > GAIT_BR_05){
+    stop();
+    return false;
+  }
+  const q8GaitParams* p = &Q8_GAITS[gait];
+  uint8_t resolved = _resolveDir(p, dir);
+  if (resolved == GAIT_STOP){
+    stop();
+    return false;
+  }
+
+  uint16_t n = p->s1Count + p->s2Count;
+  uint16_t shift = 0;
+  float stride = stridePct / 100.0f;
+  switch (p->type){
+    case GAIT_TYPE_CRAWL:
+      n = CRAWL_STEPS * p->s1Count - p->s1Count + p->s2Count;  // Each leg lifts once
+      break;
+    case GAIT_TYPE_TROT:    // Diagonal pairs, 50% offset
+      shift = static_cast<uint16_t>(p->s1Count * (static_cast<float>(n) / p->s1Count) / 2);
+      break;
+    case GAIT_TYPE_WALK:    // Each leg offset by 25%
+      shift = static_cast<uint16_t>(p->s1Count * (static_cast<float>(n) / p->s1Count) / 4);
+      break;
+    case GAIT_TYPE_BOUND:   // Front and back pairs offset
+      shift = n / 4;
+      break;
+    case GAIT_TYPE_PRONK:   // All legs in phase
+      break;
+  }
+  const uint16_t shifts[][4] = {
+    {0, shift, shift, 0},                  // trot
+    {0, shift, static_cast<uint16_t>(shift * 2), static_cast<uint16_t>(shift * 3)},  // walk
+    {0, 0, shift, shift},                  // bound
+    {0, 0, 0, 0},                          // pronk
+    {0, 0, 0, 0},                          // crawl
+  };
+
+  // Ranges only depend on the stride, so fit each distinct scale once
+  float scale[4], xrange[4], yrange[4];
+  for (uint8_t leg = 0; leg < 4; leg++){
+    scale[leg] = DIR_SCALE[resolved][leg] * stride;
+    xrange[leg] = p->xrange;
+    yrange[leg] = p->yrange;
+    if (p->type == GAIT_TYPE_CRAWL) continue;
+
+    bool cached = false;
+    for (uint8_t j = 0; j < leg; j++){
+      if (scale[j] == scale[leg]){
+        xrange[leg] = xrange[j];
+        yrange[leg] = yrange[j];
+        cached = true;
+        break;
+      }
+    }
+    if (!cached && !_fitRange(p, scale[leg], xrange[leg], yrange[leg])){
+      stop();
+      return false;
+    }
+  }
+
+  // Keep the phase when only the direction changes
+  if (!_active || gait != _gait){
+    _phase = 0;
+  }
+  _p = p;
+  _gait = gait;
+  _dir = dir;
+  _n = n;
+  _crawlBackward = (resolved == GAIT_B);
+  _pointsPerMs = periodMs ? static_cast<float>(n) / periodMs : 1.0f / GAIT_SAMPLE_MS;
+  for (uint8_t leg = 0; leg < 4; leg++){
+    _scale[leg] = scale[leg];
+    _shift[leg] = shifts[p->type][leg];
+    _xrange[leg] = xrange[leg];
+    _yrange[leg] = yrange[leg];
+  }
+  _active = true;
+  return true;
+}
+
+void q8Gait::stop(){
+  _active = false;
+  _dir = GAIT_STOP;
+  _phase = 0;
+}
+
+void q8Gait::tick(float dtMs, float feet[8]){
+  if (!_active) return;
+
+  // Interpolate between trajectory points when the period is not a multiple of
+  // GAIT_SAMPLE_MS; at the default period the phase stays on whole points.
+  uint16_t idx = static_cast<uint16_t>(_phase);
+  float frac = _phase - idx;
+  sample(idx, feet);
+  if (frac > 1e-4f){
+    float next[8];
+    sample((idx + 1) % _n, next);
+    for (uint8_t i = 0; i < 8; i++){
+      feet[i] += (next[i] - feet[i]) * frac;
+    }
+  }
+
+  _phase += dtMs * _pointsPerMs;
+  while (_phase >= _n) _phase -= _n;
+}
+
+void q8Gait::sample(uint16_t idx, float feet[8]){
+  for (uint8_t leg = 0; leg < 4; leg++){
+    float x, y;
+    if (_p->type == GAIT_TYPE_CRAWL){
+      _crawlPoint(leg, idx, x, y);
+    } else {
+      uint16_t i = (idx + _shift[leg]) % _n;
+      _basePoint(_p, _scale[leg], _xrange[leg], _yrange[leg], i, x, y);
+    }
+    feet[leg*2] = x;
+    feet[leg*2+1] = y;
+  }
+}
+
+uint8_t q8Gait::_resolveDir(const q8GaitParams* p, uint8_t dir) const{
+  // Same fallbacks as GaitManager.FALLBACK_MAP for gaits without turns
+  if (p->type == GAIT_TYPE_TROT) return dir;
+  bool hasTurn = (p->type == GAIT_TYPE_WALK);
+  if (dir == GAIT_F || dir == GAIT_B) return dir;
+  if (dir == GAIT_L || dir == GAIT_R) return hasTurn ? dir : static_cast<uint8_t>(GAIT_STOP);
+  if (dir >= GAIT_FL_075 && dir <= GAIT_FR_05) return GAIT_F;
+  return GAIT_B;
+}
+
+bool q8Gait::_fitRange(const q8GaitParams* p, float scale, float& xrange, float& yrange){
+  // Shrink xrange/yrange by 1 mm until every point is reachable, like the
+  // retry in _generate_base_trajectories()
+  uint16_t n = p->s1Count + p->s2Count;
+  while (true){
+    if (p->y0 - yrange < 5) return false;
+
+    bool reachable = true;
+    for (uint16_t i = 0; i < n && reachable; i++){
+      float x, y, q1, q2;
+      _basePoint(p, scale, xrange, yrange, i, x, y);
+      reachable = _ik.ikSolve(x, y, q1, q2);
+    }
+    if (reachable) return true;
+
+    xrange -= 1;
+    yrange -= 1;
+    if (xrange <= 0 || yrange <= 0) return false;
+  }
+}
+
+void q8Gait::_basePoint(const q8GaitParams* p, float scale, float xrange, float yrange, uint16_t i, float& x, float& y) const{
+  float stride = xrange * scale;
+  if (i < p->s1Count){
+    // Lift phase: sinusoidal lift trajectory
+    x = p->x0 - stride / 2 + (i + 1) * stride / p->s1Count;
+    y = p->y0 - sinf((i + 1) * PI_F / p->s1Count) * yrange;
+  } else {
+    // Down phase: sinusoidal down trajectory
+    uint16_t j = i - p->s1Count;
+    x = p->x0 + stride / 2 - (j + 1) * stride / p->s2Count;
+    y = p->y0 + sinf((j + 1) * PI_F / p->s2Count) * p->yrange2;
+  }
+}
+
+void q8Gait::_crawlPoint(uint8_t leg, uint16_t i, float& x, float& y) const{
+  const int8_t (*steps)[5] = _crawlBackward ? CRAWL_BACKWARD : CRAWL_FORWARD;
+  float s = _xrange[leg] * _scale[leg];
+  if (s < 0) s = -s;   // Direction is in the step table
+  x = _p->x0;
+  y = _p->y0;
+  for (int8_t k = 0; k < CRAWL_STEPS; k++){
+    bool lift = (steps[k][4] == leg);
+    uint16_t len = lift ? _p->s2Count : _p->s1Count;
+    float dx = steps[k][leg] * s;
+    if (i < len){
+      x += (i + 1) * dx / len;
+      if (lift) y = _p->y0 - sinf((i + 1) * PI_F / len) * _yrange[leg];
+      return;
+    }
+    x += dx;
+    i -= len;
+  }
+}
@@ -0,0 +1,77 @@
+/*
+  q8Kinematics.cpp - Inverse/forward kinematics of the Q8bot 5-bar leg.
+  See q8Kinematics.h.
+*/
+
+#include <Arduino.h>
+#include <q8Kinematics.h>
+
+// Keep all math in single precision (PI is a double literal)
+static const float PI_F = static_cast<float>(PI);
+static const float RAD2DEG = 180.0f / PI_F;
+static const float DEG2RAD = PI_F / 180.0f;
+
+q8Kinematics::q8Kinematics(float d, float l1, float l2, float l1p, float l2p)
+: _d(d), _l1(l1), _l2(l2), _l1p(l1p), _l2p(l2p) {
+  _prevFk[0] = _d / 2;
+  _prevFk[1] = _l1 + _l2;
+}
+
+bool q8Kinematics::ikSolve(float x, float y, float& q1, float& q2){
+  float c1 = sqrtf((x - _d) * (x - _d) + y * y);
+  float c2 = sqrtf(x * x + y * y);
+  float cosA1 = (c1 * c1 + _d * _d - c2 * c2) / (2 * c1 * _d);
+  float cosA2 = (c2 * c2 + _d * _d - c1 * c1) / (2 * c2 * _d);
+  float cosB1 = (c1 * c1 + _l1 * _l1 - _l2 * _l2) / (2 * c1 * _l1);
+  float cosB2 = (c2 * c2 + _l1p * _l1p - _l2p * _l2p) / (2 * c2 * _l1p);
+
+  // acos domain check replaces the Python try/except (also catches c1/c2 == 0)
+  if (!(fabsf(cosA1) <= 1.0f && fabsf(cosA2) <= 1.0f &&
+        fabsf(cosB1) <= 1.0f && fabsf(cosB2) <= 1.0f)){
+    q1 = _prevIk[0];
+    q2 = _prevIk[1];
+    return false;
+  }
+  q1 = (PI_F - acosf(cosA1) - acosf(cosB1)) * RAD2DEG;
+  q2 = (acosf(cosA2) + acosf(cosB2)) * RAD2DEG;
+  _prevIk[0] = q1;
+  _prevIk[1] = q2;
+  return true;
+}
+
+bool q8Kinematics::fkSolve(float q1, float q2, float& x, float& y){
+  // Knee positions of both upper links
+  float xa = _l1 * cosf(q1 * DEG2RAD) + _d;
+  float ya = _l1 * sinf(q1 * DEG2RAD);
+  float xb = _l1p * cosf(q2 * DEG2RAD);
+  float yb = _l1p * sinf(q2 * DEG2RAD);
+
+  // Foot is where the two lower-link circles intersect. Closed form instead of
+  // fsolve, which also avoids converging to the wrong (upper) intersection.
+  float dx = xb - xa;
+  float dy = yb - ya;
+  float dist = sqrtf(dx * dx + dy * dy);
+  if (dist < 1e-6f || dist > _l2 + _l2p || dist < fabsf(_l2 - _l2p)){
+    x = _prevFk[0];
+    y = _prevFk[1];
+    return false;
+  }
+  float a = (_l2 * _l2 - _l2p * _l2p + dist * dist) / (2 * dist);
+  float h = sqrtf(fmaxf(_l2 * _l2 - a * a, 0.0f));
+  float mx = xa + a * dx / dist;
+  float my = ya + a * dy / dist;
+  float x1 = mx - h * dy / dist, y1 = my + h * dx / dist;
+  float x2 = mx + h * dy / dist, y2 = my - h * dx / dist;
+
+  // The foot is the intersection below the knees (larger y)
+  if (y1 > y2){
+    x = x1;
+    y = y1;
+  } else {
+    x = x2;
+    y = y2;
+  }
+  _prevFk[0] = x;
+  _prevFk[1] = y;
+  return true;
+}
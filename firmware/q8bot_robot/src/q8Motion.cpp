@@ -0,0 +1,97 @@
+/*
+  q8Motion.cpp - Keyframe sequencer for scripted motions. See q8Motion.h.
+  Keyframes are the former q8Dynamixel::jump() and the routines in
+  python-tools/q8bot/routine_generator.py.
+*/
+
+#include <Arduino.h>
+#include <q8Motion.h>
+
+#define Q8_POSE(q1, q2) {q1, q2, q1, q2, q1, q2, q1, q2}
+
+static const q8Keyframe JUMP[] = {
+  {500, 400, Q8_POSE(-40, 220), 1100},    // Crouch
+  {0,   800, Q8_POSE(90, 90),   100},     // Jump
+  {0,   800, Q8_POSE(30, 150),  5100},    // Land
+  {500, 400, Q8_POSE(30, 150),  1000},    // Back to idle
+};
+
+static const q8Keyframe GREET[] = {
+  {1000, 400, Q8_POSE(-90, 45),                    1100},
+  {1000, 400, Q8_POSE(0, 45),                      1000},
+  {500,  400, {-45, 45, -45, 45, 50, 75, 50, 75},  1000},
+  {200,  400, {45, 90, -45, 45, 50, 75, 50, 75},   250},   // Wave 3 times
+  {200,  400, {-45, 45, 45, 90, 50, 75, 50, 75},   250},
+  {200,  400, {45, 90, -45, 45, 50, 75, 50, 75},   250},
+  {200,  400, {-45, 45, 45, 90, 50, 75, 50, 75},   250},
+  {200,  400, {45, 90, -45, 45, 50, 75, 50, 75},   250},
+  {200,  400, {-45, 45, 45, 90, 50, 75, 50, 75},   1000},
+  {500,  400, Q8_POSE(-90, 45),                    700},
+};
+
+static const q8Keyframe SHOW_RANGE[] = {
+  {1000, 400, Q8_POSE(100, 80),  1500},
+  {1000, 400, Q8_POSE(0, 45),    1500},
+  {1000, 400, Q8_POSE(-90, 45),  1500},
+  {1000, 400, Q8_POSE(-20, 200), 1500},
+  {1000, 400, Q8_POSE(130, 270), 1500},
+  {1000, 400, Q8_POSE(130, 180), 1500},
+  {1000, 400, Q8_POSE(100, 80),  1500},
+  {1000, 400, Q8_POSE(-20, 200), 1500},
+  {1000, 400, Q8_POSE(30, 150),  1500},
+};
+
+// Indexed by MotionId
+static const q8Primitive MOTIONS[] = {
+  {JUMP,       sizeof(JUMP) / sizeof(JUMP[0])},
+  {GREET,      sizeof(GREET) / sizeof(GREET[0])},
+  {SHOW_RANGE, sizeof(SHOW_RANGE) / sizeof(SHOW_RANGE[0])},
+};
+static const uint8_t MOTION_COUNT = sizeof(MOTIONS) / sizeof(MOTIONS[0]);
+
+bool q8Motion::start(uint8_t id){
+  if (id >= MOTION_COUNT){
+    stop();
+    return false;
+  }
+  _motion = &MOTIONS[id];
+  _frame = 0;
+  _holdMs = 0;
+  return true;
+}
+
+void q8Motion::stop(){
+  _motion = nullptr;
+}
+
+bool q8Motion::tick(uint32_t dtMs, q8Dynamixel& dxl){
+  if (_motion == nullptr) return false;
+  if (_holdMs > dtMs){          // Holding the current keyframe
+    _holdMs -= dtMs;
+    return false;
+  }
+  if (_frame >= _motion->count){
+    stop();
+    return false;
+  }
+
+  const q8Keyframe& k = _motion->frames[_frame++];
+  dxl.updateProfile(k.profile);   // Also resets the gain, so set it after
+  dxl.updateGain(k.gain);
+  int32_t ticks[8];
+  for (uint8_t i = 0; i < 8; i++){
+    ticks[i] = q8Deg2Dxl(k.pose[i]);
+  }
+  dxl.bulkWrite(ticks);
+  _holdMs = k.holdMs;
+  return true;
+}
+
+uint32_t q8Motion::durationMs(uint8_t id){
+  if (id >= MOTION_COUNT) return 0;
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < MOTIONS[id].count; i++){
+    total += MOTIONS[id].frames[i].holdMs;
+  }
+  return total;
+}
@@ -0,0 +1,125 @@
+/*
+  q8Smoother.cpp - Setpoint smoother for streamed joint targets. See q8Smoother.h.
+*/
+
+#include <Arduino.h>
+#include <q8Smoother.h>
+
+q8Smoother::q8Smoother(const q8SmoothConfig& config) : _config(config) {
+  resetStats();
+}
+
+void q8Smoother::configure(const q8SmoothConfig& config){
+  _config = config;
+  reset();
+}
+
+void q8Smoother::resetStats(){
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+void q8Smoother::push(const int16_t pos[8], uint16_t seq, uint32_t rxUs){
+  _stats.frames++;
+  uint16_t step = seq - _lastSeq;
+  bool restart = _count == 0 || step == 0 || step > 0x7FFF ||
+                 rxUs - _lastRxUs > _config.gapMs * 1000UL;
+  uint32_t us = rxUs;
+  if (!restart){
+    _stats.lost += step - 1;
+    uint32_t interval = (rxUs - _lastRxUs) / step;
+    if (_intervalUs == 0) _intervalUs = interval;
+    else _intervalUs += (int32_t)(interval - _intervalUs) / 8;
+
+    // Arrival jitters, the sender's clock does not: step the timestamp by the
+    // interval and pull it a quarter of the way towards the arrival
+    const Frame& prev = _frame(0);
+    uint32_t expected = prev.us + step * _intervalUs;
+    int32_t err = rxUs - expected;
+    _jitterUs += ((int32_t)(err < 0 ? -err : err) - (int32_t)_jitterUs) / 8;
+    int32_t resync = 2 * _intervalUs;
+    us = (err > resync || err < -resync) ? rxUs : expected + err / 4;
+    if ((int32_t)(us - prev.us) < (int32_t)(_intervalUs / 2)) us = prev.us + _intervalUs / 2;
+  } else {
+    _count = 0;
+    _fresh = true;               // First target of a stream is written as it is
+  }
+
+  _head = (_head + 1) % SMOOTH_HISTORY;
+  memcpy(_frames[_head].pos, pos, sizeof(_frames[_head].pos));
+  _frames[_head].us = us;
+  if (_count < SMOOTH_HISTORY) _count++;
+  _lastSeq = seq;
+  _lastRxUs = rxUs;
+}
+
+SmoothStep q8Smoother::target(uint32_t nowUs, float out[8]){
+  if (_count == 0) return SMOOTH_IDLE;
+  if ((int32_t)(nowUs - _lastRxUs) > (int32_t)(_config.staleMs * 1000UL)){
+    _count = 0;
+    _stats.stale++;
+    return SMOOTH_STALE;
+  }
+
+  float next[8];
+  const Frame& newest = _frame(0);
+  if (_count == 1 || _intervalUs == 0){
+    for (uint8_t i = 0; i < 8; i++) next[i] = newest.pos[i];
+  } else {
+    // Played back late enough for the next frame to be in by then, even if
+    // it jitters or, with two frames of delay, one frame is missing
+    uint32_t t = nowUs - _config.delayFrames * _intervalUs - 2 * _jitterUs;
+    int32_t past = t - newest.us;
+    if (past > 0){
+      // Next frame missing or late: carry on with the last motion, bounded
+      const Frame& prev = _frame(1);
+      float span = newest.us - prev.us;
+      uint32_t limit = _config.extrapolateFrames * _intervalUs;
+      float dt = (uint32_t)past < limit ? past : limit;
+      for (uint8_t i = 0; i < 8; i++){
+        next[i] = newest.pos[i] + (newest.pos[i] - prev.pos[i]) * dt / span;
+      }
+      _stats.extrapolated++;
+    } else {
+      // Segment a..b around t, holding the oldest frame if t is before it
+      uint8_t age = 0;
+      while (age + 1 < _count && (int32_t)(t - _frame(age + 1).us) < 0) age++;
+      const Frame& b = _frame(age);
+      if (age + 1 == _count){
+        for (uint8_t i = 0; i < 8; i++) next[i] = b.pos[i];
+      } else {
+        const Frame& a = _frame(age + 1);
+        float h = b.us - a.us;
+        float s = (float)(t - a.us) / h;
+        if (_config.mode == SMOOTH_CUBIC){
+          float s2 = s * s, s3 = s2 * s;
+          float h00 = 2 * s3 - 3 * s2 + 1, h10 = s3 - 2 * s2 + s;
+          float h01 = -2 * s3 + 3 * s2, h11 = s3 - s2;
+          for (uint8_t i = 0; i < 8; i++){
+            next[i] = h00 * a.pos[i] + h10 * h * _tangent(age + 1, i) +
+                      h01 * b.pos[i] + h11 * h * _tangent(age, i);
+          }
+        } else {
+          for (uint8_t i = 0; i < 8; i++) next[i] = a.pos[i] + (b.pos[i] - a.pos[i]) * s;
+        }
+      }
+    }
+  }
+
+  if (!_fresh && memcmp(next, _out, sizeof(_out)) == 0) return SMOOTH_HOLD;
+  _fresh = false;
+  memcpy(_out, next, sizeof(_out));
+  memcpy(out, next, sizeof(_out));
+  return SMOOTH_WRITE;
+}
+
+const q8Smoother::Frame& q8Smoother::_frame(uint8_t age) const {
+  return _frames[(_head + SMOOTH_HISTORY - age) % SMOOTH_HISTORY];
+}
+
+// Slope at a frame, per us: across both neighbours where there are two
+float q8Smoother::_tangent(uint8_t age, uint8_t joint) const {
+  const Frame& newer = _frame(age > 0 ? age - 1 : age);
+  const Frame& older = _frame(age + 1 < _count ? age + 1 : age);
+  float span = newer.us - older.us;
+  return span > 0 ? (newer.pos[joint] - older.pos[joint]) / span : 0;
+}
@@ -0,0 +1,36 @@
+/*
+  q8Telemetry.cpp - Packs full joint state samples into TelemetryMessage frames.
+  See q8Telemetry.h.
+*/
+
+#include <Arduino.h>
+#include <q8Telemetry.h>
+
+static int16_t clamp16(int32_t value){
+  return static_cast<int16_t>(constrain(value, -32768, 32767));
+}
+
+bool q8Telemetry::add(const q8JointState& state){
+  TelemetrySample& s = _frame.samples[_frame.count++];
+  s.timestamp = state.timestamp;
+  s.okMask = state.okMask;
+  s.reserved = 0;
+  for (uint8_t i = 0; i < 8; i++){
+    s.current[i] = state.current[i];
+    s.velocity[i] = clamp16(state.velocity[i]);
+    s.position[i] = clamp16(state.position[i]);
+  }
+  return _frame.count == TELEMETRY_PER_FRAME;
+}
+
+void q8Telemetry::sent(bool ok){
+  if (ok){
+    _frame.seq++;
+    _frame.dropped = 0;
+  } else {
+    _totalDropped += _frame.count;
+    uint32_t dropped = _frame.dropped + _frame.count;
+    _frame.dropped = dropped > 0xFFFF ? 0xFFFF : dropped;
+  }
+  _frame.count = 0;
+}
@@ -0,0 +1,78 @@
+'''
+Writes the commands of the serial_capture.py session, sent through espnow.py
+both as legacy CSV text and as binary frames, for the decoder check of the
+robot firmware (firmware/q8bot_robot/src/native/simMain.cpp). The robot must
+end up with the same joint goals either way.
+
+One line per command: the CSV text, a space, then the binary frame in hex.
+The session is followed by the other commands operate.py sends and by
+angles a fraction of a tick off half a tick, where float and double round
+differently.
+
+    python command_fixture.py ../../firmware/q8bot_robot/src/native/command_fixture.txt
+'''
+
+import argparse
+import espnow
+from espnow import q8_espnow
+from serial_capture import RecordingSerial, run_session
+
+# Angles within about 1e-5 deg of half a tick
+HALF_TICKS = [
+    [-150.51269, -153.50097, -103.84277, 21.3, 0, 0, 0, 0],
+    [0.0439453125, 0.087890625, -0.0439453125, 359.956, 180, -180, 0.5, -0.5],
+    [45.5, 90.25, -45.125, 45.0625, 50.3, 75.7, 50.01, 75.99],
+]
+
+
+def other_commands(q8):
+    q8.enable_torque()
+    q8.move_all([30, 150, 30, 150, 30, 150, 30, 150], 0, True)
+    q8.move_all([-40, 220, -40, 220, -40, 220, -40, 220], 500, False)
+    for pos in HALF_TICKS:
+        q8.move_all(pos, 0, False)
+    q8.move_feet([9.75, 43.36, -10.25, 43.36, 29.75, 23.36, 9.75, 60])
+    q8.move_feet([-15, 50, 35, 40, 9.75, 25, 9.755, 43.365], 200)
+    q8.move_timed([30, 150, 60, 120, 30, 150, 60, 120], 300)
+    q8.move_timed([10, 170, 10, 170, 10, 170, 10, 170], 120, True)
+    q8.send_gait(0, 5, 100)
+    q8.stop_gait()
+    q8.start_telemetry(100)
+    q8.send_motion(1)
+    q8.send_jump()
+    q8.check_battery()
+    q8.disable_torque()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Write CSV and binary encodings of a Q8bot session')
+    parser.add_argument('out', help='Output file, one "csv hex" line per command')
+    parser.add_argument('--seconds', type=float, default=2.0, help='Gait streaming time')
+    args = parser.parse_args()
+
+    recorder = RecordingSerial()
+    serial_class = espnow.serial.Serial
+    espnow.serial.Serial = lambda port, baud: recorder
+    q8 = q8_espnow(None)
+    espnow.serial.Serial = serial_class
+
+    # Every command goes out twice, through the same _send() operate.py uses
+    commands = []
+    send = q8._send
+
+    def send_both(values):
+        q8.binary = False
+        send(values)
+        q8.binary = True
+        send(values)
+        commands.append((recorder.writes[-2][1], recorder.writes[-1][1]))
+    q8._send = send_both
+
+    run_session(q8, args.seconds)
+    other_commands(q8)
+
+    with open(args.out, "w") as f:
+        f.write(f"# command_fixture.py, {len(commands)} commands\n")
+        for csv, frame in commands:
+            f.write(f"{csv.decode()} {frame.hex()}\n")
+    print(f"{len(commands)} commands -> {args.out}")
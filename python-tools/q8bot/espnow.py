@@ -6,12 +6,126 @@ Python class that passes arguments to connected ESP32C3 controller, which
 then sends commands wirelessly to the robot via ESPNow.
 '''
 
+import binascii
+import math
 import serial
+import struct
+import time
 
 DEFAULT_JOINTLIST = [i + 11 for i in range(8)]
 
+# Binary serial frames, both ways: 0xA5 0x5A, length, payload, then a
+# CRC-16/CCITT-FALSE of length and payload (low byte first). From the
+# controller the payload is an ESP-NOW payload from a robot behind its fleet
+# header, mixed with text lines. Must match q8Protocol.h.
+SERIAL_FRAME_SYNC = b"\xa5\x5a"
+SERIAL_FRAME_MAX = 252
+MSG_DATA = 1
+MSG_COMMAND = 3
+MSG_TELEMETRY = 4
+MSG_TRACE = 7
+TELEMETRY_HEADER = struct.Struct("<BBHH")        # msgType, count, seq, dropped
+TELEMETRY_SAMPLE = struct.Struct("<IBB8h8h8h")   # timestamp us, ok mask, reserved,
+                                                 # current, velocity, position
+
+# Commands to the controller carry a CommandMessage
+CMD_FRAME_VERSION = 1
+COMMAND_MSG = struct.Struct("<BBBBHH8h")          # msgType, version, flags, special,
+                                                 # seq, profile, pos
+CMD_RECORD, CMD_GAIT, CMD_TELEMETRY, CMD_MOTION = 2, 5, 6, 7
+CMD_FLAG_RECORD, CMD_FLAG_PROFILE, CMD_FLAG_TORQUE = 1 << 0, 1 << 1, 1 << 2
+CMD_FLAG_TORQUE_ON, CMD_FLAG_FOOT_XY, CMD_FLAG_TIMED = 1 << 3, 1 << 4, 1 << 5
+CMD_FLAG_TRACE, CMD_FLAG_HOLD = 1 << 6, 1 << 7
+CMD_FOOT_SCALE = 100
+
+# Latency trace (CMD_FLAG_TRACE): id and controller ingest time go out after
+# the CommandMessage, records come back in TRACE frames: count, then records
+COMMAND_TRACE = struct.Struct("<HH")
+TRACE_RECORD = struct.Struct("<7H")
+TRACE_STAGES = ["ingest", "air", "queue", "parse", "latch", "write"]
+
+# Link quality after each heartbeat echo: RTT over the last 32 heartbeats,
+# loss since pairing
+MSG_LINK_STATS = 8
+LINK_STATS = struct.Struct("<BBHHIIIIIII")        # msgType, samples, loss, robot loss
+                                                 # (per mille), rtt min, mean, p99 us,
+                                                 # heartbeats sent, skipped, echoes, lost
+
+# Fleet mode: a controller driving several robots. A header in front of a
+# command names the robots it goes to, one in front of each frame from the
+# controller names the robot it came from. Commands sent with CMD_FLAG_HOLD
+# wait on the robots for a group start, which they apply in the same tick.
+MSG_SYNC_START, MSG_FLEET = 9, 10
+FLEET_MAX = 8
+FLEET_HEADER = struct.Struct("<BB")               # msgType, robots (bit n is robot n)
+SYNC_START = struct.Struct("<BBI")                # msgType, id, delay us
+
+def _lround(value):
+    # C lround(): halves away from zero, unlike Python's round()
+    return int(math.copysign(math.floor(abs(value) + 0.5), value))
+
+def encode_frame(payload):
+    body = bytes([len(payload)]) + payload
+    crc = binascii.crc_hqx(body, 0xFFFF)
+    return SERIAL_FRAME_SYNC + body + struct.pack("<H", crc)
+
+def encode_command(values, seq = 0, trace_id = None, robots = None, hold = False):
+    # Same as q8CsvToCommand() in the firmware: values are the numbers of the
+    # CSV command, the result is a framed CommandMessage. robots is a list of
+    # robot IDs for a controller driving several, None sends to all of them.
+    count = min(len(values), 13)
+    flags, special = 0, 0
+    if count > 8:
+        if int(values[8]) == CMD_RECORD:
+            flags |= CMD_FLAG_RECORD
+        else:
+            special = int(values[8]) & 0xFF
+    foot_xy = count > 11 and values[11] == 1
+    pos = [0] * 8
+    for i in range(min(count, 8)):
+        if special in (CMD_GAIT, CMD_TELEMETRY, CMD_MOTION):
+            value = _lround(values[i])
+        elif foot_xy:
+            value = _lround(values[i] * CMD_FOOT_SCALE)
+        else:
+            value = int(values[i] / (360.0 / 4096.0) + 0.5) + 4096
+        pos[i] = max(-32768, min(32767, value))
+    profile = 0
+    if count > 9:
+        profile = int(values[9]) & 0xFFFF
+        flags |= CMD_FLAG_PROFILE
+    if count > 10:
+        flags |= CMD_FLAG_TORQUE
+        if int(values[10]) == 1:
+            flags |= CMD_FLAG_TORQUE_ON
+    if foot_xy:
+        flags |= CMD_FLAG_FOOT_XY
+    if count > 12 and values[12] == 1 and flags & CMD_FLAG_PROFILE:
+        flags |= CMD_FLAG_TIMED
+    if trace_id is not None:
+        flags |= CMD_FLAG_TRACE
+    if hold:
+        flags |= CMD_FLAG_HOLD
+    payload = COMMAND_MSG.pack(MSG_COMMAND, CMD_FRAME_VERSION, flags, special,
+                               seq & 0xFFFF, profile, *pos)
+    if trace_id is not None:
+        payload += COMMAND_TRACE.pack(trace_id & 0xFFFF, 0)
+    if robots is not None:
+        payload = FLEET_HEADER.pack(MSG_FLEET, sum(1 << r for r in robots)) + payload
+    return encode_frame(payload)
+
+class RobotState:
+    # What poll() collected from one robot
+    def __init__(self):
+        self.telemetry = []           # (timestamp_us, ok_mask, current, velocity, position)
+        self.telemetry_lost = 0       # Frames lost on air (seq gaps)
+        self.telemetry_dropped = 0    # Samples dropped on the robot
+        self.link = None              # Latest link quality from the controller
+        self._telemetry_seq = None
+
 class q8_espnow:
-    def __init__(self, port, joint_list = DEFAULT_JOINTLIST, baud = 115200):
+    def __init__(self, port, joint_list = DEFAULT_JOINTLIST, baud = 115200,
+                 binary = True, trace_every = 0):
         self.DEVICENAME = port
         self.BAUDRATE = baud
         self.JOINTS = joint_list
@@ -19,42 +133,210 @@ class q8_espnow:
         self.prev_profile = 0
         self.torque_on = False
 
+        # Telemetry stream and link state of each robot, filled by poll().
+        # telemetry, telemetry_lost, telemetry_dropped and link are robot 0's.
+        self.robots = [RobotState() for i in range(FLEET_MAX)]
+        self._rx_buf = bytearray()
+        self.uplink_errors = 0        # Frames from the controller dropped for a bad CRC
+
+        # Binary command frames, False sends CSV text for older controllers
+        self.binary = binary
+        self._seq = 0
+
+        # Latency trace of one in trace_every binary commands, filled by poll()
+        self.trace_every = trace_every
+        self.traces = []              # (id, ingest, air, queue, parse, latch, write, rtt) in us
+        self._trace_sent = {}         # id: time.perf_counter() of the write
+
+        # Fleet mode, see select()
+        self.target = None
+        self.hold = False
+
         # Initialize serial communication with ESP32-C3
         self.serialHandler = serial.Serial(self.DEVICENAME, self.BAUDRATE)
 
+    @property
+    def telemetry(self):
+        return self.robots[0].telemetry
+
+    @property
+    def telemetry_lost(self):
+        return self.robots[0].telemetry_lost
+
+    @property
+    def telemetry_dropped(self):
+        return self.robots[0].telemetry_dropped
+
+    @property
+    def link(self):
+        return self.robots[0].link
+
+    def select(self, robots = None, hold = False):
+        # Robots the following commands go to, by ID (the order they paired
+        # with the controller); None is all of them. With hold the robots keep
+        # the commands until sync_start().
+        self.target = list(robots) if robots is not None else None
+        self.hold = hold
+        return True
+
+    def sync_start(self, delay_ms = 20):
+        # Every robot holding commands applies them delay_ms from now, all in
+        # the same control tick. The delay covers the broadcast and the robots'
+        # next control cycle.
+        if not self.binary:
+            return False
+        self.serialHandler.write(encode_frame(SYNC_START.pack(MSG_SYNC_START, 0, int(delay_ms * 1000))))
+        return True
+
     def enable_torque(self):
-        self.serialHandler.write("0,0,0,0,0,0,0,0,0,0,1;".encode())
+        self._send([0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1])
         self.torque_on = True
         return True
     
     def disable_torque(self):
-        self.serialHandler.write("0,0,0,0,0,0,0,0,0,0,0;".encode())
+        self._send([0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0])
         self.torque_on = False
         return True
     
     def check_battery(self):
-        self.serialHandler.write("0,0,0,0,0,0,0,0,1,0,0;".encode())
+        self._send([0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0])
         return True
     
     def record_data(self):
-        self.serialHandler.write("0,0,0,0,0,0,0,0,2,0,0;".encode())
+        self._send([0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0])
         return True
     
     def finish_recording(self):
-        self.serialHandler.write("0,0,0,0,0,0,0,0,3,0,1;".encode())
+        self._send([0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 1])
         return True
     
     def send_jump(self):
-        self.serialHandler.write("0,0,0,0,0,0,0,0,4,0,0;".encode())
+        self._send([0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0])
         return True
 
+    def send_motion(self, motion_id):
+        # Keyframe sequence stored on the robot (q8Motion.cpp): 0 jump,
+        # 1 greet, 2 show range. Any move command or torque off cuts it short.
+        try:
+            self._send([motion_id, 0, 0, 0, 0, 0, 0, 0, 7, 0, int(self.torque_on)])
+        except:
+            return False
+        return True
+
+    def send_gait(self, gait_id, direction_id, stride = 100, period = 0):
+        # Robot generates the gait onboard until a stop or another move command.
+        # stride is % of the gait's xrange, period is ms per cycle (0 = default)
+        try:
+            self._send([gait_id, direction_id, stride, period, 0, 0, 0, 0, 5, 0,
+                        int(self.torque_on)])
+        except:
+            return False
+        return True
+
+    def stop_gait(self):
+        return self.send_gait(0, 0)
+
+    def start_telemetry(self, rate_hz = 100):
+        # Robot streams current/velocity/position of all joints at rate_hz
+        # (capped at the 250 Hz control rate). Samples are collected by poll().
+        for robot in (self.target if self.target is not None else range(FLEET_MAX)):
+            self.robots[robot] = RobotState()
+        try:
+            self._send([rate_hz, 0, 0, 0, 0, 0, 0, 0, 6, 0, int(self.torque_on)])
+        except:
+            return False
+        return True
+
+    def stop_telemetry(self):
+        # Robot sends the last partial frame, call poll() afterwards to get it
+        try:
+            self._send([0, 0, 0, 0, 0, 0, 0, 0, 6, 0, int(self.torque_on)])
+        except:
+            return False
+        return True
+
+    def poll(self):
+        # Read everything waiting on the serial port. Telemetry and trace
+        # frames are collected, text lines are returned. DATA frames (battery
+        # level, recorded data) come back as lines of values, as the
+        # controller used to print them, after "robot n:" for all but robot 0.
+        if self.serialHandler.in_waiting > 0:
+            self._rx_buf += self.serialHandler.read(self.serialHandler.in_waiting)
+        lines = []
+        while self._rx_buf:
+            sync = self._rx_buf.find(SERIAL_FRAME_SYNC)
+            text_end = self._rx_buf.find(b"\n")
+            if sync == 0:
+                if len(self._rx_buf) < 3 or len(self._rx_buf) < 5 + self._rx_buf[2]:
+                    break             # Wait for the rest of the frame
+                length = self._rx_buf[2]
+                body = bytes(self._rx_buf[2:3 + length])
+                crc = self._rx_buf[3 + length] | self._rx_buf[4 + length] << 8
+                if length == 0 or length > SERIAL_FRAME_MAX or binascii.crc_hqx(body, 0xFFFF) != crc:
+                    self.uplink_errors += 1
+                    del self._rx_buf[:1]          # Look for the next start marker
+                    continue
+                payload = body[1:]
+                robot = 0
+                if payload[0] == MSG_FLEET and len(payload) > FLEET_HEADER.size:
+                    robot = max((payload[1] & -payload[1]).bit_length() - 1, 0)
+                    payload = payload[FLEET_HEADER.size:]
+                if payload[0] == MSG_DATA:
+                    count = (len(payload) - 2) // 2
+                    line = " ".join(map(str, struct.unpack_from(f"<{count}H", payload, 2)))
+                    lines.append(line if robot == 0 else f"robot {robot}: {line}")
+                else:
+                    self._parse_frame(payload, self.robots[robot])
+                del self._rx_buf[:5 + length]
+            elif text_end >= 0 and (sync < 0 or text_end < sync):
+                lines.append(self._rx_buf[:text_end].decode("utf-8", "replace").strip())
+                del self._rx_buf[:text_end + 1]
+            elif sync > 0:
+                lines.append(self._rx_buf[:sync].decode("utf-8", "replace").strip())
+                del self._rx_buf[:sync]
+            else:
+                break                 # Partial text line
+        return lines
+
+    def latency_report(self):
+        # p50/p99 and a histogram of each stage of the traced commands. rtt is
+        # the PC write to the trace record coming back; what is not in the
+        # stages is USB both ways and the way back over the air.
+        if not self.traces:
+            return "No latency traces received"
+        edges = [100, 200, 500, 1000, 2000, 5000, 10000, 20000]
+        labels = ["<100", "<200", "<500", "<1ms", "<2ms", "<5ms", "<10ms", "<20ms", "more"]
+        lines = [f"{len(self.traces)} traced commands, {len(self._trace_sent)} without a record",
+                 "stage       p50 us   p99 us   max us  " + " ".join(f"{l:>6}" for l in labels)]
+        for i, name in enumerate(TRACE_STAGES + ["rtt"]):
+            values = sorted(t[i + 1] for t in self.traces)
+            counts = [0] * len(labels)
+            for v in values:
+                counts[sum(1 for e in edges if v >= e)] += 1
+            p50 = values[len(values) // 2]
+            p99 = values[min(len(values) - 1, len(values) * 99 // 100)]
+            lines.append(f"{name:<8} {p50:>9} {p99:>8} {values[-1]:>8}  " +
+                         " ".join(f"{c:>6}" for c in counts))
+        return "\n".join(lines)
+
+    def save_telemetry(self, path, robot = 0):
+        # One CSV row per sample: time, ok mask, then current, velocity and
+        # position of joints 1-8 (raw register units)
+        telemetry = self.robots[robot].telemetry
+        with open(path, "w") as f:
+            header = ["timestamp_us", "ok_mask"]
+            for name in ("current", "velocity", "position"):
+                header += [f"{name}{i + 1}" for i in range(8)]
+            f.write(",".join(header) + "\n")
+            for t, mask, cur, vel, pos in telemetry:
+                f.write(",".join(map(str, [t, mask, *cur, *vel, *pos])) + "\n")
+        return len(telemetry)
+
     def move_all(self, joints_pos, dur = 0, record = True):
         # Expects 8 positions in deg. For example: [0, 90, 0, 90, 0, 90, 0, 90]
         try:
             # If record is true, the 9th element is set to value 2. Else 0.
-            cmd = ",".join(map(str, joints_pos)) + f",{record*2}," + f"{dur}," + f"{int(self.torque_on)};" 
-            # print(cmd)
-            self.serialHandler.write(cmd.encode())
+            self._send(list(joints_pos) + [record*2, dur, int(self.torque_on)])
         except:
             return False
         return True
@@ -66,7 +348,27 @@ class q8_espnow:
             mirrored_pos.append(joint_pos[0])
             mirrored_pos.append(joint_pos[1])
         return self.move_all(mirrored_pos, dur, False)
-    
+
+    def move_feet(self, feet_xy, dur = 0):
+        # Expects 4 foot positions in mm, solved by the IK on the robot.
+        # For example: [9.75, 43.36, 9.75, 43.36, 9.75, 43.36, 9.75, 43.36]
+        try:
+            # 12th element set to 1 marks the first 8 values as foot x/y.
+            self._send(list(feet_xy) + [0, dur, int(self.torque_on), 1])
+        except:
+            return False
+        return True
+
+    def move_timed(self, joints_pos, dur, record = False):
+        # Same as move_all, but the robot writes the duration together with the
+        # goal positions in one bus packet, so all joints start on the new timing.
+        try:
+            # 13th element set to 1 marks a timed move.
+            self._send(list(joints_pos) + [record*2, dur, int(self.torque_on), 0, 1])
+        except:
+            return False
+        return True
+
     def bulkread(self, addr, len = 4):
         value = [0 for i in range(8)]
         return value, True
@@ -101,4 +403,51 @@ class q8_espnow:
     #-------------------#
     
     def _set_profile(self, dur_ms):
-        return
\ No newline at end of file
+        return
+
+    def _send(self, values):
+        # One command, as a binary frame or as the legacy CSV text (to all robots)
+        if self.binary:
+            self._seq = (self._seq + 1) & 0xFFFF
+            trace_id = None
+            if self.trace_every and self._seq % self.trace_every == 0:
+                trace_id = self._seq
+                self._trace_sent[trace_id] = time.perf_counter()
+            self.serialHandler.write(encode_command(values, self._seq, trace_id, self.target, self.hold))
+        else:
+            self.serialHandler.write((",".join(map(str, values)) + ";").encode())
+
+    def _parse_frame(self, payload, robot):
+        if len(payload) >= 2 and payload[0] == MSG_TRACE:
+            self._parse_trace(payload)
+            return
+        if len(payload) >= LINK_STATS.size and payload[0] == MSG_LINK_STATS:
+            v = LINK_STATS.unpack_from(payload)
+            robot.link = dict(zip(["samples", "loss", "robot_loss", "rtt_min_us", "rtt_mean_us",
+                                  "rtt_p99_us", "heartbeats", "skipped", "echoes", "lost"], v[1:]))
+            return
+        if len(payload) < TELEMETRY_HEADER.size or payload[0] != MSG_TELEMETRY:
+            return
+        _, count, seq, dropped = TELEMETRY_HEADER.unpack_from(payload)
+        if robot._telemetry_seq is not None:
+            robot.telemetry_lost += (seq - robot._telemetry_seq - 1) & 0xFFFF
+        robot._telemetry_seq = seq
+        robot.telemetry_dropped += dropped
+        offset = TELEMETRY_HEADER.size
+        for _ in range(count):
+            if offset + TELEMETRY_SAMPLE.size > len(payload):
+                break
+            v = TELEMETRY_SAMPLE.unpack_from(payload, offset)
+            robot.telemetry.append((v[0], v[1], v[3:11], v[11:19], v[19:27]))
+            offset += TELEMETRY_SAMPLE.size
+
+    def _parse_trace(self, payload):
+        now = time.perf_counter()
+        for i in range(payload[1]):
+            offset = 2 + i * TRACE_RECORD.size
+            if offset + TRACE_RECORD.size > len(payload):
+                break
+            record = TRACE_RECORD.unpack_from(payload, offset)
+            sent = self._trace_sent.pop(record[0], None)
+            if sent is not None:
+                self.traces.append(record + (int((now - sent) * 1e6),))
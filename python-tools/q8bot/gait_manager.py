@@ -28,6 +28,14 @@ GAITS = {
     'PRONK':     ['pronk', 9.75, 33.36, 40, 0, 20, 60, 10],
 }
 
+# Direction ids for the onboard gait command (GaitDir in firmware q8Protocol.h).
+# The robot indexes its gait table in the same order as GAITS above.
+GAIT_DIRECTIONS = {
+    'f': 1, 'b': 2, 'l': 3, 'r': 4,
+    'fl_0.75': 5, 'fl_0.5': 6, 'fr_0.75': 7, 'fr_0.5': 8,
+    'bl_0.75': 9, 'bl_0.5': 10, 'br_0.75': 11, 'br_0.5': 12,
+}
+
 
 class GaitManager:
     """
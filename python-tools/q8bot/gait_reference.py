@@ -0,0 +1,20 @@
+'''
+Dumps the joint trajectories of every gait in GAITS as CSV, one row per
+trajectory point: gait_id, direction_id, index, q1_1, q2_1, ... q1_4, q2_4.
+The firmware native build compares its onboard gait engine against this.
+
+Usage: python gait_reference.py > gait_reference.csv
+       <robot native program> gait_reference.csv
+'''
+
+from kinematics_solver import k_solver
+from gait_manager import GaitManager, GAITS, GAIT_DIRECTIONS
+
+leg = k_solver()
+for gait_id, name in enumerate(GAITS):
+    gait_manager = GaitManager(leg, GAITS)
+    if not gait_manager.load_gait(name):
+        continue
+    for direction, trajectory in gait_manager.current_trajectories[name].items():
+        for i, pos in enumerate(trajectory):
+            print(f"{gait_id},{GAIT_DIRECTIONS[direction]},{i}," + ",".join(map(str, pos)))
@@ -12,7 +12,7 @@ import argparse
 from kinematics_solver import k_solver
 from espnow import q8_espnow
 from helpers import XiaoPortFinder, Q8Logger
-from gait_manager import GaitManager, GAITS
+from gait_manager import GaitManager, GAITS, GAIT_DIRECTIONS
 from routine_generator import show_range, greet
 from input_handler import InputHandler, detect_and_init_joystick
 
@@ -25,6 +25,9 @@ L2 = 40             # Lower leg length
 SPEED = 200
 res = 0.2
 
+# Telemetry stream rate while recording (Hz)
+TELEMETRY_HZ = 100
+
 # Helper Functions
 def move_xy(x, y, dur = 0, deg = True):
     """Move robot legs to specific x,y position."""
@@ -36,6 +39,8 @@ def move_xy(x, y, dur = 0, deg = True):
 parser = argparse.ArgumentParser(description='Q8bot control script')
 parser.add_argument('com_port', nargs='?', help='COM port for ESP32C3 (optional, auto-detect if not provided)')
 parser.add_argument('--debug', action='store_true', help='Enable debug logging')
+parser.add_argument('--onboard-gait', action='store_true', help='Generate gaits on the robot instead of streaming them')
+parser.add_argument('--trace', type=int, default=0, metavar='N', help='Trace the latency of every Nth command, report on exit')
 args = parser.parse_args()
 
 # Initialize logger
@@ -46,6 +51,7 @@ movement = False
 exit = False
 record = False
 request = "none"
+onboard_direction = None  # Direction last sent to the onboard gait engine
 
 # Find a serial port and connect
 if args.com_port:
@@ -102,7 +108,7 @@ except Exception as e:
 
 # Initialize kinamatics solver and Q8bot ESPNow instance
 leg = k_solver(CENTER_DIST, L1, L2, L1, L2)
-q8 = q8_espnow(com_port)
+q8 = q8_espnow(com_port, trace_every=args.trace)
 q8.enable_torque()
 
 # Initialize GaitManager
@@ -126,6 +132,10 @@ while True:
     clock.tick(SPEED)
     pygame.event.get()
 
+    # Keep draining the serial port while the telemetry stream or tracing is on
+    if record or (args.trace and movement):
+        q8.poll()
+
     # Clear screen and render logger messages
     window.fill((0, 0, 0))  # Black background
 
@@ -143,17 +153,35 @@ while True:
         if requested_direction:
             # Start or switch movement direction
             if gait_manager.start_movement(requested_direction):
-                # Execute current trajectory
-                pos = gait_manager.tick()
-                if pos:
-                    q8.move_all(pos, 0, record)
+                if args.onboard_gait:
+                    # Robot runs the trajectory, only send direction changes
+                    if requested_direction != onboard_direction:
+                        gait_id = list(GAITS.keys()).index(gait_manager.current_gait)
+                        q8.send_gait(gait_id, GAIT_DIRECTIONS[requested_direction])
+                        onboard_direction = requested_direction
+                else:
+                    # Execute current trajectory
+                    pos = gait_manager.tick()
+                    if pos:
+                        q8.move_all(pos, 0, False)
             else:
                 # Failed to start movement
                 movement = False
         else:
             # No movement input - transition to idle
+            if onboard_direction:
+                q8.stop_gait()
+                onboard_direction = None
             move_xy(pos_x, pos_y, 0)
-            q8.finish_recording()
+            if record:
+                # Stop the stream and save what arrived
+                q8.stop_telemetry()
+                time.sleep(0.1)
+                q8.poll()
+                path = time.strftime("telemetry_%Y%m%d_%H%M%S.csv")
+                count = q8.save_telemetry(path)
+                log.info(f"Saved {count} samples to {path} "
+                         f"({q8.telemetry_lost} frames lost, {q8.telemetry_dropped} samples dropped)")
             record = False
             gait_manager.stop()
             movement = False
@@ -192,8 +220,8 @@ while True:
             time.sleep(0.2)
         elif input_handler.is_action_pressed('record'):
             log.debug("Record next movement")
+            q8.start_telemetry(TELEMETRY_HZ)
             record = True
-            request = "data"
             time.sleep(0.2)
         elif input_handler.is_action_pressed('show_range'):
             log.info("Show Range")
@@ -208,19 +236,22 @@ while True:
             break
         else:
             try:
-                while q8.serialHandler.in_waiting > 0:  # Check if there is any data waiting to be read
-                    raw_data = q8.serialHandler.readline().decode('utf-8').strip() # Read a line and decode it
-                    raw_data = raw_data.split()
+                for line in q8.poll():  # Text lines; telemetry frames are collected separately
+                    raw_data = line.split()
                     while raw_data and raw_data[-1] == '0':
                         raw_data.pop()
                     # print(f"Received data: {raw_data}")
-                    if request == "battery":
+                    if request == "battery" and raw_data:
                         log.info(f"Battery: {int(raw_data[0])}%")
-                request = "none"
+                        request = "none"
             except:
                 log.debug("Data reading failed. Continuing...")
 
 q8.disable_torque()
+if args.trace:
+    time.sleep(0.1)
+    q8.poll()
+    log.info(q8.latency_report())
 if joystick:
     joystick.quit()
 pygame.quit()
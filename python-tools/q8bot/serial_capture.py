@@ -0,0 +1,103 @@
+'''
+Records the serial traffic operate.py sends to the controller, for the
+serial-to-air latency harness of the controller firmware
+(firmware/q8bot_controller/src/native/simMain.cpp).
+
+Runs a scripted session at the operate.py loop rate: torque on, stand, stream
+a trot forward and turning, stop, torque off. Every serial write is logged as
+"time_us,hex bytes", one line per write. With a COM port the writes also go
+to the controller, so the robot can be driven while recording.
+
+    python serial_capture.py capture.txt
+    python serial_capture.py capture_csv.txt --csv
+    python serial_capture.py capture.txt --port COM5
+'''
+
+import argparse
+import time
+import espnow
+from espnow import q8_espnow
+from kinematics_solver import k_solver
+from gait_manager import GaitManager, GAITS
+
+# Same as operate.py
+CENTER_DIST = 19.5
+L1 = 25
+L2 = 40
+SPEED = 200
+
+
+class RecordingSerial:
+    """Stands in for serial.Serial, logs each write with its time."""
+
+    def __init__(self, port = None, baud = 115200):
+        self.writes = []
+        self.in_waiting = 0
+        self._start = time.perf_counter()
+        self._port = espnow.serial.Serial(port, baud) if port else None
+
+    def write(self, data):
+        self.writes.append((int((time.perf_counter() - self._start) * 1e6), bytes(data)))
+        if self._port:
+            self._port.write(data)
+        return len(data)
+
+    def read(self, size = 1):
+        return b""
+
+
+def run_session(q8, seconds):
+    leg = k_solver(CENTER_DIST, L1, L2, L1, L2)
+    gait_manager = GaitManager(leg, GAITS)
+    gait_manager.load_gait('TROT')
+    x, y = GAITS['TROT'][1], GAITS['TROT'][2]
+
+    def stand(dur):
+        q1, q2, _ = leg.ik_solve(x, y, True, 1)
+        q8.move_mirror([q1, q2], dur)
+
+    q8.enable_torque()
+    stand(1000)
+    time.sleep(0.5)
+
+    # Stream the gait like operate.py, one move_all per loop tick
+    period = 1.0 / SPEED
+    next_tick = time.perf_counter()
+    for direction, share in (('f', 0.6), ('fl_0.75', 0.2), ('r', 0.2)):
+        gait_manager.start_movement(direction)
+        end = time.perf_counter() + seconds * share
+        while time.perf_counter() < end:
+            pos = gait_manager.tick()
+            if pos:
+                q8.move_all(pos, 0, False)
+            next_tick += period
+            time.sleep(max(0.0, next_tick - time.perf_counter()))
+
+    gait_manager.stop()
+    stand(0)
+    time.sleep(0.2)
+    q8.disable_torque()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Record the serial traffic of a scripted Q8bot session')
+    parser.add_argument('out', help='Output file, one "time_us,hex" line per write')
+    parser.add_argument('--csv', action='store_true', help='Send the legacy CSV text instead of binary frames')
+    parser.add_argument('--port', help='Also send to the controller on this port')
+    parser.add_argument('--seconds', type=float, default=5.0, help='Gait streaming time')
+    args = parser.parse_args()
+
+    recorder = RecordingSerial(args.port)
+    serial_class = espnow.serial.Serial
+    espnow.serial.Serial = lambda port, baud: recorder
+    q8 = q8_espnow(args.port, binary=not args.csv)
+    espnow.serial.Serial = serial_class
+
+    run_session(q8, args.seconds)
+
+    with open(args.out, "w") as f:
+        f.write(f"# {'csv' if args.csv else 'binary'}, {len(recorder.writes)} writes\n")
+        for t, data in recorder.writes:
+            f.write(f"{t},{data.hex()}\n")
+    total = sum(len(d) for _, d in recorder.writes)
+    print(f"{len(recorder.writes)} writes, {total} bytes, {recorder.writes[-1][0] / 1e6:.1f} s -> {args.out}")